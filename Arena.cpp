@@ -0,0 +1,115 @@
+/*
+ * Arena
+ *
+ * A region allocator for memory that lives exactly as long as a scene.
+ */
+
+#include "Arena.h"
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <sys/mman.h>
+#include <unistd.h>
+
+static const size_t hugePageSize = 2 << 20;
+
+static size_t roundUp( size_t size, size_t multiple ){
+  return (size + multiple - 1) / multiple * multiple;
+}
+
+Arena::Arena( size_t chunkSize, bool hugePages ) : _next(NULL), _end(NULL), _chunkSize(chunkSize), _hugePages(hugePages){
+  memset(&_stats, 0, sizeof(_stats));
+}
+
+Arena::~Arena( ){
+  reset( );
+}
+
+/*
+ * Fresh anonymous pages read as zero, so nothing handed out needs to be
+ * cleared.
+ */
+char* Arena::mapChunk( size_t size ){
+  void *p;
+  if( _hugePages ){
+    // Over-map so the chunk can start on a huge page boundary
+    size_t mapped = size + hugePageSize;
+    p = mmap(NULL, mapped, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if( p != MAP_FAILED ){
+      char *base = (char*)p;
+      char *aligned = (char*)roundUp((uintptr_t)base, hugePageSize);
+      if( aligned > base ){
+        munmap(base, aligned - base);
+      }
+      if( base + mapped > aligned + size ){
+        munmap(aligned + size, base + mapped - (aligned + size));
+      }
+      p = aligned;
+#ifdef MADV_HUGEPAGE
+      madvise(p, size, MADV_HUGEPAGE);
+#endif
+    }
+  }else{
+    p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  }
+  if( p == MAP_FAILED ){
+    std::cerr << "Could not allocate memory." << std::endl;
+    exit(1);
+  }
+  Chunk c = { (char*)p, size };
+  _chunks.push_back(c);
+  _stats.chunks++;
+  _stats.reserved += size;
+  if( _stats.reserved > _stats.peakReserved ){
+    _stats.peakReserved = _stats.reserved;
+  }
+  return (char*)p;
+}
+
+void* Arena::allocate( size_t size, size_t alignment ){
+  std::lock_guard<std::mutex> lock(_mutex);
+  _stats.allocations++;
+  _stats.requested += size;
+  if( size == 0 ){
+    size = 1;
+  }
+  char *p = _next ? (char*)roundUp((uintptr_t)_next, alignment) : NULL;
+  if( p == NULL || p + size > _end ){
+    size_t page = _hugePages ? hugePageSize : (size_t)sysconf(_SC_PAGESIZE);
+    if( size > _chunkSize / 2 ){
+      // Too big to share a chunk; keep filling the current one
+      _stats.used += size;
+      return mapChunk(roundUp(size, page));
+    }
+    size_t chunk = roundUp(_chunkSize, page);
+    _next = mapChunk(chunk);
+    _end = _next + chunk;
+    p = _next;
+  }
+  _stats.used += (p + size) - _next;
+  _next = p + size;
+  return p;
+}
+
+void Arena::reset( ){
+  std::lock_guard<std::mutex> lock(_mutex);
+  for( size_t i = 0; i < _chunks.size( ); i++ ){
+    munmap(_chunks[i].base, _chunks[i].size);
+  }
+  _chunks.clear( );
+  _next = NULL;
+  _end = NULL;
+  _stats.allocations = 0;
+  _stats.requested = 0;
+  _stats.used = 0;
+  _stats.reserved = 0;
+  _stats.chunks = 0;
+  _stats.resets++;
+}
+
+ArenaStats Arena::stats( ){
+  std::lock_guard<std::mutex> lock(_mutex);
+  return _stats;
+}
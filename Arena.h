@@ -0,0 +1,89 @@
+/*
+ * Arena
+ *
+ * A region allocator for memory that lives exactly as long as a scene.
+ * Allocations are carved out of large chunks mapped straight from the
+ * operating system and are never freed one at a time; reset( ) or the
+ * destructor returns every chunk at once, no matter how many objects
+ * were allocated. Since nothing of a scene stays behind on the heap,
+ * loading and unloading scenes over and over does not fragment it.
+ */
+
+#include <cstddef>
+#include <mutex>
+#include <new>
+#include <utility>
+#include <vector>
+
+#ifndef _ARENA_H_
+#define _ARENA_H_
+
+struct ArenaStats{
+  // allocate( ) calls since the last reset
+  size_t allocations;
+  // bytes asked for by those calls
+  size_t requested;
+  // bytes handed out, including alignment padding
+  size_t used;
+  // bytes mapped in chunks
+  size_t reserved;
+  int chunks;
+  // the most reserved at any one time, over every reset
+  size_t peakReserved;
+  int resets;
+};
+
+class Arena{
+public:
+  /*
+   * chunkSize is how much is mapped at a time; larger allocations get a
+   * chunk of their own. With hugePages the chunks are aligned to and
+   * sized in 2MB pages and the kernel is asked to back them with
+   * transparent huge pages, where it supports them.
+   */
+  explicit Arena( size_t chunkSize = 4 << 20, bool hugePages = false );
+  ~Arena( );
+
+  /*
+   * Zeroed memory of at least size bytes aligned to alignment, a power
+   * of two no larger than a page. Safe to call from several threads.
+   * Exits the program if memory runs out.
+   */
+  void* allocate( size_t size, size_t alignment = 64 );
+
+  /*
+   * Construct a T in the arena. Its destructor is never run, so T must
+   * not own anything outside the arena.
+   */
+  template <typename T, typename... Args>
+  T* make( Args&&... args ){
+    return new (allocate(sizeof(T), alignof(T) < 64 ? 64 : alignof(T))) T(std::forward<Args>(args)...);
+  }
+
+  // Release every allocation at once. Nothing allocated may be used
+  // afterwards.
+  void reset( );
+
+  ArenaStats stats( );
+
+private:
+  Arena( const Arena& );
+  Arena& operator =( const Arena& );
+
+  struct Chunk{
+    char* base;
+    size_t size;
+  };
+
+  char* mapChunk( size_t size );
+
+  std::mutex _mutex;
+  std::vector<Chunk> _chunks;
+  char* _next;
+  char* _end;
+  size_t _chunkSize;
+  bool _hugePages;
+  ArenaStats _stats;
+};
+
+#endif
@@ -9,9 +9,263 @@
 #include "BBox.h"
 #include "GFXMath.h"
 #include "GFXExtra.h"
+#include <algorithm>
 
-void BBox::align(){
-	//
+BBox::BBox(){
+	width = 0;
+	oriented = false;
+	//encloses nothing until enclose() is called, so it rules nothing out
+	aabbMin = Vec3(-HUGE_VALF, -HUGE_VALF, -HUGE_VALF);
+	aabbMax = Vec3(HUGE_VALF, HUGE_VALF, HUGE_VALF);
+}
+
+//turn a into the eigenvectors of the symmetric matrix m by Jacobi rotations,
+//largest eigenvalue first; a is in columns
+static void eigenvectors(double m[3][3], double a[3][3]){
+	for(int i = 0; i < 3; i++){
+		for(int j = 0; j < 3; j++){
+			a[i][j] = i == j;
+		}
+	}
+	for(int sweep = 0; sweep < 32; sweep++){
+		double off = m[0][1]*m[0][1] + m[0][2]*m[0][2] + m[1][2]*m[1][2];
+		if(off <= 1e-24 * (m[0][0]*m[0][0] + m[1][1]*m[1][1] + m[2][2]*m[2][2]) || off == 0){
+			break;
+		}
+		for(int p = 0; p < 2; p++){
+			for(int q = p + 1; q < 3; q++){
+				if(m[p][q] == 0){
+					continue;
+				}
+				//the rotation that zeroes m[p][q]
+				double theta = (m[q][q] - m[p][p]) / (2 * m[p][q]);
+				double t = (theta >= 0 ? 1 : -1) / (fabs(theta) + sqrt(theta*theta + 1));
+				double c = 1 / sqrt(t*t + 1);
+				double s = t * c;
+				for(int k = 0; k < 3; k++){
+					double mkp = m[k][p], mkq = m[k][q];
+					m[k][p] = c*mkp - s*mkq;
+					m[k][q] = s*mkp + c*mkq;
+				}
+				for(int k = 0; k < 3; k++){
+					double mpk = m[p][k], mqk = m[q][k];
+					m[p][k] = c*mpk - s*mqk;
+					m[q][k] = s*mpk + c*mqk;
+				}
+				for(int k = 0; k < 3; k++){
+					double akp = a[k][p], akq = a[k][q];
+					a[k][p] = c*akp - s*akq;
+					a[k][q] = s*akp + c*akq;
+				}
+			}
+		}
+	}
+	//sort by eigenvalue
+	for(int i = 0; i < 2; i++){
+		for(int j = i + 1; j < 3; j++){
+			if(m[j][j] > m[i][i]){
+				std::swap(m[i][i], m[j][j]);
+				for(int k = 0; k < 3; k++){
+					std::swap(a[k][i], a[k][j]);
+				}
+			}
+		}
+	}
+}
+
+//the box around fl's vertices along axis (columns); returns its volume
+static double fitBox(const FaceList *fl, double axis[3][3], double lo[3], double hi[3]){
+	for(int j = 0; j < 3; j++){
+		lo[j] = HUGE_VAL;
+		hi[j] = -HUGE_VAL;
+	}
+	for(int i = 0; i < fl->vc; i++){
+		const FaceList::Real *v = fl->vertices[i];
+		for(int j = 0; j < 3; j++){
+			double d = v[0]*axis[0][j] + v[1]*axis[1][j] + v[2]*axis[2][j];
+			lo[j] = std::min(lo[j], d);
+			hi[j] = std::max(hi[j], d);
+		}
+	}
+	return (hi[0] - lo[0]) * (hi[1] - lo[1]) * (hi[2] - lo[2]);
+}
+
+//fit the box to fl in its own model space: along the principal axes of its
+//surface (Gottschalk, Lin and Manocha 1996), or along x, y and z if that box
+//is smaller; center and width are left alone
+void BBox::align(const FaceList *fl){
+	oriented = false;
+	if(fl == NULL || fl->vc == 0){
+		return;
+	}
+	//covariance of the surface, each triangle weighted by its area, so
+	//closely spaced vertices do not pull the axes their way
+	double mean[3] = {0, 0, 0};
+	double m[3][3] = {{0, 0, 0}, {0, 0, 0}, {0, 0, 0}};
+	double total = 0;
+	for(int f = 0; f < fl->fc; f++){
+		const FaceList::Real *p = fl->vertices[fl->faces[f][0]];
+		const FaceList::Real *q = fl->vertices[fl->faces[f][1]];
+		const FaceList::Real *r = fl->vertices[fl->faces[f][2]];
+		double u[3], v[3];
+		for(int j = 0; j < 3; j++){
+			u[j] = q[j] - p[j];
+			v[j] = r[j] - p[j];
+		}
+		double n[3] = {u[1]*v[2] - u[2]*v[1], u[2]*v[0] - u[0]*v[2], u[0]*v[1] - u[1]*v[0]};
+		double area = 0.5 * sqrt(n[0]*n[0] + n[1]*n[1] + n[2]*n[2]);
+		total += area;
+		for(int j = 0; j < 3; j++){
+			mean[j] += area * (p[j] + q[j] + r[j]) / 3;
+			for(int k = 0; k < 3; k++){
+				m[j][k] += area / 12 * (9 * (p[j] + q[j] + r[j]) / 3 * (p[k] + q[k] + r[k]) / 3
+					+ p[j]*p[k] + q[j]*q[k] + r[j]*r[k]);
+			}
+		}
+	}
+	//no area to go by; use the vertices
+	if(total <= 0){
+		for(int i = 0; i < fl->vc; i++){
+			const FaceList::Real *p = fl->vertices[i];
+			for(int j = 0; j < 3; j++){
+				mean[j] += p[j];
+				for(int k = 0; k < 3; k++){
+					m[j][k] += p[j]*p[k];
+				}
+			}
+		}
+		total = fl->vc;
+	}
+	for(int j = 0; j < 3; j++){
+		mean[j] /= total;
+	}
+	for(int j = 0; j < 3; j++){
+		for(int k = 0; k < 3; k++){
+			m[j][k] = m[j][k] / total - mean[j] * mean[k];
+		}
+	}
+	double axis[3][3], lo[3], hi[3];
+	eigenvectors(m, axis);
+	double volume = fitBox(fl, axis, lo, hi);
+	double identity[3][3] = {{1, 0, 0}, {0, 1, 0}, {0, 0, 1}};
+	double alignedLo[3], alignedHi[3];
+	if(fitBox(fl, identity, alignedLo, alignedHi) < volume){
+		for(int j = 0; j < 3; j++){
+			lo[j] = alignedLo[j];
+			hi[j] = alignedHi[j];
+			for(int k = 0; k < 3; k++){
+				axis[j][k] = identity[j][k];
+			}
+		}
+	}
+	boxCenter = Vec3(0, 0, 0);
+	for(int j = 0; j < 3; j++){
+		axes[j] = Vec3(axis[0][j], axis[1][j], axis[2][j]);
+		extents[j] = (hi[j] - lo[j]) * 0.5;
+		boxCenter += axes[j] * float((hi[j] + lo[j]) * 0.5);
+	}
+	oriented = true;
+}
+
+//this box becomes local's moved by model, which scales by scale in every direction
+void BBox::orient(const BBox &local, Mat4 model, float scale){
+	oriented = local.oriented;
+	if(!oriented){
+		return;
+	}
+	Vec4 c = model * Vec4(local.boxCenter[0], local.boxCenter[1], local.boxCenter[2], 1);
+	boxCenter = Vec3(c[0], c[1], c[2]);
+	for(int j = 0; j < 3; j++){
+		Vec4 a = model * Vec4(local.axes[j][0], local.axes[j][1], local.axes[j][2], 0);
+		axes[j] = normalize(Vec3(a[0], a[1], a[2]));
+		extents[j] = local.extents[j] * fabs(scale);
+	}
+}
+
+//the world box around the model box [localMin, localMax] moved by model;
+//it takes the same few operations for any model however it is turned
+void BBox::enclose(Vec3 localMin, Vec3 localMax, Mat4 model){
+	FaceList::transformBox((const float*)model, (const float*)localMin, (const float*)localMax,
+		(float*)aabbMin, (float*)aabbMax);
+}
+
+//whether everything in the sphere, the axis aligned box or the oriented box
+//lies on the side of the plane through point that normal points to
+bool BBox::outside(Vec3 normal, Vec3 point){
+	if(dot(normal, center - point) > width * length(normal)){
+		return true;
+	}
+	//the corner of the axis aligned box farthest back along normal
+	Vec3 nearest;
+	for(int j = 0; j < 3; j++){
+		nearest[j] = normal[j] >= 0 ? aabbMin[j] : aabbMax[j];
+	}
+	if(dot(normal, nearest - point) > 0){
+		return true;
+	}
+	if(!oriented){
+		return false;
+	}
+	float r = extents[0] * fabs(dot(normal, axes[0]))
+		+ extents[1] * fabs(dot(normal, axes[1]))
+		+ extents[2] * fabs(dot(normal, axes[2]));
+	return dot(normal, boxCenter - point) > r;
+}
+
+//whether the axis aligned boxes and the spheres meet and, if both have one,
+//the oriented boxes too; those are tested on the 15 axes that can separate
+//them (Gottschalk, Lin and Manocha 1996)
+bool BBox::overlaps(const BBox &other){
+	//the axis aligned boxes are the cheapest to rule a pair out with
+	for(int j = 0; j < 3; j++){
+		if(aabbMin[j] > other.aabbMax[j] || other.aabbMin[j] > aabbMax[j]){
+			return false;
+		}
+	}
+	Vec3 d = other.center - center;
+	float reach = width + other.width;
+	if(dot(d, d) > reach * reach){
+		return false;
+	}
+	if(!oriented || !other.oriented){
+		return true;
+	}
+	//other's axes and offset in this box's frame
+	float r[3][3], absR[3][3], t[3];
+	Vec3 offset = other.boxCenter - boxCenter;
+	for(int i = 0; i < 3; i++){
+		for(int j = 0; j < 3; j++){
+			r[i][j] = dot(axes[i], other.axes[j]);
+			//edges that are nearly parallel give a cross product of almost nothing
+			absR[i][j] = fabs(r[i][j]) + 1e-6f;
+		}
+		t[i] = dot(offset, axes[i]);
+	}
+	const Vec3 &a = extents;
+	const Vec3 &b = other.extents;
+	for(int i = 0; i < 3; i++){
+		if(fabs(t[i]) > a[i] + b[0]*absR[i][0] + b[1]*absR[i][1] + b[2]*absR[i][2]){
+			return false;
+		}
+	}
+	for(int j = 0; j < 3; j++){
+		if(fabs(t[0]*r[0][j] + t[1]*r[1][j] + t[2]*r[2][j]) > a[0]*absR[0][j] + a[1]*absR[1][j] + a[2]*absR[2][j] + b[j]){
+			return false;
+		}
+	}
+	//axes[i] x other.axes[j]
+	for(int i = 0; i < 3; i++){
+		int i1 = (i + 1) % 3, i2 = (i + 2) % 3;
+		for(int j = 0; j < 3; j++){
+			int j1 = (j + 1) % 3, j2 = (j + 2) % 3;
+			float ra = a[i1]*absR[i2][j] + a[i2]*absR[i1][j];
+			float rb = b[j1]*absR[i][j2] + b[j2]*absR[i][j1];
+			if(fabs(t[i2]*r[i1][j] - t[i1]*r[i2][j]) > ra + rb){
+				return false;
+			}
+		}
+	}
+	return true;
 }
 
 Vec3 BBox::frontNorm(){
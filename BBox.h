@@ -16,10 +16,26 @@
 class BBox{
 	public:
 	Vec3 center;
-	float width;
+	float width;	//radius of the bounding sphere about center
 	Vec4 vertices[8];
-	
-	void align();
+	Vec3 boxCenter;	//box turned to fit the model, for long thin models a sphere fits badly
+	Vec3 axes[3];	//unit length and at right angles
+	Vec3 extents;	//half the size of the box along each of axes
+	bool oriented;	//false until align() or orient() gives it a box
+	Vec3 aabbMin;	//axis aligned box in world space, from the model's own by enclose()
+	Vec3 aabbMax;
+
+	BBox();
+
+	void align(const FaceList *fl);
+
+	void orient(const BBox &local, Mat4 model, float scale);
+
+	void enclose(Vec3 localMin, Vec3 localMax, Mat4 model);
+
+	bool outside(Vec3 normal, Vec3 point);
+
+	bool overlaps(const BBox &other);
 
 	Vec3 frontNorm();
 
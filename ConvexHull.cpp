@@ -0,0 +1,617 @@
+/*
+ * ConvexHull
+ */
+
+#include "ConvexHull.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdint.h>
+#include <unordered_map>
+#include <vector>
+
+namespace{
+
+double dot3( const double *a, const double *b ){
+  return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+void cross3( double *n, const double *u, const double *v ){
+  n[0] = u[1] * v[2] - u[2] * v[1];
+  n[1] = u[2] * v[0] - u[0] * v[2];
+  n[2] = u[0] * v[1] - u[1] * v[0];
+}
+
+void sub3( double *c, const double *a, const double *b ){
+  for( int j = 0; j < 3; j++ ){
+    c[j] = a[j] - b[j];
+  }
+}
+
+struct HullFace{
+  int v[3];
+  // n . p = d on the face, n facing out
+  double n[3];
+  double d;
+  // points in front of the face, and the farthest of them
+  std::vector<int> outside;
+  int farthest;
+  double farthestDistance;
+  bool alive;
+};
+
+/*
+ * Quickhull over count points of 3 doubles each. Each step takes the
+ * farthest point in front of some face, removes every face it can see
+ * and joins the edge around them to it.
+ */
+class Quickhull{
+public:
+  Quickhull( const double *points, int count ) : _p(points), _count(count){
+    double extent = 0.0;
+    for( int i = 0; i < 3 * count; i++ ){
+      extent = std::max(extent, fabs(points[i]));
+    }
+    _epsilon = 1e-10 * std::max(extent, 1e-30);
+  }
+
+  /*
+   * Build the hull, stopping before it would have more than maxFaces
+   * faces when maxFaces is above 0. Returns false if the points have
+   * no volume. complete( ) tells whether any point was left out.
+   */
+  bool build( int maxFaces ){
+    int first[4] = { 0, 0, 0, 0 };
+    if( !simplex(first) ){
+      return false;
+    }
+    for( int j = 0; j < 3; j++ ){
+      _inside[j] = 0.25 * (_p[3 * first[0] + j] + _p[3 * first[1] + j] + _p[3 * first[2] + j] + _p[3 * first[3] + j]);
+    }
+    int start = (int)_faces.size( );
+    addFace(first[0], first[1], first[2]);
+    addFace(first[0], first[1], first[3]);
+    addFace(first[0], first[2], first[3]);
+    addFace(first[1], first[2], first[3]);
+    _alive = 4;
+    std::vector<int> all;
+    for( int i = 0; i < _count; i++ ){
+      if( i != first[0] && i != first[1] && i != first[2] && i != first[3] ){
+        all.push_back(i);
+      }
+    }
+    std::vector<int> created;
+    for( int f = start; f < start + 4; f++ ){
+      created.push_back(f);
+    }
+    assign(all, created);
+
+    for( size_t f = 0; f < _faces.size( ); f++ ){
+      if( !_faces[f].alive || _faces[f].outside.empty( ) ){
+        continue;
+      }
+      // every point added takes the hull up by 2 faces
+      if( maxFaces > 0 && _alive + 2 > maxFaces ){
+        return true;
+      }
+      addPoint((int)f);
+      // faces made since sit past f, but f itself may now be dead
+    }
+    return true;
+  }
+
+  bool complete( ) const{
+    for( size_t f = 0; f < _faces.size( ); f++ ){
+      if( _faces[f].alive && !_faces[f].outside.empty( ) ){
+        return false;
+      }
+    }
+    return true;
+  }
+
+  const std::vector<HullFace>& faces( ) const{
+    return _faces;
+  }
+
+  // a point strictly inside the hull
+  const double* inside( ) const{
+    return _inside;
+  }
+
+  double epsilon( ) const{
+    return _epsilon;
+  }
+
+private:
+  const double* point( int i ) const{
+    return _p + 3 * (size_t)i;
+  }
+
+  double distance( const HullFace &f, int i ) const{
+    return dot3(f.n, point(i)) - f.d;
+  }
+
+  static uint64_t edgeKey( int a, int b ){
+    return ((uint64_t)(uint32_t)a << 32) | (uint32_t)b;
+  }
+
+  // Four points far apart and not in one plane
+  bool simplex( int *s ){
+    if( _count < 4 ){
+      return false;
+    }
+    int low[3] = { 0, 0, 0 }, high[3] = { 0, 0, 0 };
+    for( int i = 1; i < _count; i++ ){
+      for( int j = 0; j < 3; j++ ){
+        if( point(i)[j] < point(low[j])[j] ){
+          low[j] = i;
+        }
+        if( point(i)[j] > point(high[j])[j] ){
+          high[j] = i;
+        }
+      }
+    }
+    double best = -1.0;
+    for( int j = 0; j < 3; j++ ){
+      double e[3];
+      sub3(e, point(high[j]), point(low[j]));
+      if( dot3(e, e) > best ){
+        best = dot3(e, e);
+        s[0] = low[j];
+        s[1] = high[j];
+      }
+    }
+    if( best <= _epsilon * _epsilon ){
+      return false;
+    }
+    double axis[3];
+    sub3(axis, point(s[1]), point(s[0]));
+    best = 0.0;
+    for( int i = 0; i < _count; i++ ){
+      double e[3], c[3];
+      sub3(e, point(i), point(s[0]));
+      cross3(c, axis, e);
+      if( dot3(c, c) > best ){
+        best = dot3(c, c);
+        s[2] = i;
+      }
+    }
+    if( best <= _epsilon * _epsilon * dot3(axis, axis) ){
+      return false;
+    }
+    double e[3], n[3];
+    sub3(e, point(s[2]), point(s[0]));
+    cross3(n, axis, e);
+    best = 0.0;
+    for( int i = 0; i < _count; i++ ){
+      sub3(e, point(i), point(s[0]));
+      if( fabs(dot3(n, e)) > best ){
+        best = fabs(dot3(n, e));
+        s[3] = i;
+      }
+    }
+    return best > _epsilon * sqrt(dot3(n, n));
+  }
+
+  // A face on a, b and c, wound to face away from the inside
+  int addFace( int a, int b, int c ){
+    HullFace f;
+    double u[3], v[3];
+    sub3(u, point(b), point(a));
+    sub3(v, point(c), point(a));
+    cross3(f.n, u, v);
+    double length = sqrt(dot3(f.n, f.n));
+    for( int j = 0; j < 3; j++ ){
+      f.n[j] /= length;
+    }
+    f.d = dot3(f.n, point(a));
+    if( dot3(f.n, _inside) > f.d ){
+      std::swap(b, c);
+      for( int j = 0; j < 3; j++ ){
+        f.n[j] = -f.n[j];
+      }
+      f.d = -f.d;
+    }
+    f.v[0] = a;
+    f.v[1] = b;
+    f.v[2] = c;
+    f.farthest = -1;
+    f.farthestDistance = 0.0;
+    f.alive = true;
+    int index = (int)_faces.size( );
+    for( int k = 0; k < 3; k++ ){
+      _edges[edgeKey(f.v[k], f.v[(k + 1) % 3])] = index;
+    }
+    _faces.push_back(f);
+    return index;
+  }
+
+  // Give each of points to the face in created it is farthest in front of
+  void assign( const std::vector<int> &points, const std::vector<int> &created ){
+    for( size_t k = 0; k < points.size( ); k++ ){
+      int best = -1;
+      double bestDistance = _epsilon;
+      for( size_t c = 0; c < created.size( ); c++ ){
+        double d = distance(_faces[created[c]], points[k]);
+        if( d > bestDistance ){
+          bestDistance = d;
+          best = created[c];
+        }
+      }
+      if( best >= 0 ){
+        HullFace &f = _faces[best];
+        f.outside.push_back(points[k]);
+        if( bestDistance > f.farthestDistance ){
+          f.farthestDistance = bestDistance;
+          f.farthest = points[k];
+        }
+      }
+    }
+  }
+
+  void addPoint( int from ){
+    int eye = _faces[from].farthest;
+    // the faces eye sees are connected, so walk them from the first
+    std::vector<int> visible(1, from);
+    std::vector<char> seen(_faces.size( ), 0);
+    seen[from] = 1;
+    std::vector<int> horizon;
+    for( size_t k = 0; k < visible.size( ); k++ ){
+      const HullFace &f = _faces[visible[k]];
+      for( int e = 0; e < 3; e++ ){
+        int a = f.v[e], b = f.v[(e + 1) % 3];
+        std::unordered_map<uint64_t, int>::const_iterator twin = _edges.find(edgeKey(b, a));
+        int g = twin != _edges.end( ) ? twin->second : -1;
+        if( g >= 0 && seen[g] ){
+          continue;
+        }
+        if( g >= 0 && distance(_faces[g], eye) > _epsilon ){
+          seen[g] = 1;
+          visible.push_back(g);
+        }else{
+          horizon.push_back(a);
+          horizon.push_back(b);
+        }
+      }
+    }
+    std::vector<int> orphans;
+    for( size_t k = 0; k < visible.size( ); k++ ){
+      HullFace &f = _faces[visible[k]];
+      f.alive = false;
+      for( int e = 0; e < 3; e++ ){
+        _edges.erase(edgeKey(f.v[e], f.v[(e + 1) % 3]));
+      }
+      for( size_t i = 0; i < f.outside.size( ); i++ ){
+        if( f.outside[i] != eye ){
+          orphans.push_back(f.outside[i]);
+        }
+      }
+      std::vector<int>( ).swap(f.outside);
+    }
+    std::vector<int> created;
+    for( size_t k = 0; k < horizon.size( ); k += 2 ){
+      created.push_back(addFace(horizon[k], horizon[k + 1], eye));
+    }
+    _alive += (int)created.size( ) - (int)visible.size( );
+    assign(orphans, created);
+  }
+
+  const double *_p;
+  int _count;
+  double _epsilon;
+  double _inside[3];
+  std::vector<HullFace> _faces;
+  int _alive;
+  // the face each directed edge belongs to
+  std::unordered_map<uint64_t, int> _edges;
+};
+
+// The distinct vertices of hull's faces, each once
+void hullCorners( const Quickhull &hull, std::vector<int> &corners ){
+  const std::vector<HullFace> &faces = hull.faces( );
+  for( size_t f = 0; f < faces.size( ); f++ ){
+    if( faces[f].alive ){
+      corners.insert(corners.end( ), faces[f].v, faces[f].v + 3);
+    }
+  }
+  std::sort(corners.begin( ), corners.end( ));
+  corners.erase(std::unique(corners.begin( ), corners.end( )), corners.end( ));
+}
+
+// Faces in one plane give one plane
+void addPlane( std::vector<double> &planes, const double *n, double d, double epsilon ){
+  for( size_t i = 0; i < planes.size( ); i += 4 ){
+    if( dot3(&planes[i], n) > 1.0 - 1e-9 && fabs(planes[i + 3] - d) <= epsilon ){
+      planes[i + 3] = std::max(planes[i + 3], d);
+      return;
+    }
+  }
+  planes.insert(planes.end( ), n, n + 3);
+  planes.push_back(d);
+}
+
+/*
+ * The support point of fl's hull placed by model in direction d given
+ * in world space: the hull's vertex farthest along d, in world space.
+ * The direction is taken into model space by the transpose of model's
+ * linear part.
+ */
+void support( const FaceList *fl, const float *model, const double *d, double *out ){
+  double local[3];
+  for( int j = 0; j < 3; j++ ){
+    local[j] = model[4 * j] * d[0] + model[4 * j + 1] * d[1] + model[4 * j + 2] * d[2];
+  }
+  int best = 0;
+  double bestDot = -HUGE_VAL;
+  for( int i = 0; i < fl->hullVertexCount; i++ ){
+    const FaceList::Real *v = fl->hullVertices[i];
+    double t = local[0] * v[0] + local[1] * v[1] + local[2] * v[2];
+    if( t > bestDot ){
+      bestDot = t;
+      best = i;
+    }
+  }
+  const FaceList::Real *v = fl->hullVertices[best];
+  for( int j = 0; j < 3; j++ ){
+    out[j] = model[j] * v[0] + model[4 + j] * v[1] + model[8 + j] * v[2] + model[12 + j];
+  }
+}
+
+bool hasHull( const FaceList *fl ){
+  return fl != NULL && fl->hullVertexCount > 0 && fl->boundsCurrent( );
+}
+
+// A vertex of the Minkowski difference a - b in direction d
+void minkowskiSupport( const FaceList *a, const float *ma, const FaceList *b, const float *mb, const double *d, double *out ){
+  double pa[3], pb[3], negative[3] = { -d[0], -d[1], -d[2] };
+  support(a, ma, d, pa);
+  support(b, mb, negative, pb);
+  sub3(out, pa, pb);
+}
+
+/*
+ * Reduce the simplex s of count points, newest last, to the part
+ * nearest the origin and point d at the origin from it. Returns true
+ * once the simplex holds the origin.
+ */
+bool nearestSimplex( double s[4][3], int &count, double *d ){
+  const double *a = s[count - 1];
+  double ao[3] = { -a[0], -a[1], -a[2] };
+  if( count == 2 ){
+    double ab[3], t[3];
+    sub3(ab, s[0], a);
+    if( dot3(ab, ao) > 0 ){
+      cross3(t, ab, ao);
+      cross3(d, t, ab);
+    }else{
+      std::copy(a, a + 3, s[0]);
+      count = 1;
+      std::copy(ao, ao + 3, d);
+    }
+  }else if( count == 3 ){
+    double ab[3], ac[3], abc[3], t[3];
+    sub3(ab, s[1], a);
+    sub3(ac, s[0], a);
+    cross3(abc, ab, ac);
+    cross3(t, abc, ac);
+    if( dot3(t, ao) > 0 ){
+      if( dot3(ac, ao) > 0 ){
+        // the edge a c
+        std::copy(a, a + 3, s[1]);
+        count = 2;
+        cross3(t, ac, ao);
+        cross3(d, t, ac);
+      }else{
+        std::copy(s[1], s[1] + 3, s[0]);
+        std::copy(a, a + 3, s[1]);
+        count = 2;
+        return nearestSimplex(s, count, d);
+      }
+    }else{
+      cross3(t, ab, abc);
+      if( dot3(t, ao) > 0 ){
+        std::copy(s[1], s[1] + 3, s[0]);
+        std::copy(a, a + 3, s[1]);
+        count = 2;
+        return nearestSimplex(s, count, d);
+      }
+      // above or below the triangle
+      if( dot3(abc, ao) > 0 ){
+        std::copy(abc, abc + 3, d);
+      }else{
+        double c[3];
+        std::copy(s[0], s[0] + 3, c);
+        std::copy(s[1], s[1] + 3, s[0]);
+        std::copy(c, c + 3, s[1]);
+        for( int j = 0; j < 3; j++ ){
+          d[j] = -abc[j];
+        }
+      }
+    }
+  }else{
+    // the faces through a, each facing away from the vertex it leaves out
+    for( int k = 0; k < 3; k++ ){
+      const double *b = s[k], *c = s[(k + 1) % 3], *other = s[(k + 2) % 3];
+      double ab[3], ac[3], n[3], ao2[3];
+      sub3(ab, b, a);
+      sub3(ac, c, a);
+      cross3(n, ab, ac);
+      sub3(ao2, other, a);
+      if( dot3(n, ao2) > 0 ){
+        for( int j = 0; j < 3; j++ ){
+          n[j] = -n[j];
+        }
+      }
+      if( dot3(n, ao) > 0 ){
+        double face[3][3];
+        std::copy(b, b + 3, face[0]);
+        std::copy(c, c + 3, face[1]);
+        std::copy(a, a + 3, face[2]);
+        for( int i = 0; i < 3; i++ ){
+          std::copy(face[i], face[i] + 3, s[i]);
+        }
+        count = 3;
+        return nearestSimplex(s, count, d);
+      }
+    }
+    return true;
+  }
+  // the origin is on the simplex
+  return dot3(d, d) == 0.0;
+}
+
+}
+
+int buildHull( FaceList* fl, int maxPlanes ){
+  fl->allocHull(0, 0);
+  std::vector<double> points(3 * (size_t)fl->vc);
+  for( int i = 0; i < fl->vc; i++ ){
+    for( int j = 0; j < 3; j++ ){
+      points[3 * (size_t)i + j] = fl->vertices[i][j];
+    }
+  }
+  Quickhull hull(&points[0], fl->vc);
+  if( fl->vc == 0 || !hull.build(maxPlanes) ){
+    return 0;
+  }
+  const std::vector<HullFace> &faces = hull.faces( );
+  std::vector<double> planes;
+  std::vector<double> corners;
+  if( hull.complete( ) ){
+    for( size_t f = 0; f < faces.size( ); f++ ){
+      if( faces[f].alive ){
+        addPlane(planes, faces[f].n, faces[f].d, hull.epsilon( ));
+      }
+    }
+    std::vector<int> used;
+    hullCorners(hull, used);
+    for( size_t i = 0; i < used.size( ); i++ ){
+      corners.insert(corners.end( ), &points[3 * (size_t)used[i]], &points[3 * (size_t)used[i]] + 3);
+    }
+  }else{
+    /*
+     * Capped: move each plane out to the farthest vertex in front of
+     * it, so the hull of the planes encloses the mesh. Its corners are
+     * where the planes meet, which are the faces of the hull of the
+     * planes' duals n / (d - n . c) about a point c inside (the polar
+     * dual); a plane that ends up redundant is inside that hull.
+     */
+    const double *c = hull.inside( );
+    // a vertex in front of no face is inside the hull so far, and so
+    // behind every face
+    std::vector<int> left;
+    for( size_t f = 0; f < faces.size( ); f++ ){
+      if( faces[f].alive ){
+        left.insert(left.end( ), faces[f].outside.begin( ), faces[f].outside.end( ));
+      }
+    }
+    std::vector<double> moved;
+    for( size_t f = 0; f < faces.size( ); f++ ){
+      if( !faces[f].alive ){
+        continue;
+      }
+      double d = faces[f].d;
+      for( size_t i = 0; i < left.size( ); i++ ){
+        d = std::max(d, dot3(faces[f].n, &points[3 * (size_t)left[i]]));
+      }
+      addPlane(moved, faces[f].n, d, hull.epsilon( ));
+    }
+    std::vector<double> duals;
+    for( size_t i = 0; i < moved.size( ); i += 4 ){
+      double offset = moved[i + 3] - dot3(&moved[i], c);
+      for( int j = 0; j < 3; j++ ){
+        duals.push_back(moved[i + j] / offset);
+      }
+    }
+    Quickhull dual(&duals[0], (int)duals.size( ) / 3);
+    if( !dual.build(0) ){
+      return 0;
+    }
+    std::vector<int> kept;
+    hullCorners(dual, kept);
+    for( size_t i = 0; i < kept.size( ); i++ ){
+      planes.insert(planes.end( ), &moved[4 * kept[i]], &moved[4 * kept[i]] + 4);
+    }
+    const std::vector<HullFace> &dualFaces = dual.faces( );
+    for( size_t f = 0; f < dualFaces.size( ); f++ ){
+      if( !dualFaces[f].alive ){
+        continue;
+      }
+      double p[3];
+      for( int j = 0; j < 3; j++ ){
+        p[j] = c[j] + dualFaces[f].n[j] / dualFaces[f].d;
+      }
+      // planes meeting four or more at a corner give it several times
+      bool known = false;
+      for( size_t i = 0; i < corners.size( ) && !known; i += 3 ){
+        double e[3];
+        sub3(e, &corners[i], p);
+        known = dot3(e, e) <= 1e-18 * std::max(1.0, dot3(p, p));
+      }
+      if( !known ){
+        corners.insert(corners.end( ), p, p + 3);
+      }
+    }
+  }
+  fl->allocHull((int)planes.size( ) / 4, (int)corners.size( ) / 3);
+  for( int i = 0; i < fl->hullPlaneCount; i++ ){
+    for( int j = 0; j < 4; j++ ){
+      fl->hullPlanes[i][j] = planes[4 * i + j];
+    }
+  }
+  for( int i = 0; i < fl->hullVertexCount; i++ ){
+    for( int j = 0; j < 3; j++ ){
+      fl->hullVertices[i][j] = corners[3 * i + j];
+    }
+  }
+  return fl->hullPlaneCount;
+}
+
+bool hullOutside( const FaceList* fl, const Mat4& model, const Vec3& normal, const Vec3& point ){
+  if( !hasHull(fl) ){
+    return false;
+  }
+  // the vertex farthest back along normal decides
+  double back[3] = { -normal[0], -normal[1], -normal[2] };
+  double p[3];
+  support(fl, model, back, p);
+  return normal[0] * (p[0] - point[0]) + normal[1] * (p[1] - point[1]) + normal[2] * (p[2] - point[2]) > 0;
+}
+
+bool hullsIntersect( const FaceList* a, const Mat4& modelA, const FaceList* b, const Mat4& modelB ){
+  if( !hasHull(a) || !hasHull(b) ){
+    return true;
+  }
+  double s[4][3];
+  double d[3];
+  Vec4 ca = modelA * Vec4(a->hullVertices[0][0], a->hullVertices[0][1], a->hullVertices[0][2], 1);
+  Vec4 cb = modelB * Vec4(b->hullVertices[0][0], b->hullVertices[0][1], b->hullVertices[0][2], 1);
+  for( int j = 0; j < 3; j++ ){
+    d[j] = cb[j] - ca[j];
+  }
+  if( dot3(d, d) == 0.0 ){
+    d[0] = 1.0;
+  }
+  int count = 1;
+  minkowskiSupport(a, modelA, b, modelB, d, s[0]);
+  for( int j = 0; j < 3; j++ ){
+    d[j] = -s[0][j];
+  }
+  // GJK reaches the answer in a few steps; one that does not is taken
+  // as touching, which is the safe side for a bounding volume
+  for( int step = 0; step < 64; step++ ){
+    if( dot3(d, d) == 0.0 ){
+      return true;
+    }
+    double p[3];
+    minkowskiSupport(a, modelA, b, modelB, d, p);
+    if( dot3(p, d) < 0 ){
+      return false;
+    }
+    std::copy(p, p + 3, s[count++]);
+    if( nearestSimplex(s, count, d) ){
+      return true;
+    }
+  }
+  return true;
+}
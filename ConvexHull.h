@@ -0,0 +1,48 @@
+/*
+ * ConvexHull
+ *
+ * A convex hull for a FaceList, as a bounding volume: a few dozen
+ * planes hug a model far more closely than a sphere or a box, and are
+ * still far cheaper to test than its faces. Hulls are built with
+ * Quickhull (Barber, Dobkin and Huhdanpaa 1996), and can be capped to
+ * a number of planes, in which case the planes are moved out until
+ * every vertex is behind them, so the capped hull still encloses the
+ * whole mesh.
+ *
+ * Hulls are tested against frustum planes by their vertices, and
+ * against each other with GJK (Gilbert, Johnson and Keerthi 1988).
+ * Both tests work on the hull in model space through the object's
+ * model matrix, so a moved object needs no new hull.
+ */
+
+#include "FaceList.h"
+#include "GFXMath.h"
+
+#ifndef _CONVEXHULL_H_
+#define _CONVEXHULL_H_
+
+// Most planes the hull readPlyModel gives a model has
+static const int hullMaxPlanes = 32;
+
+/*
+ * Replace fl's hull with the convex hull of its vertices, of at most
+ * maxPlanes planes, or of as many as it takes when maxPlanes is 0. A
+ * mesh with no volume, such as a flat one, gets no hull. Returns the
+ * number of planes.
+ */
+int buildHull( FaceList* fl, int maxPlanes = hullMaxPlanes );
+
+/*
+ * Whether all of fl's hull, placed by model, is on the side of the
+ * plane through point that normal points to. False when fl has no
+ * hull.
+ */
+bool hullOutside( const FaceList* fl, const Mat4& model, const Vec3& normal, const Vec3& point );
+
+/*
+ * Whether the hulls of a and b, placed by modelA and modelB, meet.
+ * True when either has no hull.
+ */
+bool hullsIntersect( const FaceList* a, const Mat4& modelA, const FaceList* b, const Mat4& modelB );
+
+#endif
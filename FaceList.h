@@ -30,7 +30,11 @@
  *
  */
 
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
+#include <utility>
 
 #ifdef __APPLE__
 /* Apple's weird location of their OpenGL header */
@@ -42,84 +46,390 @@
 #endif
 
 #include "GFXMath.h"
+#include "Arena.h"
+#include "VertexKernels.h"
 
 #ifndef _FACELIST_H_
 #define _FACELIST_H_
 
 /*
- * Macro to allocate/free 2D arrays using C constructs
+ * Precision of the per vertex and per face data. Build with
+ * -DFACELIST_SINGLE_PRECISION to store floats, which halves the
+ * footprint of a mesh.
  */
-#define msAlloc2D( type, varName, dim_x, dim_y ) \
-{ \
-	int __i; \
-	if( !((varName) = (type**)calloc( (dim_x), sizeof(type*) )) ){ \
-		fprintf( stderr, "Could not allocate memory." ); \
-	} \
-	for( __i = 0; __i < dim_x; __i++ ){ \
-		if( !((varName)[__i] = (type*)calloc( (dim_y), sizeof(type) )) ){ \
-		fprintf( stderr, "Could not allocate memory." ); \
-		} \
-	} \
+#ifdef FACELIST_SINGLE_PRECISION
+typedef float FaceListReal;
+#else
+typedef double FaceListReal;
+#endif
+
+/*
+ * Zeroed memory aligned for vector loads; release it with free( ).
+ * FaceLists placed in an Arena take their memory from it instead.
+ */
+static inline void* flAlignedAlloc( size_t size ){
+	void *p = NULL;
+	if( posix_memalign(&p, 64, size > 0 ? size : 64) != 0 ){
+		fprintf( stderr, "Could not allocate memory." );
+		return NULL;
+	}
+	memset(p, 0, size);
+	return p;
 }
 
-#define msFree2D( varName, dim_x, dim_y ) \
-{ \
-	int __i; \
-	for( __i = 0; __i < dim_x; __i++ ){ \
-		free( varName[__i] ); \
-	} \
-	free( varName ); \
+// Round size up to a whole number of 64 byte lines
+static inline size_t flAlignedSize( size_t size ){
+	return (size + 63) & ~(size_t)63;
 }
 
+/*
+ * A cluster of neighbouring faces that is culled as a unit: off screen
+ * when its bounding sphere is, and facing away when every face in it
+ * is. See Meshlets.h.
+ */
+struct Meshlet{
+  // faces [firstFace, firstFace + faceCount) of the FaceList
+  int firstFace;
+  int faceCount;
+  // bounding sphere
+  float center[3];
+  float radius;
+  // every face normal is within the cone around coneAxis whose half
+  // angle has coneCutoff as its sine; coneCutoff is 1 when the faces
+  // spread too far for the cone to ever cull
+  float coneAxis[3];
+  float coneCutoff;
+};
+
+/*
+ * A coarser level of detail of a FaceList: faces of its own over the
+ * FaceList's vertices, for when the mesh is small on screen. See
+ * MeshSimplify.h.
+ */
+struct MeshLod{
+  // faces [firstFace, firstFace + faceCount) of the FaceList's lodFaces
+  int firstFace;
+  int faceCount;
+  // how far the level strays from the full mesh, in model units
+  float error;
+};
+
+/*
+ * A vertex packed for drawing (see VertexPacking.h): 12 bytes against
+ * the 48 of a double position and normal. The position is quantized
+ * across the mesh's bounding box and the normal is oct-encoded into
+ * its first two components; the third is 0 and only pads it out to
+ * the three glNormalPointer takes.
+ */
+struct PackedVertex{
+  short position[3];
+  short normal[3];
+};
+
 /*
  * I have usesd arrays for the vertices, colors, normals, and faces
  * but that does not mean that if you have a Vector class that you can not
  * revise this code to use your Vector class.
  *
+ * Each attribute is one contiguous array of rows, so vertices[i][j]
+ * reads as it always has. The per vertex arrays share one aligned
+ * allocation and the per face arrays another; every array starts on
+ * its own cache line.
+ *
+ * A FaceList built with an Arena keeps all of its memory there and is
+ * freed with the arena. Use create( ) and release( ) to handle either
+ * kind alike.
  */
 
 class FaceList{
 public:
+  typedef FaceListReal Real;
+
   // array of vertices
-  double **vertices;
+  Real (*vertices)[3];
   //array of vertex colors
-  double **colors;
+  Real (*colors)[3];
   // array of face indices
-  int **faces;
+  int (*faces)[3];
   // vertex count
   int vc;
   // face count
   int fc;
   // The face's surface normal
-  double **f_normals;
-  double **v_normals;
+  Real (*f_normals)[3];
+  Real (*v_normals)[3];
+  // per vertex (u, v), or NULL when the model has none
+  Real (*texcoords)[2];
+  // face clusters covering every face in order, or none
+  Meshlet *meshlets;
+  int meshletCount;
+  // levels of detail, finest first, and the faces of all of them
+  MeshLod *lods;
+  int lodCount;
+  int (*lodFaces)[3];
+  // the vertices packed for drawing, position i being
+  // packOffset + packScale * position, or NULL; see VertexPacking.h
+  PackedVertex *packed;
+  float packScale[3];
+  float packOffset[3];
+  // faces and then lodFaces as 16-bit indices, or NULL when there are
+  // too many vertices or none are packed
+  unsigned short (*shortFaces)[3];
+  // convex hull around the vertices, or none: planes as (normal, d)
+  // with normal . p <= d inside, and its corners; see ConvexHull.h
+  Real (*hullPlanes)[4];
+  int hullPlaneCount;
+  Real (*hullVertices)[3];
+  int hullVertexCount;
   
-  // bounding sphere
+  // bounding sphere and axis aligned box; whoever fills in the
+  // vertices sets them, and the rigid edits below keep them up to date
   double radius;
   double center[3];
+  double boxMin[3];
+  double boxMax[3];
+  // changes with every edit of the vertices, so whatever is derived
+  // from them can tell when it is out of date; see edited( )
+  unsigned int version;
   
-  FaceList( int vertexCount, int faceCount ){
+  FaceList( int vertexCount, int faceCount, bool withTexcoords = false, Arena *arena = NULL ){
+    _arena = arena;
     vc = vertexCount;
     fc = faceCount;
+    radius = 0.0;
+    center[0] = center[1] = center[2] = 0.0;
+    boxMin[0] = boxMin[1] = boxMin[2] = 0.0;
+    boxMax[0] = boxMax[1] = boxMax[2] = 0.0;
 
-		msAlloc2D( double, vertices, vc, 3 );
-    
-		msAlloc2D( double, colors, vc, 3 );
-
-		msAlloc2D( double, v_normals, vc, 3 );
+		size_t row = flAlignedSize(vc * sizeof(Real[3]));
+		size_t size = 3 * row + (withTexcoords ? flAlignedSize(vc * sizeof(Real[2])) : 0);
+		char *block = (char*)allocBlock(size);
+		_vertexBlock = block;
+		vertices = (Real(*)[3])block;
+		v_normals = (Real(*)[3])(block + row);
+		colors = (Real(*)[3])(block + 2 * row);
+		texcoords = withTexcoords ? (Real(*)[2])(block + 3 * row) : NULL;
 
-		msAlloc2D( double, f_normals, fc, 3 );
-
-		msAlloc2D( int, faces, fc, 3 );
+		allocFaces( );
+		meshlets = NULL;
+		meshletCount = 0;
+		lods = NULL;
+		lodCount = 0;
+		lodFaces = NULL;
+		packed = NULL;
+		shortFaces = NULL;
+		hullPlanes = NULL;
+		hullPlaneCount = 0;
+		hullVertices = NULL;
+		hullVertexCount = 0;
+		packScale[0] = packScale[1] = packScale[2] = 1.0f;
+		packOffset[0] = packOffset[1] = packOffset[2] = 0.0f;
+		version = 0;
+		_boundsVersion = 0;
   };
   
   ~FaceList( ){
-		msFree2D( vertices, vc, 3 );
-		msFree2D( v_normals, vc, 3 );
-		msFree2D( f_normals, fc, 3 );
-    msFree2D( faces, fc, 3 );
+		if( !_arena ){
+			free( _vertexBlock );
+			free( _faceBlock );
+			free( meshlets );
+			free( lods );
+			free( packed );
+			free( hullPlanes );
+		}
   };
 
+	// A new FaceList, placed in arena when there is one
+	static FaceList* create( int vertexCount, int faceCount, bool withTexcoords = false, Arena *arena = NULL ){
+		if( arena ){
+			return arena->make<FaceList>(vertexCount, faceCount, withTexcoords, arena);
+		}
+		return new FaceList(vertexCount, faceCount, withTexcoords);
+	}
+
+	// Free a FaceList from create( ); arena ones go with their arena
+	static void release( const FaceList *fl ){
+		if( fl && !fl->_arena ){
+			delete fl;
+		}
+	}
+
+	Arena* arena( ) const{
+		return _arena;
+	}
+
+	// FaceLists are moved, never copied; the moved-from list is empty
+	FaceList( FaceList&& other ){
+		_arena = NULL;
+		_vertexBlock = NULL;
+		_faceBlock = NULL;
+		meshlets = NULL;
+		lods = NULL;
+		packed = NULL;
+		hullPlanes = NULL;
+		vc = fc = 0;
+		*this = std::move(other);
+	}
+
+	FaceList& operator =( FaceList&& other ){
+		if( this != &other ){
+			if( !_arena ){
+				free( _vertexBlock );
+				free( _faceBlock );
+				free( meshlets );
+				free( lods );
+				free( packed );
+				free( hullPlanes );
+			}
+			vertices = other.vertices;
+			colors = other.colors;
+			faces = other.faces;
+			vc = other.vc;
+			fc = other.fc;
+			f_normals = other.f_normals;
+			v_normals = other.v_normals;
+			texcoords = other.texcoords;
+			meshlets = other.meshlets;
+			meshletCount = other.meshletCount;
+			lods = other.lods;
+			lodCount = other.lodCount;
+			lodFaces = other.lodFaces;
+			packed = other.packed;
+			shortFaces = other.shortFaces;
+			hullPlanes = other.hullPlanes;
+			hullPlaneCount = other.hullPlaneCount;
+			hullVertices = other.hullVertices;
+			hullVertexCount = other.hullVertexCount;
+			radius = other.radius;
+			version = other.version;
+			_boundsVersion = other._boundsVersion;
+			for(int j = 0; j < 3; j++){
+				center[j] = other.center[j];
+				boxMin[j] = other.boxMin[j];
+				boxMax[j] = other.boxMax[j];
+				packScale[j] = other.packScale[j];
+				packOffset[j] = other.packOffset[j];
+			}
+			_arena = other._arena;
+			_vertexBlock = other._vertexBlock;
+			_faceBlock = other._faceBlock;
+			other.vertices = other.colors = other.f_normals = other.v_normals = NULL;
+			other.faces = NULL;
+			other.texcoords = NULL;
+			other.meshlets = NULL;
+			other.lods = NULL;
+			other.lodFaces = NULL;
+			other.packed = NULL;
+			other.shortFaces = NULL;
+			other.hullPlanes = NULL;
+			other.hullVertices = NULL;
+			other.hullPlaneCount = other.hullVertexCount = 0;
+			other.vc = other.fc = other.meshletCount = other.lodCount = 0;
+			other._vertexBlock = other._faceBlock = NULL;
+		}
+		return *this;
+	}
+
+	// Room for count meshlets, replacing any there were
+	void allocMeshlets( int count ){
+		if( !_arena ){
+			free( meshlets );
+		}
+		meshletCount = count;
+		meshlets = (Meshlet*)allocBlock(count * sizeof(Meshlet));
+	}
+
+	// Room for count levels of detail with faceCount faces between
+	// them, replacing any there were. The packed copy no longer has all
+	// the faces and is dropped.
+	void allocLods( int count, int faceCount ){
+		dropPacking( );
+		if( !_arena ){
+			free( lods );
+		}
+		size_t lodsSize = flAlignedSize(count * sizeof(MeshLod));
+		char *block = (char*)allocBlock(lodsSize + faceCount * sizeof(int[3]));
+		lodCount = count;
+		lods = (MeshLod*)block;
+		lodFaces = (int(*)[3])(block + lodsSize);
+	}
+
+	// Room for a hull of planeCount planes and vertexCount corners,
+	// replacing any there was
+	void allocHull( int planeCount, int vertexCount ){
+		if( !_arena ){
+			free( hullPlanes );
+		}
+		size_t planesSize = flAlignedSize(planeCount * sizeof(Real[4]));
+		char *block = (char*)allocBlock(planesSize + vertexCount * sizeof(Real[3]));
+		hullPlaneCount = planeCount;
+		hullPlanes = (Real(*)[4])block;
+		hullVertexCount = vertexCount;
+		hullVertices = (Real(*)[3])(block + planesSize);
+	}
+
+	// Faces in all of the levels of detail
+	int lodFaceCount( ) const{
+		return lodCount > 0 ? lods[lodCount - 1].firstFace + lods[lodCount - 1].faceCount : 0;
+	}
+
+	// Room for a packed copy of the vertices, and of the faces and
+	// lodFaces when withShortFaces is set, replacing any there was
+	void allocPacking( bool withShortFaces ){
+		dropPacking( );
+		size_t vertexSize = flAlignedSize(vc * sizeof(PackedVertex));
+		size_t faceSize = withShortFaces ? (fc + lodFaceCount( )) * sizeof(unsigned short[3]) : 0;
+		char *block = (char*)allocBlock(vertexSize + faceSize);
+		packed = (PackedVertex*)block;
+		shortFaces = withShortFaces ? (unsigned short(*)[3])(block + vertexSize) : NULL;
+	}
+
+	/*
+	 * Call after changing the vertices other than through rotate( ),
+	 * translate( ) or scale( ). The bounds are no longer known
+	 * to hold, and the packed copy is dropped.
+	 */
+	void edited( ){
+		version++;
+		dropPacking( );
+	}
+
+	// Whether the sphere and the box still bound the vertices
+	bool boundsCurrent( ) const{
+		return _boundsVersion == version;
+	}
+
+	// Anything that changes the vertices or faces must drop the packed
+	// copy; the mesh is then drawn from the full precision arrays
+	void dropPacking( ){
+		if( !_arena ){
+			free( packed );
+		}
+		packed = NULL;
+		shortFaces = NULL;
+	}
+
+	// Change the number of faces, keeping the leading ones. In an arena
+	// the old faces stay allocated until the arena is reset. Meshlets no
+	// longer match the faces and are dropped, as are levels of detail
+	// and the packed copy.
+	void resizeFaces( int faceCount ){
+		dropPacking( );
+		meshletCount = 0;
+		lodCount = 0;
+		void *oldBlock = _faceBlock;
+		int (*oldFaces)[3] = faces;
+		Real (*oldNormals)[3] = f_normals;
+		int keep = fc < faceCount ? fc : faceCount;
+		fc = faceCount;
+		allocFaces( );
+		memcpy(faces, oldFaces, keep * sizeof(faces[0]));
+		memcpy(f_normals, oldNormals, keep * sizeof(f_normals[0]));
+		if( !_arena ){
+			free( oldBlock );
+		}
+	}
+
 	void rotate(Vec3 axis, float angle){
 		//
 		float delta = sin(angle / 2);
@@ -134,57 +444,257 @@ public:
 				, delta * axis[1],	-delta * axis[0],	gamma,			-delta * axis[2]
 				, delta * axis[0],	delta * axis[1],	delta * axis[2],	gamma};
 		Mat4 temp = Q_bar * Q;
-		Vec4 tempVec;
-		for(int i = 0; i < vc; i++ ){
-			tempVec = Vec4(vertices[i][0], vertices[i][1], vertices[i][2], 0);
-			tempVec = temp * tempVec;
-			vertices[i][0]=tempVec[0];
-			vertices[i][1]=tempVec[1];
-			vertices[i][2]=tempVec[2];
+		dropPacking( );
+		Real m[16];
+		for(int j = 0; j < 4; j++){
+			for(int i = 0; i < 4; i++){
+				m[4 * j + i] = temp(j, i);
+			}
 		}
+		// a rotation about the origin turns normals the same way
+		transformDirections(m, vertices, vertices, vc);
+		transformDirections(m, v_normals, v_normals, vc);
+		transformDirections(m, f_normals, f_normals, fc);
+		transformMeshlets(m, 1);
+		transformBounds(m, 1);
 	}
 
 	void translate(float x, float y, float z){
-		for(int i = 0; i < vc; i++ ){
-			vertices[i][0]+=x;
-			vertices[i][1]+=y;
-			vertices[i][2]+=z;
-		}
+		Real m[16] = { 1, 0, 0, 0,  0, 1, 0, 0,  0, 0, 1, 0,  x, y, z, 1 };
+		dropPacking( );
+		transformPoints(m, vertices, vertices, vc);
+		transformMeshlets(m, 1);
+		transformBounds(m, 1);
 	}
 
 	void scale(float s){
-		for(int i = 0; i < vc; i++ ){
-			vertices[i][0]*=s;
-			vertices[i][1]*=s;
-			vertices[i][2]*=s;
+		Real m[16] = { s, 0, 0, 0,  0, s, 0, 0,  0, 0, s, 0,  0, 0, 0, 1 };
+		dropPacking( );
+		transformPoints(m, vertices, vertices, vc);
+		transformMeshlets(m, s);
+		transformBounds(m, s);
+	}
+
+	// Deep copy, for when a shared mesh has to be edited
+	FaceList* clone( Arena *arena = NULL ) const{
+		FaceList *copy = create(vc, fc, texcoords != NULL, arena);
+		memcpy(copy->vertices, vertices, vc * sizeof(vertices[0]));
+		memcpy(copy->colors, colors, vc * sizeof(colors[0]));
+		memcpy(copy->v_normals, v_normals, vc * sizeof(v_normals[0]));
+		if( texcoords ){
+			memcpy(copy->texcoords, texcoords, vc * sizeof(texcoords[0]));
+		}
+		memcpy(copy->f_normals, f_normals, fc * sizeof(f_normals[0]));
+		memcpy(copy->faces, faces, fc * sizeof(faces[0]));
+		if( meshletCount > 0 ){
+			copy->allocMeshlets(meshletCount);
+			memcpy(copy->meshlets, meshlets, meshletCount * sizeof(meshlets[0]));
+		}
+		if( lodCount > 0 ){
+			copy->allocLods(lodCount, lodFaceCount( ));
+			memcpy(copy->lods, lods, lodCount * sizeof(lods[0]));
+			memcpy(copy->lodFaces, lodFaces, lodFaceCount( ) * sizeof(lodFaces[0]));
+		}
+		if( hullPlaneCount > 0 ){
+			copy->allocHull(hullPlaneCount, hullVertexCount);
+			memcpy(copy->hullPlanes, hullPlanes, hullPlaneCount * sizeof(hullPlanes[0]));
+			memcpy(copy->hullVertices, hullVertices, hullVertexCount * sizeof(hullVertices[0]));
 		}
+		if( packed ){
+			copy->allocPacking(shortFaces != NULL);
+			memcpy(copy->packed, packed, vc * sizeof(packed[0]));
+			if( shortFaces ){
+				memcpy(copy->shortFaces, shortFaces, (fc + lodFaceCount( )) * sizeof(shortFaces[0]));
+			}
+		}
+		copy->radius = radius;
+		copy->version = version;
+		copy->_boundsVersion = _boundsVersion;
+		for(int j = 0; j < 3; j++){
+			copy->center[j] = center[j];
+			copy->boxMin[j] = boxMin[j];
+			copy->boxMax[j] = boxMax[j];
+			copy->packScale[j] = packScale[j];
+			copy->packOffset[j] = packOffset[j];
+		}
+		return copy;
 	}
 
-	void drawSphere( ){	
+	// Wireframe, scaled by s and then moved by (x, y, z)
+	void drawSphere( double x = 0.0, double y = 0.0, double z = 0.0, double s = 1.0 ) const{	
 		glPolygonMode( GL_FRONT_AND_BACK, GL_LINE );
 		glBegin(GL_TRIANGLES);
 		for(int i = 0; i < fc; i++ ){	
 			for(int j = 0; j < 3; j++){
 				//glColor3dv(colors[faces[i][j]]);        	
-				glVertex3dv(vertices[faces[i][j]]);
-				glNormal3dv(v_normals[faces[i][j]]);
+				const Real *v = vertices[faces[i][j]];
+				const Real *n = v_normals[faces[i][j]];
+				glVertex3d(v[0] * s + x, v[1] * s + y, v[2] * s + z);
+				glNormal3d(n[0], n[1], n[2]);
  			}
 		}
 		glEnd(); 
 	}
 
-  void draw( ){	
+  /*
+   * Indexed triangles straight from the arrays, so each vertex is sent
+   * once and a vertex shared by several faces can come from the GPU's
+   * post-transform cache (see MeshOptimize.h). Placing the mesh is up
+   * to the modelview matrix.
+   *
+   * With a packed copy the vertices are sent packed, and the shader has
+   * to decode them (see VertexPacking.h).
+   */
+  void draw( ) const{
+	drawFaces(0, fc);
+  }
+
+  // Faces [first, first + count) only, e.g. the visible meshlets
+  void drawFaces( int first, int count ) const{
+	drawIndexed(first, count);
+  }
+
+  // Level of detail level, where 0 is the full mesh and 1 is lods[0]
+  void drawLod( int level ) const{
+	if( level == 0 ){
+		draw( );
+	}else{
+		drawIndexed(fc + lods[level - 1].firstFace, lods[level - 1].faceCount);
+	}
+  }
+
+  /*
+   * The box around the box [min, max] moved by m (Arvo, "Transforming
+   * Axis-Aligned Bounding Boxes", Graphics Gems 1990): each output
+   * bound adds the smaller or larger of every matrix entry times the
+   * box's two bounds, so it costs the same for any mesh. m is by
+   * columns; the output may be the input.
+   */
+  template <typename M, typename B>
+  static void transformBox( const M *m, const B *min, const B *max, B *outMin, B *outMax ){
+		B lo[3], hi[3];
+		for(int i = 0; i < 3; i++){
+			lo[i] = hi[i] = m[12 + i];
+			for(int j = 0; j < 3; j++){
+				B a = m[4 * j + i] * min[j];
+				B b = m[4 * j + i] * max[j];
+				lo[i] += a < b ? a : b;
+				hi[i] += a < b ? b : a;
+			}
+		}
+		for(int i = 0; i < 3; i++){
+			outMin[i] = lo[i];
+			outMax[i] = hi[i];
+		}
+  }
+
+private:
+  FaceList( const FaceList& );
+  FaceList& operator =( const FaceList& );
+
+  // Faces [first, first + count) of faces followed by lodFaces
+  void drawIndexed( int first, int count ) const{
+	const GLenum type = sizeof(Real) == sizeof(float) ? GL_FLOAT : GL_DOUBLE;
 	glPolygonMode( GL_FRONT_AND_BACK, GL_FILL );
-    glBegin(GL_TRIANGLES);
-    for(int i = 0; i < fc; i++ ){	
-      for(int j = 0; j < 3; j++){
-        //glColor3dv(colors[faces[i][j]]);        	
-	glVertex3dv(vertices[faces[i][j]]);
-	glNormal3dv(v_normals[faces[i][j]]);
-      }
-    }
-    glEnd(); 
+	glEnableClientState(GL_VERTEX_ARRAY);
+	glEnableClientState(GL_NORMAL_ARRAY);
+	if( packed ){
+		glVertexPointer(3, GL_SHORT, sizeof(PackedVertex), packed->position);
+		glNormalPointer(GL_SHORT, sizeof(PackedVertex), packed->normal);
+	}else{
+		glVertexPointer(3, type, 0, vertices);
+		glNormalPointer(type, 0, v_normals);
+	}
+	if( shortFaces ){
+		glDrawElements(GL_TRIANGLES, 3 * count, GL_UNSIGNED_SHORT, shortFaces + first);
+	}else{
+		glDrawElements(GL_TRIANGLES, 3 * count, GL_UNSIGNED_INT, first < fc ? faces + first : lodFaces + (first - fc));
+	}
+	glDisableClientState(GL_NORMAL_ARRAY);
+	glDisableClientState(GL_VERTEX_ARRAY);
+  }
+
+  void* allocBlock( size_t size ){
+		return _arena ? _arena->allocate(size) : flAlignedAlloc(size);
   }
+
+  // Keep the meshlets' spheres and cones on the mesh after m, which
+  // scales lengths by s. The faces wind as before, so their normals
+  // keep their direction under a negative s and the cones must too.
+  void transformMeshlets( const Real *m, Real s ){
+		for(int i = 0; i < meshletCount; i++){
+			Meshlet &c = meshlets[i];
+			Real p[3] = { c.center[0], c.center[1], c.center[2] };
+			Real a[3] = { c.coneAxis[0], c.coneAxis[1], c.coneAxis[2] };
+			Real axis[3];
+			for(int j = 0; j < 3; j++){
+				c.center[j] = m[j] * p[0] + m[4 + j] * p[1] + m[8 + j] * p[2] + m[12 + j];
+				axis[j] = m[j] * a[0] + m[4 + j] * a[1] + m[8 + j] * a[2];
+			}
+			Real length = sqrt(axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2]);
+			if( s == 0 || length == 0 ){
+				// flattened to a point, the faces face nowhere; a cone
+				// like this culls nothing
+				c.coneAxis[0] = c.coneAxis[1] = c.coneAxis[2] = 0.0f;
+				c.coneCutoff = 1.0f;
+			}else{
+				for(int j = 0; j < 3; j++){
+					c.coneAxis[j] = axis[j] / (s < 0 ? -length : length);
+				}
+			}
+			c.radius *= fabs(s);
+		}
+  }
+
+  // The same for the bounding sphere, box and hull, which stay current
+  // if they were; either way the vertices have a new version. A rotated
+  // box is the box around the old one turned, so it loosens.
+  void transformBounds( const Real *m, Real s ){
+		bool current = boundsCurrent( );
+		double p[3] = { center[0], center[1], center[2] };
+		for(int j = 0; j < 3; j++){
+			center[j] = m[j] * p[0] + m[4 + j] * p[1] + m[8 + j] * p[2] + m[12 + j];
+		}
+		radius *= fabs(s);
+		transformBox(m, boxMin, boxMax, boxMin, boxMax);
+		if( s == 0 ){
+			// flattened to a point, the hull has no planes left
+			hullPlaneCount = hullVertexCount = 0;
+		}
+		transformPoints(m, hullVertices, hullVertices, hullVertexCount);
+		for(int i = 0; i < hullPlaneCount; i++){
+			// a negative s turns the normal around, so divide by its size
+			// only, and move the plane through the point q on it
+			Real *h = hullPlanes[i];
+			Real n[3] = { h[0], h[1], h[2] };
+			Real q[3] = { n[0] * h[3], n[1] * h[3], n[2] * h[3] };
+			h[3] = 0;
+			for(int j = 0; j < 3; j++){
+				h[j] = (m[j] * n[0] + m[4 + j] * n[1] + m[8 + j] * n[2]) / fabs(s);
+			}
+			for(int j = 0; j < 3; j++){
+				h[3] += h[j] * (m[j] * q[0] + m[4 + j] * q[1] + m[8 + j] * q[2] + m[12 + j]);
+			}
+		}
+		version++;
+		if( current ){
+			_boundsVersion = version;
+		}
+  }
+
+  void allocFaces( ){
+		size_t normalsSize = flAlignedSize(fc * sizeof(Real[3]));
+		char *block = (char*)allocBlock(normalsSize + fc * sizeof(int[3]));
+		_faceBlock = block;
+		f_normals = (Real(*)[3])block;
+		faces = (int(*)[3])(block + normalsSize);
+  }
+
+  Arena *_arena;
+  // version of the vertices center and radius were last right for
+  unsigned int _boundsVersion;
+  void *_vertexBlock;
+  void *_faceBlock;
 };
 
 /*std::ostream& operator <<( std::ostream &out, FaceList &fl ){
@@ -0,0 +1,87 @@
+/*
+ * HandoffQueue
+ *
+ * Lock-free hand-off of values from any number of producer threads to
+ * a single consumer. Producers push onto an atomic list head with a
+ * compare-and-swap; the consumer takes the whole list in one exchange,
+ * so neither side ever blocks the other.
+ */
+
+#include <atomic>
+#include <cstddef>
+#include <utility>
+
+#ifndef _HANDOFFQUEUE_H_
+#define _HANDOFFQUEUE_H_
+
+template <typename T>
+class HandoffQueue{
+public:
+  HandoffQueue( ) : _head(NULL){ }
+
+  ~HandoffQueue( ){
+    Node *n = _head.exchange(NULL);
+    while( n ){
+      Node *next = n->next;
+      delete n;
+      n = next;
+    }
+  }
+
+  // May be called from any thread.
+  void push( const T& value ){
+    link(new Node(value));
+  }
+
+  void push( T&& value ){
+    link(new Node(std::move(value)));
+  }
+
+  /*
+   * Call f on every value pushed so far, oldest first, and remove them.
+   * f gets each value by reference and may move it out. Only the
+   * consumer thread may call this. Returns the number of values taken.
+   */
+  template <typename F>
+  int drain( F f ){
+    Node *n = _head.exchange(NULL, std::memory_order_acquire);
+    // The list comes off newest first
+    Node *oldest = NULL;
+    while( n ){
+      Node *next = n->next;
+      n->next = oldest;
+      oldest = n;
+      n = next;
+    }
+    int count = 0;
+    while( oldest ){
+      Node *next = oldest->next;
+      f(oldest->value);
+      delete oldest;
+      oldest = next;
+      count++;
+    }
+    return count;
+  }
+
+private:
+  struct Node{
+    Node( const T& v ) : value(v), next(NULL){ }
+    Node( T&& v ) : value(std::move(v)), next(NULL){ }
+    T value;
+    Node *next;
+  };
+
+  void link( Node *n ){
+    n->next = _head.load(std::memory_order_relaxed);
+    while( !_head.compare_exchange_weak(n->next, n, std::memory_order_release, std::memory_order_relaxed) ){
+    }
+  }
+
+  HandoffQueue( const HandoffQueue& );
+  HandoffQueue& operator =( const HandoffQueue& );
+
+  std::atomic<Node*> _head;
+};
+
+#endif
@@ -0,0 +1,61 @@
+/*
+ * MappedFile
+ *
+ * A read-only memory mapping of an entire file. The mapping lives until
+ * close( ) is called or the object is destroyed.
+ */
+
+#include "MappedFile.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Stands in for the mapping of an empty file, which mmap refuses.
+static const char emptyFile[1] = { 0 };
+
+MappedFile::MappedFile( ) : _data(NULL), _size(0), _mapped(false){ }
+
+MappedFile::~MappedFile( ){
+  close( );
+}
+
+bool MappedFile::open( const char* filename ){
+  close( );
+  int fd = ::open(filename, O_RDONLY);
+  if( fd < 0 ){
+    return false;
+  }
+  struct stat st;
+  if( fstat(fd, &st) != 0 ){
+    ::close(fd);
+    return false;
+  }
+  if( st.st_size == 0 ){
+    ::close(fd);
+    _data = emptyFile;
+    _size = 0;
+    return true;
+  }
+  void *p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd);
+  if( p == MAP_FAILED ){
+    return false;
+  }
+  // The file is read front to back exactly once.
+  madvise(p, st.st_size, MADV_SEQUENTIAL);
+  _data = (const char*)p;
+  _size = st.st_size;
+  _mapped = true;
+  return true;
+}
+
+void MappedFile::close( ){
+  if( _mapped ){
+    munmap((void*)_data, _size);
+  }
+  _data = NULL;
+  _size = 0;
+  _mapped = false;
+}
@@ -0,0 +1,36 @@
+/*
+ * MappedFile
+ *
+ * A read-only memory mapping of an entire file. The mapping lives until
+ * close( ) is called or the object is destroyed.
+ */
+
+#include <cstddef>
+
+#ifndef _MAPPEDFILE_H_
+#define _MAPPEDFILE_H_
+
+class MappedFile{
+public:
+  MappedFile( );
+  ~MappedFile( );
+
+  // Map filename into memory. Returns false if it can not be opened.
+  bool open( const char* filename );
+  void close( );
+
+  const char* data( ) const { return _data; }
+  size_t size( ) const { return _size; }
+  bool isOpen( ) const { return _data != NULL; }
+
+private:
+  // Mappings are not copyable
+  MappedFile( const MappedFile& );
+  MappedFile& operator =( const MappedFile& );
+
+  const char* _data;
+  size_t _size;
+  bool _mapped;
+};
+
+#endif
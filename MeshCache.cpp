@@ -0,0 +1,249 @@
+/*
+ * MeshCache
+ *
+ * A baked, memory-mappable copy of a fully processed FaceList.
+ */
+
+#include "MeshCache.h"
+#include "MappedFile.h"
+
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <unistd.h>
+
+/*
+ * The file is this header followed by the vertex positions, vertex
+ * normals and vertex colors (vc * 3 reals each), the texture coordinates
+ * when flags has bakedMeshTexcoords (vc * 2 reals), the face normals
+ * (fc * 3 reals), the face indices (fc * 3 int32s), the meshlets
+ * (meshletCount Meshlet structs), the levels of detail (lodCount
+ * MeshLod structs), their faces (lodFaceCount * 3 int32s) and the
+ * convex hull's planes and corners (hullPlaneCount * 4 and
+ * hullVertexCount * 3 reals). A real is
+ * realSize bytes, i.e. a FaceList::Real of the build that wrote the
+ * file. Everything is in host byte order; byteOrder and realSize let a
+ * file from another host or build be rejected.
+ */
+struct BakedMeshHeader{
+  char magic[8];
+  uint32_t version;
+  uint32_t byteOrder;
+  uint64_t sourceHash;
+  int32_t vc;
+  int32_t fc;
+  uint32_t flags;
+  uint32_t realSize;
+  int32_t meshletCount;
+  int32_t lodCount;
+  int32_t lodFaceCount;
+  int32_t hullPlaneCount;
+  int32_t hullVertexCount;
+  uint32_t reserved;
+  double center[3];
+  double radius;
+  double boxMin[3];
+  double boxMax[3];
+};
+
+static const char bakedMeshMagic[8] = { 'P', 'L', 'Y', 'B', 'A', 'K', 'E', 0 };
+static const uint32_t bakedMeshVersion = 7;
+static const uint32_t bakedMeshByteOrder = 0x01020304;
+static const uint32_t bakedMeshTexcoords = 1;
+
+static size_t bakedMeshSize( const BakedMeshHeader &h ){
+  size_t perVertex = (h.flags & bakedMeshTexcoords) ? 11 : 9;
+  return sizeof(BakedMeshHeader) + (size_t)h.vc * perVertex * sizeof(FaceList::Real) + (size_t)h.fc * 3 * (sizeof(FaceList::Real) + sizeof(int32_t)) +
+    (size_t)h.meshletCount * sizeof(Meshlet) + (size_t)h.lodCount * sizeof(MeshLod) + (size_t)h.lodFaceCount * 3 * sizeof(int32_t) +
+    ((size_t)h.hullPlaneCount * 4 + (size_t)h.hullVertexCount * 3) * sizeof(FaceList::Real);
+}
+
+static bool facesInRange( const int (*faces)[3], int count, int vc ){
+  for( int i = 0; i < count; i++ ){
+    for( int k = 0; k < 3; k++ ){
+      if( (unsigned int)faces[i][k] >= (unsigned int)vc ){
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+/*
+ * Whether every index fl holds names a vertex, face or level face it
+ * has, so a corrupt file is never read past at draw time.
+ */
+static bool bakedIndicesValid( const FaceList* fl, int lodFaceCount ){
+  int i;
+  if( !facesInRange(fl->faces, fl->fc, fl->vc) ){
+    return false;
+  }
+  for( i = 0; i < fl->meshletCount; i++ ){
+    const Meshlet &m = fl->meshlets[i];
+    if( m.firstFace < 0 || m.faceCount < 0 || m.faceCount > fl->fc - m.firstFace ){
+      return false;
+    }
+  }
+  for( i = 0; i < fl->lodCount; i++ ){
+    const MeshLod &l = fl->lods[i];
+    if( l.firstFace < 0 || l.faceCount < 0 || l.faceCount > lodFaceCount - l.firstFace ){
+      return false;
+    }
+  }
+  // lodFaceCount( ) is where the last level ends
+  if( fl->lodCount > 0 && fl->lodFaceCount( ) != lodFaceCount ){
+    return false;
+  }
+  return fl->lodCount == 0 || facesInRange(fl->lodFaces, lodFaceCount, fl->vc);
+}
+
+uint64_t hashBytes( const char* data, size_t size ){
+  // FNV-1a style mixing over eight bytes at a time
+  const uint64_t prime = 0x100000001b3ULL;
+  uint64_t h = 0xcbf29ce484222325ULL ^ size;
+  size_t i = 0;
+  for( ; i + 8 <= size; i += 8 ){
+    uint64_t w;
+    memcpy(&w, data + i, 8);
+    h = (h ^ w) * prime;
+    h ^= h >> 29;
+  }
+  for( ; i < size; i++ ){
+    h = (h ^ (unsigned char)data[i]) * prime;
+  }
+  return h;
+}
+
+std::string bakedMeshPath( const char* plyFilename ){
+  return std::string(plyFilename) + ".mesh";
+}
+
+FaceList* readBakedMesh( const char* path, uint64_t sourceHash, Arena* arena ){
+  MappedFile file;
+  BakedMeshHeader header;
+  if( !file.open(path) || file.size( ) < sizeof(header) ){
+    return NULL;
+  }
+  memcpy(&header, file.data( ), sizeof(header));
+  if( memcmp(header.magic, bakedMeshMagic, sizeof(bakedMeshMagic)) != 0 ||
+      header.version != bakedMeshVersion ||
+      header.byteOrder != bakedMeshByteOrder ||
+      header.sourceHash != sourceHash ||
+      header.realSize != sizeof(FaceList::Real) ||
+      header.vc < 0 || header.fc < 0 || header.meshletCount < 0 ||
+      header.lodCount < 0 || header.lodFaceCount < 0 ||
+      header.hullPlaneCount < 0 || header.hullVertexCount < 0 ||
+      (header.hullPlaneCount > 0) != (header.hullVertexCount > 0) ||
+      file.size( ) != bakedMeshSize(header) ){
+    return NULL;
+  }
+
+  FaceList *fl = FaceList::create(header.vc, header.fc, (header.flags & bakedMeshTexcoords) != 0, arena);
+  memcpy(fl->center, header.center, sizeof(header.center));
+  fl->radius = header.radius;
+  memcpy(fl->boxMin, header.boxMin, sizeof(header.boxMin));
+  memcpy(fl->boxMax, header.boxMax, sizeof(header.boxMax));
+
+  // Each array is contiguous in the file and in the FaceList
+  const char *p = file.data( ) + sizeof(header);
+  const size_t vertexRows = (size_t)fl->vc * 3 * sizeof(FaceList::Real);
+  const size_t faceRows = (size_t)fl->fc * 3 * sizeof(FaceList::Real);
+  memcpy(fl->vertices, p, vertexRows);
+  p += vertexRows;
+  memcpy(fl->v_normals, p, vertexRows);
+  p += vertexRows;
+  memcpy(fl->colors, p, vertexRows);
+  p += vertexRows;
+  if( fl->texcoords ){
+    memcpy(fl->texcoords, p, (size_t)fl->vc * 2 * sizeof(FaceList::Real));
+    p += (size_t)fl->vc * 2 * sizeof(FaceList::Real);
+  }
+  memcpy(fl->f_normals, p, faceRows);
+  p += faceRows;
+  memcpy(fl->faces, p, (size_t)fl->fc * 3 * sizeof(int32_t));
+  p += (size_t)fl->fc * 3 * sizeof(int32_t);
+  if( header.meshletCount > 0 ){
+    fl->allocMeshlets(header.meshletCount);
+    memcpy(fl->meshlets, p, (size_t)header.meshletCount * sizeof(Meshlet));
+    p += (size_t)header.meshletCount * sizeof(Meshlet);
+  }
+  if( header.lodCount > 0 ){
+    fl->allocLods(header.lodCount, header.lodFaceCount);
+    memcpy(fl->lods, p, (size_t)header.lodCount * sizeof(MeshLod));
+    p += (size_t)header.lodCount * sizeof(MeshLod);
+    memcpy(fl->lodFaces, p, (size_t)header.lodFaceCount * 3 * sizeof(int32_t));
+  }
+  p += (size_t)header.lodFaceCount * 3 * sizeof(int32_t);
+  if( header.hullPlaneCount > 0 ){
+    fl->allocHull(header.hullPlaneCount, header.hullVertexCount);
+    memcpy(fl->hullPlanes, p, (size_t)header.hullPlaneCount * 4 * sizeof(FaceList::Real));
+    p += (size_t)header.hullPlaneCount * 4 * sizeof(FaceList::Real);
+    memcpy(fl->hullVertices, p, (size_t)header.hullVertexCount * 3 * sizeof(FaceList::Real));
+  }
+  if( !bakedIndicesValid(fl, header.lodFaceCount) ){
+    FaceList::release(fl);
+    return NULL;
+  }
+  return fl;
+}
+
+bool writeBakedMesh( const char* path, uint64_t sourceHash, const FaceList* fl ){
+  BakedMeshHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, bakedMeshMagic, sizeof(bakedMeshMagic));
+  header.version = bakedMeshVersion;
+  header.byteOrder = bakedMeshByteOrder;
+  header.sourceHash = sourceHash;
+  header.vc = fl->vc;
+  header.fc = fl->fc;
+  header.flags = fl->texcoords ? bakedMeshTexcoords : 0;
+  header.realSize = sizeof(FaceList::Real);
+  header.meshletCount = fl->meshletCount;
+  header.lodCount = fl->lodCount;
+  header.lodFaceCount = fl->lodFaceCount( );
+  header.hullPlaneCount = fl->hullPlaneCount;
+  header.hullVertexCount = fl->hullVertexCount;
+  memcpy(header.center, fl->center, sizeof(header.center));
+  header.radius = fl->radius;
+  memcpy(header.boxMin, fl->boxMin, sizeof(header.boxMin));
+  memcpy(header.boxMax, fl->boxMax, sizeof(header.boxMax));
+
+  // Unique per process and per call so concurrent writers never share
+  // a temporary file
+  static std::atomic<int> writeCount(0);
+  char suffix[48];
+  snprintf(suffix, sizeof(suffix), ".%ld.%d.tmp", (long)getpid( ), writeCount++);
+  std::string tmp = std::string(path) + suffix;
+  FILE *f = fopen(tmp.c_str( ), "wb");
+  if( !f ){
+    return false;
+  }
+  bool ok = fwrite(&header, sizeof(header), 1, f) == 1;
+  const size_t vertexRows = (size_t)fl->vc * 3 * sizeof(FaceList::Real);
+  const size_t faceRows = (size_t)fl->fc * 3 * sizeof(FaceList::Real);
+  ok = ok && fwrite(fl->vertices, 1, vertexRows, f) == vertexRows;
+  ok = ok && fwrite(fl->v_normals, 1, vertexRows, f) == vertexRows;
+  ok = ok && fwrite(fl->colors, 1, vertexRows, f) == vertexRows;
+  if( fl->texcoords ){
+    const size_t texcoordRows = (size_t)fl->vc * 2 * sizeof(FaceList::Real);
+    ok = ok && fwrite(fl->texcoords, 1, texcoordRows, f) == texcoordRows;
+  }
+  ok = ok && fwrite(fl->f_normals, 1, faceRows, f) == faceRows;
+  ok = ok && fwrite(fl->faces, 1, (size_t)fl->fc * 3 * sizeof(int32_t), f) == (size_t)fl->fc * 3 * sizeof(int32_t);
+  const size_t meshletSize = (size_t)fl->meshletCount * sizeof(Meshlet);
+  ok = ok && fwrite(fl->meshlets, 1, meshletSize, f) == meshletSize;
+  const size_t lodSize = (size_t)fl->lodCount * sizeof(MeshLod);
+  const size_t lodFaceSize = (size_t)fl->lodFaceCount( ) * 3 * sizeof(int32_t);
+  ok = ok && fwrite(fl->lods, 1, lodSize, f) == lodSize;
+  ok = ok && fwrite(fl->lodFaces, 1, lodFaceSize, f) == lodFaceSize;
+  const size_t hullPlaneSize = (size_t)fl->hullPlaneCount * 4 * sizeof(FaceList::Real);
+  const size_t hullVertexSize = (size_t)fl->hullVertexCount * 3 * sizeof(FaceList::Real);
+  ok = ok && fwrite(fl->hullPlanes, 1, hullPlaneSize, f) == hullPlaneSize;
+  ok = ok && fwrite(fl->hullVertices, 1, hullVertexSize, f) == hullVertexSize;
+  ok = (fclose(f) == 0) && ok;
+  if( !ok || rename(tmp.c_str( ), path) != 0 ){
+    remove(tmp.c_str( ));
+    return false;
+  }
+  return true;
+}
@@ -0,0 +1,44 @@
+/*
+ * MeshCache
+ *
+ * A baked, memory-mappable copy of a fully processed FaceList. The
+ * vertices, normals, colors, texture coordinates, faces, meshlets,
+ * levels of detail, bounding sphere, box and convex hull are stored
+ * exactly as
+ * readPlyModel leaves them, so loading a baked mesh is a handful of
+ * copies with no parsing or post-processing. Each file records a hash
+ * of the PLY file it was built from and is ignored once that file
+ * changes.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+
+#include "FaceList.h"
+
+#ifndef _MESHCACHE_H_
+#define _MESHCACHE_H_
+
+// Hash of the contents of a source file
+uint64_t hashBytes( const char* data, size_t size );
+
+// Where the baked copy of plyFilename is kept
+std::string bakedMeshPath( const char* plyFilename );
+
+/*
+ * Load the baked mesh at path. Returns NULL if there is no such file,
+ * it is not a baked mesh, it was built from a source whose hash is not
+ * sourceHash, or an index in it is out of range. The mesh is placed in
+ * arena when one is given.
+ */
+FaceList* readBakedMesh( const char* path, uint64_t sourceHash, Arena* arena = NULL );
+
+/*
+ * Write fl to path. The file is written beside path and renamed into
+ * place, so a reader never sees a partial file. Returns false on
+ * failure.
+ */
+bool writeBakedMesh( const char* path, uint64_t sourceHash, const FaceList* fl );
+
+#endif
@@ -0,0 +1,415 @@
+/*
+ * MeshOptimize
+ *
+ * Welding, vertex cache and vertex fetch ordering of a FaceList.
+ */
+
+#include "MeshOptimize.h"
+#include "Meshlets.h"
+#include "MeshSimplify.h"
+
+#include <stdint.h>
+#include <cmath>
+#include <unordered_map>
+#include <vector>
+
+#ifndef SQR
+#define SQR( x ) ((x) * (x))
+#endif
+
+typedef FaceList::Real Real;
+
+// Weld tolerances for meshes scaled to a unit sphere
+static const double weldDistance = 1e-6;
+static const double weldDegrees = 1.0;
+
+/*
+ * Move row i of rows to row newIndex[i] for every i in [0, count) where
+ * newIndex[i] is not -1.
+ */
+template <int N>
+static void permuteRows(Real (*rows)[N], const std::vector<int> &newIndex, int count){
+  std::vector<Real> copy(rows[0], rows[0] + (size_t)N * count);
+  for( int i = 0; i < count; i++ ){
+    if( newIndex[i] >= 0 ){
+      for( int j = 0; j < N; j++ ){
+        rows[newIndex[i]][j] = copy[(size_t)N * i + j];
+      }
+    }
+  }
+}
+
+// Renumber fl's vertices by newIndex; newCount of them are kept
+static void renumberVertices(FaceList *fl, const std::vector<int> &newIndex, int newCount){
+  permuteRows(fl->vertices, newIndex, fl->vc);
+  permuteRows(fl->v_normals, newIndex, fl->vc);
+  permuteRows(fl->colors, newIndex, fl->vc);
+  if( fl->texcoords ){
+    permuteRows(fl->texcoords, newIndex, fl->vc);
+  }
+  for( int f = 0; f < fl->fc; f++ ){
+    for( int k = 0; k < 3; k++ ){
+      fl->faces[f][k] = newIndex[fl->faces[f][k]];
+    }
+  }
+  fl->vc = newCount;
+}
+
+/*
+ * Vertices are hashed into a grid of cells much wider than the weld
+ * distance, so only a vertex within that distance of a cell's side has
+ * to look in the cell next to it as well. Cells whose keys collide only
+ * cost extra comparisons.
+ */
+static const double weldCellScale = 64.0;
+
+static uint64_t cellKey(int64_t x, int64_t y, int64_t z){
+  return (uint64_t)x * 73856093u ^ (uint64_t)y * 19349663u ^ (uint64_t)z * 83492791u;
+}
+
+int weldVertices( FaceList* fl, double distance, double degrees ){
+  const double maxDistance2 = distance * distance;
+  const double cellSize = distance * weldCellScale;
+  const double minCos = cos(degrees * M_PI / 180.0);
+  const int vc = fl->vc;
+
+  // the first vertex of each cell, and the next one in the same cell
+  std::unordered_map<uint64_t, int> firstInCell;
+  firstInCell.reserve(vc);
+  std::vector<int> nextInCell(vc, -1);
+  // the vertex each one is merged into
+  std::vector<int> weldTo(vc);
+  std::vector<double> normalSum(3 * (size_t)vc, 0.0);
+  int removed = 0;
+
+  for( int v = 0; v < vc; v++ ){
+    const Real *p = fl->vertices[v];
+    const Real *n = fl->v_normals[v];
+    // the cells within distance of p
+    int64_t cell[3], low[3], high[3];
+    for( int j = 0; j < 3; j++ ){
+      cell[j] = (int64_t)floor(p[j] / cellSize);
+      low[j] = (int64_t)floor((p[j] - distance) / cellSize);
+      high[j] = (int64_t)floor((p[j] + distance) / cellSize);
+    }
+    int match = -1;
+    for( int64_t x = low[0]; x <= high[0] && match < 0; x++ ){
+      for( int64_t y = low[1]; y <= high[1] && match < 0; y++ ){
+        for( int64_t z = low[2]; z <= high[2] && match < 0; z++ ){
+          std::unordered_map<uint64_t, int>::const_iterator it = firstInCell.find(cellKey(x, y, z));
+          for( int w = it == firstInCell.end( ) ? -1 : it->second; w >= 0; w = nextInCell[w] ){
+            const Real *q = fl->vertices[w];
+            const Real *m = fl->v_normals[w];
+            double d2 = SQR(p[0] - q[0]) + SQR(p[1] - q[1]) + SQR(p[2] - q[2]);
+            if( d2 > maxDistance2 || n[0] * m[0] + n[1] * m[1] + n[2] * m[2] < minCos ){
+              continue;
+            }
+            if( fl->texcoords && (fabs(fl->texcoords[v][0] - fl->texcoords[w][0]) > distance ||
+                fabs(fl->texcoords[v][1] - fl->texcoords[w][1]) > distance) ){
+              continue;
+            }
+            match = w;
+            break;
+          }
+        }
+      }
+    }
+    if( match < 0 ){
+      match = v;
+      uint64_t key = cellKey(cell[0], cell[1], cell[2]);
+      std::unordered_map<uint64_t, int>::iterator it = firstInCell.find(key);
+      if( it != firstInCell.end( ) ){
+        nextInCell[v] = it->second;
+        it->second = v;
+      }else{
+        firstInCell[key] = v;
+      }
+    }else{
+      removed++;
+    }
+    weldTo[v] = match;
+    for( int j = 0; j < 3; j++ ){
+      normalSum[3 * (size_t)match + j] += n[j];
+    }
+  }
+  if( removed == 0 ){
+    return 0;
+  }
+
+  // The vertices that are kept, packed down in their original order
+  std::vector<int> newIndex(vc, -1);
+  int kept = 0;
+  for( int v = 0; v < vc; v++ ){
+    if( weldTo[v] == v ){
+      double length = sqrt(SQR(normalSum[3 * (size_t)v]) + SQR(normalSum[3 * (size_t)v + 1]) + SQR(normalSum[3 * (size_t)v + 2]));
+      if( length > 0.0 ){
+        for( int j = 0; j < 3; j++ ){
+          fl->v_normals[v][j] = normalSum[3 * (size_t)v + j] / length;
+        }
+      }
+      newIndex[v] = kept++;
+    }
+  }
+  for( int v = 0; v < vc; v++ ){
+    newIndex[v] = newIndex[weldTo[v]];
+  }
+  // Only the kept vertices move; the others map onto them
+  std::vector<int> moveIndex(vc, -1);
+  for( int v = 0; v < vc; v++ ){
+    if( weldTo[v] == v ){
+      moveIndex[v] = newIndex[v];
+    }
+  }
+  permuteRows(fl->vertices, moveIndex, vc);
+  permuteRows(fl->v_normals, moveIndex, vc);
+  permuteRows(fl->colors, moveIndex, vc);
+  if( fl->texcoords ){
+    permuteRows(fl->texcoords, moveIndex, vc);
+  }
+  fl->vc = kept;
+
+  int faces = 0;
+  for( int f = 0; f < fl->fc; f++ ){
+    int a = newIndex[fl->faces[f][0]];
+    int b = newIndex[fl->faces[f][1]];
+    int c = newIndex[fl->faces[f][2]];
+    if( a == b || b == c || a == c ){
+      continue;
+    }
+    fl->faces[faces][0] = a;
+    fl->faces[faces][1] = b;
+    fl->faces[faces][2] = c;
+    for( int j = 0; j < 3; j++ ){
+      fl->f_normals[faces][j] = fl->f_normals[f][j];
+    }
+    faces++;
+  }
+  fl->fc = faces;
+  return removed;
+}
+
+/*
+ * Tipsify: draw all the remaining faces around one vertex (a fan),
+ * then move on to a vertex of that fan which is still in the cache and
+ * has few faces left, so it can be finished before it falls out.
+ * When none qualifies, go back to the most recently used vertex that
+ * still has faces, or failing that the next one in index order.
+ */
+static void tipsify( const std::vector<int> &faceVertices, int vc, int cacheSize, std::vector<int> &order ){
+  const int fc = (int)(faceVertices.size( ) / 3);
+
+  // faces around each vertex, in compressed rows
+  std::vector<int> firstFace(vc + 1, 0);
+  for( int f = 0; f < fc; f++ ){
+    for( int k = 0; k < 3; k++ ){
+      firstFace[faceVertices[3 * (size_t)f + k] + 1]++;
+    }
+  }
+  for( int v = 0; v < vc; v++ ){
+    firstFace[v + 1] += firstFace[v];
+  }
+  std::vector<int> vertexFaces(3 * (size_t)fc);
+  {
+    std::vector<int> fill(firstFace.begin( ), firstFace.end( ) - 1);
+    for( int f = 0; f < fc; f++ ){
+      for( int k = 0; k < 3; k++ ){
+        vertexFaces[fill[faceVertices[3 * (size_t)f + k]]++] = f;
+      }
+    }
+  }
+
+  // faces not yet drawn around each vertex
+  std::vector<int> liveFaces(vc);
+  for( int v = 0; v < vc; v++ ){
+    liveFaces[v] = firstFace[v + 1] - firstFace[v];
+  }
+  // when each vertex last entered the cache
+  std::vector<int> cacheTime(vc, 0);
+  std::vector<bool> emitted(fc, false);
+  std::vector<int> deadEnd;
+  order.clear( );
+  order.reserve(fc);
+  std::vector<int> candidates;
+
+  int time = cacheSize + 1;
+  int cursor = 0;
+  int fan = 0;
+  while( fan >= 0 ){
+    candidates.clear( );
+    for( int i = firstFace[fan]; i < firstFace[fan + 1]; i++ ){
+      int f = vertexFaces[i];
+      if( emitted[f] ){
+        continue;
+      }
+      emitted[f] = true;
+      order.push_back(f);
+      for( int k = 0; k < 3; k++ ){
+        int v = faceVertices[3 * (size_t)f + k];
+        deadEnd.push_back(v);
+        candidates.push_back(v);
+        liveFaces[v]--;
+        if( time - cacheTime[v] > cacheSize ){
+          cacheTime[v] = time++;
+        }
+      }
+    }
+
+    // the candidate that stays in the cache longest once its faces are
+    // drawn, among those that will not fall out before then
+    fan = -1;
+    int best = -1;
+    for( size_t i = 0; i < candidates.size( ); i++ ){
+      int v = candidates[i];
+      if( liveFaces[v] > 0 ){
+        int priority = 0;
+        if( time - cacheTime[v] + 2 * liveFaces[v] <= cacheSize ){
+          priority = time - cacheTime[v];
+        }
+        if( priority > best ){
+          best = priority;
+          fan = v;
+        }
+      }
+    }
+    while( fan < 0 && !deadEnd.empty( ) ){
+      int v = deadEnd.back( );
+      deadEnd.pop_back( );
+      if( liveFaces[v] > 0 ){
+        fan = v;
+      }
+    }
+    for( ; fan < 0 && cursor < vc; cursor++ ){
+      if( liveFaces[cursor] > 0 ){
+        fan = cursor;
+      }
+    }
+  }
+}
+
+/*
+ * Append the cache order of faces [first, first + count) to order. The
+ * range's vertices are numbered from 0 for tipsify, so the work is in
+ * proportion to the range, not the mesh; newIndex is all -1 on entry
+ * and on return.
+ */
+static void appendRangeOrder( const int (*faces)[3], int first, int count, int cacheSize, std::vector<int> &newIndex, std::vector<int> &order ){
+  std::vector<int> faceVertices(3 * (size_t)count);
+  int vertices = 0;
+  for( int f = 0; f < count; f++ ){
+    for( int k = 0; k < 3; k++ ){
+      int v = faces[first + f][k];
+      if( newIndex[v] < 0 ){
+        newIndex[v] = vertices++;
+      }
+      faceVertices[3 * (size_t)f + k] = newIndex[v];
+    }
+  }
+  for( int f = 0; f < count; f++ ){
+    for( int k = 0; k < 3; k++ ){
+      newIndex[faces[first + f][k]] = -1;
+    }
+  }
+  std::vector<int> rangeOrder;
+  tipsify(faceVertices, vertices, cacheSize, rangeOrder);
+  for( int i = 0; i < count; i++ ){
+    order.push_back(first + rangeOrder[i]);
+  }
+}
+
+// Each meshlet is ordered on its own, so it keeps its range
+void optimizeVertexCache( FaceList* fl, int cacheSize ){
+  const int fc = fl->fc;
+  if( fc == 0 ){
+    return;
+  }
+  std::vector<int> newIndex(fl->vc, -1);
+  std::vector<int> order;
+  order.reserve(fc);
+  if( fl->meshletCount == 0 ){
+    appendRangeOrder(fl->faces, 0, fc, cacheSize, newIndex, order);
+  }
+  for( int i = 0; i < fl->meshletCount; i++ ){
+    appendRangeOrder(fl->faces, fl->meshlets[i].firstFace, fl->meshlets[i].faceCount, cacheSize, newIndex, order);
+  }
+
+  std::vector<int> faces(fl->faces[0], fl->faces[0] + 3 * (size_t)fc);
+  std::vector<Real> normals(fl->f_normals[0], fl->f_normals[0] + 3 * (size_t)fc);
+  for( int i = 0; i < fc; i++ ){
+    int f = order[i];
+    for( int j = 0; j < 3; j++ ){
+      fl->faces[i][j] = faces[3 * (size_t)f + j];
+      fl->f_normals[i][j] = normals[3 * (size_t)f + j];
+    }
+  }
+}
+
+void optimizeVertexCache( int (*faces)[3], int faceCount, int vertexCount, int cacheSize ){
+  if( faceCount == 0 ){
+    return;
+  }
+  std::vector<int> newIndex(vertexCount, -1);
+  std::vector<int> order;
+  order.reserve(faceCount);
+  appendRangeOrder(faces, 0, faceCount, cacheSize, newIndex, order);
+  std::vector<int> copy(faces[0], faces[0] + 3 * (size_t)faceCount);
+  for( int i = 0; i < faceCount; i++ ){
+    for( int j = 0; j < 3; j++ ){
+      faces[i][j] = copy[3 * (size_t)order[i] + j];
+    }
+  }
+}
+
+void optimizeVertexFetch( FaceList* fl ){
+  std::vector<int> newIndex(fl->vc, -1);
+  int next = 0;
+  for( int f = 0; f < fl->fc; f++ ){
+    for( int k = 0; k < 3; k++ ){
+      int v = fl->faces[f][k];
+      if( newIndex[v] < 0 ){
+        newIndex[v] = next++;
+      }
+    }
+  }
+  renumberVertices(fl, newIndex, next);
+}
+
+double vertexCacheMissRatio( const FaceList* fl, int cacheSize ){
+  if( fl->fc == 0 ){
+    return 0.0;
+  }
+  // A FIFO cache holds the last cacheSize vertices that missed, so a
+  // vertex is a hit until cacheSize misses have followed it
+  std::vector<long> missedAt(fl->vc, -(long)cacheSize);
+  long misses = 0;
+  for( int f = 0; f < fl->fc; f++ ){
+    for( int k = 0; k < 3; k++ ){
+      int v = fl->faces[f][k];
+      if( misses - missedAt[v] >= cacheSize ){
+        missedAt[v] = ++misses;
+      }
+    }
+  }
+  return (double)misses / fl->fc;
+}
+
+void optimizeMesh( FaceList* fl, MeshOptimizeStats* stats ){
+  MeshOptimizeStats s;
+  s.verticesBefore = fl->vc;
+  s.facesBefore = fl->fc;
+  s.acmrBefore = vertexCacheMissRatio(fl);
+
+  // the faces and vertices are about to be reordered under it
+  fl->dropPacking( );
+  weldVertices(fl, weldDistance, weldDegrees);
+  buildMeshlets(fl);
+  optimizeVertexCache(fl);
+  optimizeVertexFetch(fl);
+  buildLods(fl);
+
+  s.verticesAfter = fl->vc;
+  s.facesAfter = fl->fc;
+  s.acmrAfter = vertexCacheMissRatio(fl);
+  if( stats ){
+    *stats = s;
+  }
+}
@@ -0,0 +1,75 @@
+/*
+ * MeshOptimize
+ *
+ * Clean-up and reordering of a loaded FaceList for drawing it as
+ * indexed triangles:
+ *
+ *   1. welding, which merges vertices that are at the same place and
+ *      face the same way, so triangles that meet share their corners
+ *   2. ordering the faces for the GPU's post-transform vertex cache
+ *      (Tipsify, Sander, Nehab and Barczak 2007), so a vertex is
+ *      reused while it is still in the cache
+ *   3. numbering the vertices in the order the faces first use them,
+ *      so fetching them walks through memory front to back
+ *
+ * How well a mesh uses the cache is measured as its ACMR, the average
+ * number of vertices transformed per triangle drawn. Each triangle
+ * costs at most 3; a well ordered closed mesh gets close to 0.6.
+ */
+
+#include "FaceList.h"
+
+#ifndef _MESHOPTIMIZE_H_
+#define _MESHOPTIMIZE_H_
+
+// Vertex cache size the faces are ordered for and ACMR is measured with
+static const int vertexCacheSize = 16;
+
+struct MeshOptimizeStats{
+  int verticesBefore;
+  int verticesAfter;
+  int facesBefore;
+  int facesAfter;
+  double acmrBefore;
+  double acmrAfter;
+};
+
+/*
+ * Merge vertices less than distance apart whose normals are less than
+ * degrees apart, along with their texture coordinates. Each merged
+ * vertex keeps the first one's position and color and the average of
+ * the normals. Faces left with two corners on the same vertex are
+ * dropped. The arrays keep their size; vc and fc shrink. Returns the
+ * number of vertices removed.
+ */
+int weldVertices( FaceList* fl, double distance, double degrees );
+
+/*
+ * Reorder the faces for a FIFO vertex cache of cacheSize vertices. A
+ * mesh split into meshlets is ordered one meshlet at a time, so each
+ * meshlet keeps its range of faces.
+ */
+void optimizeVertexCache( FaceList* fl, int cacheSize = vertexCacheSize );
+
+// The same for a list of faceCount faces over vertexCount vertices
+void optimizeVertexCache( int (*faces)[3], int faceCount, int vertexCount, int cacheSize = vertexCacheSize );
+
+/*
+ * Renumber the vertices in the order the faces first use them. Vertices
+ * no face uses are dropped.
+ */
+void optimizeVertexFetch( FaceList* fl );
+
+// The ACMR of drawing fl's faces in order through a FIFO cache
+double vertexCacheMissRatio( const FaceList* fl, int cacheSize = vertexCacheSize );
+
+/*
+ * All three steps, with tolerances suited to the unit sized meshes
+ * readPlyModel produces, and the faces grouped into meshlets (see
+ * Meshlets.h) after welding, so the faces are then ordered within
+ * each meshlet. Last, a chain of levels of detail is built over the
+ * final vertices (see MeshSimplify.h). Fills in stats when given.
+ */
+void optimizeMesh( FaceList* fl, MeshOptimizeStats* stats = NULL );
+
+#endif
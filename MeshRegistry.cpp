@@ -0,0 +1,160 @@
+/*
+ * MeshRegistry
+ *
+ * Shares one loaded, read-only FaceList between everything that uses
+ * the same model.
+ */
+
+#include "MeshRegistry.h"
+#include "MappedFile.h"
+#include "MeshCache.h"
+#include "PlyModel.h"
+
+#include <climits>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+
+MeshRegistry::MeshRegistry( Arena* arena ) : _arena(arena){ }
+
+MeshRegistry::~MeshRegistry( ){
+  std::map<uint64_t, Entry*>::iterator i;
+  for( i = _byHash.begin( ); i != _byHash.end( ); ++i ){
+    FaceList::release(i->second->loaded);
+    delete i->second;
+  }
+}
+
+MeshRegistry& meshRegistry( ){
+  static MeshRegistry registry;
+  return registry;
+}
+
+static std::string canonicalPath( const char* filename ){
+  char resolved[PATH_MAX];
+  if( realpath(filename, resolved) ){
+    return resolved;
+  }
+  return filename;
+}
+
+MeshHandle::MeshHandle( const MeshHandle& other ) : _registry(other._registry), _mesh(other._mesh){
+  if( _registry ){
+    _registry->retain(_mesh);
+  }
+}
+
+void MeshHandle::reset( ){
+  if( _registry ){
+    _registry->release(_mesh);
+  }
+  _registry = NULL;
+  _mesh = NULL;
+}
+
+MeshHandle MeshRegistry::acquire( const char* filename ){
+  std::string path = canonicalPath(filename);
+  std::shared_future<FaceList*> mesh;
+  // only made for a mesh not loaded yet, so acquiring one that is costs
+  // no more than its path
+  std::unique_ptr<std::promise<FaceList*> > loading;
+  Entry *created = NULL;
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    std::map<std::string, Entry*>::iterator i = _byPath.find(path);
+    if( i != _byPath.end( ) ){
+      i->second->refs++;
+      mesh = i->second->mesh;
+    }
+  }
+
+  if( !mesh.valid( ) ){
+    // Not seen under this path; the contents may still be known
+    MappedFile file;
+    if( !file.open(path.c_str( )) ){
+      std::cerr << "File \"" << filename << "\" not found." << std::endl;
+      exit( 1 );
+    }
+    uint64_t hash = hashBytes(file.data( ), file.size( ));
+    file.close( );
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    std::map<uint64_t, Entry*>::iterator i = _byHash.find(hash);
+    Entry *e;
+    if( i != _byHash.end( ) ){
+      e = i->second;
+    }else{
+      e = new Entry;
+      e->hash = hash;
+      loading.reset(new std::promise<FaceList*>);
+      e->mesh = loading->get_future( ).share( );
+      e->loaded = NULL;
+      e->refs = 0;
+      _byHash[hash] = e;
+      created = e;
+    }
+    if( _byPath.find(path) == _byPath.end( ) ){
+      e->paths.push_back(path);
+      _byPath[path] = e;
+    }
+    e->refs++;
+    mesh = e->mesh;
+  }
+
+  if( created ){
+    // Load outside the lock so other meshes can be acquired meanwhile
+    FaceList *fl = readPlyModel(path.c_str( ), _arena);
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      created->loaded = fl;
+      _byMesh[fl] = created;
+    }
+    loading->set_value(fl);
+  }
+  return MeshHandle(this, mesh.get( ));
+}
+
+void MeshRegistry::retain( const FaceList* mesh ){
+  std::lock_guard<std::mutex> lock(_mutex);
+  std::map<const FaceList*, Entry*>::iterator i = _byMesh.find(mesh);
+  if( i != _byMesh.end( ) ){
+    i->second->refs++;
+  }
+}
+
+void MeshRegistry::release( const FaceList* mesh ){
+  if( !mesh ){
+    return;
+  }
+  std::lock_guard<std::mutex> lock(_mutex);
+  std::map<const FaceList*, Entry*>::iterator i = _byMesh.find(mesh);
+  if( i == _byMesh.end( ) ){
+    return;
+  }
+  Entry *e = i->second;
+  if( --e->refs > 0 ){
+    return;
+  }
+  for( size_t p = 0; p < e->paths.size( ); p++ ){
+    _byPath.erase(e->paths[p]);
+  }
+  _byHash.erase(e->hash);
+  _byMesh.erase(i);
+  FaceList::release(e->loaded);
+  delete e;
+}
+
+int MeshRegistry::meshCount( ){
+  std::lock_guard<std::mutex> lock(_mutex);
+  return (int)_byHash.size( );
+}
+
+int MeshRegistry::referenceCount( ){
+  std::lock_guard<std::mutex> lock(_mutex);
+  int refs = 0;
+  std::map<uint64_t, Entry*>::iterator i;
+  for( i = _byHash.begin( ); i != _byHash.end( ); ++i ){
+    refs += i->second->refs;
+  }
+  return refs;
+}
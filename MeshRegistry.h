@@ -0,0 +1,114 @@
+/*
+ * MeshRegistry
+ *
+ * Shares one loaded, read-only FaceList between everything that uses
+ * the same model. Meshes are keyed by canonical path and by a hash of
+ * the file's contents, so a file loaded through two different paths,
+ * or two files with identical contents, are still loaded only once.
+ * A mesh is freed when the last reference to it is released.
+ *
+ * A registry given an Arena loads its meshes there. Releasing them then
+ * only drops the bookkeeping; the memory goes when the arena is reset,
+ * which must wait until every handle has been released and meshCount( )
+ * is 0.
+ *
+ * Meshes are handed out as MeshHandles. A handle holds one reference:
+ * copying it adds one, moving it passes it on, and destroying or
+ * resetting it releases it. The mesh itself is never copied.
+ */
+
+#include <stdint.h>
+#include <future>
+#include <map>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "FaceList.h"
+
+#ifndef _MESHREGISTRY_H_
+#define _MESHREGISTRY_H_
+
+class MeshRegistry;
+
+class MeshHandle{
+public:
+  MeshHandle( ) : _registry(NULL), _mesh(NULL){ }
+  MeshHandle( const MeshHandle& other );
+  MeshHandle( MeshHandle&& other ) : _registry(other._registry), _mesh(other._mesh){
+    other._registry = NULL;
+    other._mesh = NULL;
+  }
+  ~MeshHandle( ){ reset( ); }
+
+  MeshHandle& operator =( MeshHandle other ){
+    std::swap(_registry, other._registry);
+    std::swap(_mesh, other._mesh);
+    return *this;
+  }
+
+  // Drop the reference; the handle is empty afterwards
+  void reset( );
+
+  const FaceList* get( ) const { return _mesh; }
+  const FaceList* operator ->( ) const { return _mesh; }
+  explicit operator bool( ) const { return _mesh != NULL; }
+
+  MeshRegistry* registry( ) const { return _registry; }
+
+private:
+  friend class MeshRegistry;
+  // Takes over a reference already counted for mesh
+  MeshHandle( MeshRegistry* registry, const FaceList* mesh ) : _registry(registry), _mesh(mesh){ }
+
+  MeshRegistry* _registry;
+  const FaceList* _mesh;
+};
+
+class MeshRegistry{
+public:
+  explicit MeshRegistry( Arena* arena = NULL );
+  ~MeshRegistry( );
+
+  /*
+   * Returns the shared mesh for filename, loading it with readPlyModel
+   * the first time. Safe to call from several threads at once; a thread
+   * asking for a mesh another thread is loading waits for that load.
+   */
+  MeshHandle acquire( const char* filename );
+
+  // number of distinct meshes currently loaded
+  int meshCount( );
+  // number of handles held over all meshes
+  int referenceCount( );
+
+  Arena* arena( ) const { return _arena; }
+
+private:
+  MeshRegistry( const MeshRegistry& );
+  MeshRegistry& operator =( const MeshRegistry& );
+
+  friend class MeshHandle;
+  void retain( const FaceList* mesh );
+  void release( const FaceList* mesh );
+
+  struct Entry{
+    uint64_t hash;
+    std::vector<std::string> paths;
+    std::shared_future<FaceList*> mesh;
+    const FaceList* loaded;
+    int refs;
+  };
+
+  Arena* _arena;
+  std::mutex _mutex;
+  std::map<std::string, Entry*> _byPath;
+  std::map<uint64_t, Entry*> _byHash;
+  std::map<const FaceList*, Entry*> _byMesh;
+};
+
+// The registry shared by the whole program
+MeshRegistry& meshRegistry( );
+
+#endif
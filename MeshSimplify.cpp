@@ -0,0 +1,620 @@
+/*
+ * MeshSimplify
+ *
+ * Quadric error edge collapse for levels of detail.
+ */
+
+#include "MeshSimplify.h"
+#include "MeshOptimize.h"
+
+#include <stdint.h>
+#include <algorithm>
+#include <cmath>
+#include <queue>
+#include <unordered_map>
+#include <vector>
+
+// How much more a border plane counts than a face of the same size
+static const double borderWeight = 10.0;
+// A collapse may turn a face at most this far, as the cosine of the angle
+static const double maxTurnCos = 0.2;
+
+/*
+ * Sum of squared distances to a set of weighted planes, as the matrix
+ * A, vector b and constant c of p.A.p + 2 b.p + c. A is symmetric and
+ * kept as xx, xy, xz, yy, yz, zz.
+ */
+struct Quadric{
+  double a[6];
+  double b[3];
+  double c;
+};
+
+static void addPlane( Quadric &q, const double n[3], double d, double w ){
+  q.a[0] += w * n[0] * n[0];
+  q.a[1] += w * n[0] * n[1];
+  q.a[2] += w * n[0] * n[2];
+  q.a[3] += w * n[1] * n[1];
+  q.a[4] += w * n[1] * n[2];
+  q.a[5] += w * n[2] * n[2];
+  for( int j = 0; j < 3; j++ ){
+    q.b[j] += w * d * n[j];
+  }
+  q.c += w * d * d;
+}
+
+static void addQuadric( Quadric &q, const Quadric &r ){
+  for( int j = 0; j < 6; j++ ){
+    q.a[j] += r.a[j];
+  }
+  for( int j = 0; j < 3; j++ ){
+    q.b[j] += r.b[j];
+  }
+  q.c += r.c;
+}
+
+static double evaluate( const Quadric &q, const double p[3] ){
+  double x = p[0], y = p[1], z = p[2];
+  double e = q.a[0] * x * x + 2.0 * q.a[1] * x * y + 2.0 * q.a[2] * x * z +
+    q.a[3] * y * y + 2.0 * q.a[4] * y * z + q.a[5] * z * z +
+    2.0 * (q.b[0] * x + q.b[1] * y + q.b[2] * z) + q.c;
+  return std::max(e, 0.0);
+}
+
+static void cross( const double a[3], const double b[3], double out[3] ){
+  out[0] = a[1] * b[2] - a[2] * b[1];
+  out[1] = a[2] * b[0] - a[0] * b[2];
+  out[2] = a[0] * b[1] - a[1] * b[0];
+}
+
+static double dot( const double a[3], const double b[3] ){
+  return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+// A collapse of vertex from onto vertex to, waiting in the queue
+struct Collapse{
+  double cost;
+  int from;
+  int to;
+  // the vertices' versions when the cost was found; a collapse whose
+  // vertices changed since is stale
+  int fromVersion;
+  int toVersion;
+
+  // cheapest first, ties broken by vertex so the order is repeatable
+  bool operator <( const Collapse &other ) const{
+    if( cost != other.cost ){
+      return cost > other.cost;
+    }
+    if( from != other.from ){
+      return from > other.from;
+    }
+    return to > other.to;
+  }
+};
+
+class Simplifier{
+public:
+  enum Kind{ Interior, Border, Locked };
+
+  Simplifier( const FaceList* fl );
+
+  // Collapse edges until at most target faces are left or none can go
+  void collapseTo( int target );
+
+  // How far the vertices removed so far are from the faces left
+  double error( );
+
+  int liveFaces;
+  std::vector<int> faces;
+  std::vector<bool> faceAlive;
+  // every collapse made, in order, with no error yet
+  std::vector<EdgeCollapse> collapses;
+
+private:
+  const double* position( int v ) const{
+    return &positions[3 * (size_t)v];
+  }
+  void faceNormal( int f, int moved, int to, double n[3] ) const;
+  void pushEdge( int a, int b );
+  int representative( int v );
+  int edgeFaces( int a, int b ) const;
+  bool canCollapse( int from, int to );
+  void collapse( int from, int to );
+  int markNeighbours( int v, std::vector<int> &mark );
+
+  std::vector<double> positions;
+  std::vector<Quadric> quadrics;
+  std::vector<char> kind;
+  std::vector<bool> removed;
+  // the vertex each removed vertex was collapsed onto
+  std::vector<int> collapsedTo;
+  std::vector<int> version;
+  // faces around each vertex; faces that died are skipped
+  std::vector< std::vector<int> > vertexFaces;
+  std::priority_queue<Collapse> queue;
+  // scratch marks for neighbour sets
+  std::vector<int> markFrom;
+  std::vector<int> markTo;
+  int stamp;
+};
+
+/*
+ * Each vertex starts with the planes of its faces, weighted by area,
+ * and each border edge adds a plane through it at right angles to its
+ * face to both of its ends. Vertices on edges shared by more than two
+ * faces never move.
+ */
+Simplifier::Simplifier( const FaceList* fl ){
+  const int vc = fl->vc;
+  const int fc = fl->fc;
+  faces.assign(fl->faces[0], fl->faces[0] + 3 * (size_t)fc);
+  faceAlive.assign(fc, true);
+  liveFaces = fc;
+  positions.resize(3 * (size_t)vc);
+  for( int v = 0; v < vc; v++ ){
+    for( int j = 0; j < 3; j++ ){
+      positions[3 * (size_t)v + j] = fl->vertices[v][j];
+    }
+  }
+  Quadric zero = { { 0, 0, 0, 0, 0, 0 }, { 0, 0, 0 }, 0 };
+  quadrics.assign(vc, zero);
+  kind.assign(vc, Interior);
+  removed.assign(vc, false);
+  collapsedTo.assign(vc, -1);
+  version.assign(vc, 0);
+  vertexFaces.resize(vc);
+  markFrom.assign(vc, 0);
+  markTo.assign(vc, 0);
+  stamp = 0;
+
+  std::unordered_map<uint64_t, int> edgeUses;
+  for( int f = 0; f < fc; f++ ){
+    for( int k = 0; k < 3; k++ ){
+      int a = faces[3 * f + k];
+      int b = faces[3 * f + (k + 1) % 3];
+      edgeUses[(uint64_t)std::min(a, b) << 32 | (uint32_t)std::max(a, b)]++;
+      vertexFaces[a].push_back(f);
+    }
+  }
+
+  for( int f = 0; f < fc; f++ ){
+    double n[3];
+    faceNormal(f, -1, -1, n);
+    double length = sqrt(dot(n, n));
+    if( length == 0.0 ){
+      continue;
+    }
+    for( int j = 0; j < 3; j++ ){
+      n[j] /= length;
+    }
+    double d = -dot(n, position(faces[3 * f]));
+    for( int k = 0; k < 3; k++ ){
+      addPlane(quadrics[faces[3 * f + k]], n, d, 0.5 * length);
+    }
+
+    for( int k = 0; k < 3; k++ ){
+      int a = faces[3 * f + k];
+      int b = faces[3 * f + (k + 1) % 3];
+      int uses = edgeUses[(uint64_t)std::min(a, b) << 32 | (uint32_t)std::max(a, b)];
+      if( uses > 2 ){
+        kind[a] = kind[b] = Locked;
+      }else if( uses == 1 ){
+        if( kind[a] == Interior ){
+          kind[a] = Border;
+        }
+        if( kind[b] == Interior ){
+          kind[b] = Border;
+        }
+        double edge[3], m[3];
+        for( int j = 0; j < 3; j++ ){
+          edge[j] = position(b)[j] - position(a)[j];
+        }
+        cross(edge, n, m);
+        double mLength = sqrt(dot(m, m));
+        if( mLength > 0.0 ){
+          for( int j = 0; j < 3; j++ ){
+            m[j] /= mLength;
+          }
+          double w = borderWeight * dot(edge, edge);
+          addPlane(quadrics[a], m, -dot(m, position(a)), w);
+          addPlane(quadrics[b], m, -dot(m, position(a)), w);
+        }
+      }
+    }
+  }
+
+  // every edge once: interior edges from the face where they run from
+  // the lower index, border edges from their only face
+  for( int f = 0; f < fc; f++ ){
+    for( int k = 0; k < 3; k++ ){
+      int a = faces[3 * f + k];
+      int b = faces[3 * f + (k + 1) % 3];
+      if( a < b || edgeUses[(uint64_t)b << 32 | (uint32_t)a] == 1 ){
+        pushEdge(a, b);
+      }
+    }
+  }
+}
+
+// The normal of face f, scaled by twice its area, with vertex moved at
+// the position of vertex to when moved is not -1
+void Simplifier::faceNormal( int f, int moved, int to, double n[3] ) const{
+  const double *p[3];
+  for( int k = 0; k < 3; k++ ){
+    int v = faces[3 * f + k];
+    p[k] = position(v == moved ? to : v);
+  }
+  double e1[3], e2[3];
+  for( int j = 0; j < 3; j++ ){
+    e1[j] = p[1][j] - p[0][j];
+    e2[j] = p[2][j] - p[0][j];
+  }
+  cross(e1, e2, n);
+}
+
+// Queue the cheaper way of collapsing the edge between a and b
+void Simplifier::pushEdge( int a, int b ){
+  Quadric q = quadrics[a];
+  addQuadric(q, quadrics[b]);
+  Collapse c;
+  c.cost = HUGE_VAL;
+  // border vertices stay on the border; canCollapse checks the edge
+  // itself is on it
+  if( kind[a] == Interior || (kind[a] == Border && kind[b] != Interior) ){
+    c.cost = evaluate(q, position(b));
+    c.from = a;
+    c.to = b;
+  }
+  if( kind[b] == Interior || (kind[b] == Border && kind[a] != Interior) ){
+    double cost = evaluate(q, position(a));
+    if( cost < c.cost ){
+      c.cost = cost;
+      c.from = b;
+      c.to = a;
+    }
+  }
+  if( c.cost == HUGE_VAL ){
+    return;
+  }
+  c.fromVersion = version[c.from];
+  c.toVersion = version[c.to];
+  queue.push(c);
+}
+
+// Stamp mark for every vertex sharing a live face with v; returns the stamp
+int Simplifier::markNeighbours( int v, std::vector<int> &mark ){
+  int s = ++stamp;
+  for( size_t i = 0; i < vertexFaces[v].size( ); i++ ){
+    int f = vertexFaces[v][i];
+    if( !faceAlive[f] ){
+      continue;
+    }
+    for( int k = 0; k < 3; k++ ){
+      int w = faces[3 * f + k];
+      if( w != v ){
+        mark[w] = s;
+      }
+    }
+  }
+  return s;
+}
+
+// Live faces on the edge between a and b
+int Simplifier::edgeFaces( int a, int b ) const{
+  int count = 0;
+  for( size_t i = 0; i < vertexFaces[a].size( ); i++ ){
+    int f = vertexFaces[a][i];
+    if( faceAlive[f] && (faces[3 * f] == b || faces[3 * f + 1] == b || faces[3 * f + 2] == b) ){
+      count++;
+    }
+  }
+  return count;
+}
+
+/*
+ * A collapse has to keep the mesh a manifold: the two ends may have no
+ * neighbours in common other than the far corners of the faces on the
+ * edge. It may not fold or flatten any face that survives it. A border
+ * vertex may only slide along a border edge, and not when the face on
+ * that edge has a second border edge, since that would eat away a
+ * strip one face wide or a small piece of the mesh.
+ */
+bool Simplifier::canCollapse( int from, int to ){
+  int sharedFaces = edgeFaces(from, to);
+  if( sharedFaces == 0 || (kind[from] == Border && sharedFaces != 1) ){
+    return false;
+  }
+  if( kind[from] == Border ){
+    for( size_t i = 0; i < vertexFaces[from].size( ); i++ ){
+      int f = vertexFaces[from][i];
+      if( !faceAlive[f] || (faces[3 * f] != to && faces[3 * f + 1] != to && faces[3 * f + 2] != to) ){
+        continue;
+      }
+      int far = faces[3 * f] + faces[3 * f + 1] + faces[3 * f + 2] - from - to;
+      if( edgeFaces(from, far) == 1 || edgeFaces(to, far) == 1 ){
+        return false;
+      }
+    }
+  }
+
+  int fromStamp = markNeighbours(from, markFrom);
+  int toStamp = markNeighbours(to, markTo);
+  int common = 0;
+  for( size_t i = 0; i < vertexFaces[to].size( ); i++ ){
+    int f = vertexFaces[to][i];
+    if( !faceAlive[f] ){
+      continue;
+    }
+    for( int k = 0; k < 3; k++ ){
+      int w = faces[3 * f + k];
+      if( markFrom[w] == fromStamp && markTo[w] == toStamp ){
+        // count each common neighbour once
+        markTo[w] = 0;
+        common++;
+      }
+    }
+  }
+  if( common != sharedFaces ){
+    return false;
+  }
+
+  for( size_t i = 0; i < vertexFaces[from].size( ); i++ ){
+    int f = vertexFaces[from][i];
+    if( !faceAlive[f] || faces[3 * f] == to || faces[3 * f + 1] == to || faces[3 * f + 2] == to ){
+      continue;
+    }
+    double before[3], after[3];
+    faceNormal(f, -1, -1, before);
+    faceNormal(f, from, to, after);
+    double lengths = sqrt(dot(before, before) * dot(after, after));
+    if( lengths > 0.0 ? dot(before, after) <= maxTurnCos * lengths : dot(after, after) == 0.0 ){
+      return false;
+    }
+  }
+  return true;
+}
+
+void Simplifier::collapse( int from, int to ){
+  addQuadric(quadrics[to], quadrics[from]);
+
+  std::vector<int> &toFaces = vertexFaces[to];
+  for( size_t i = 0; i < vertexFaces[from].size( ); i++ ){
+    int f = vertexFaces[from][i];
+    if( !faceAlive[f] ){
+      continue;
+    }
+    int *corners = &faces[3 * f];
+    if( corners[0] == to || corners[1] == to || corners[2] == to ){
+      faceAlive[f] = false;
+      liveFaces--;
+      continue;
+    }
+    for( int k = 0; k < 3; k++ ){
+      if( corners[k] == from ){
+        corners[k] = to;
+      }
+    }
+    toFaces.push_back(f);
+  }
+  std::vector<int>().swap(vertexFaces[from]);
+  removed[from] = true;
+  collapsedTo[from] = to;
+  EdgeCollapse c = { from, to, 0.0f };
+  collapses.push_back(c);
+  version[to]++;
+
+  // drop dead faces from to's list, then requeue every edge around to
+  size_t kept = 0;
+  for( size_t i = 0; i < toFaces.size( ); i++ ){
+    if( faceAlive[toFaces[i]] ){
+      toFaces[kept++] = toFaces[i];
+    }
+  }
+  toFaces.resize(kept);
+  int s = ++stamp;
+  for( size_t i = 0; i < toFaces.size( ); i++ ){
+    for( int k = 0; k < 3; k++ ){
+      int w = faces[3 * toFaces[i] + k];
+      if( w != to && markFrom[w] != s ){
+        markFrom[w] = s;
+        pushEdge(to, w);
+      }
+    }
+  }
+}
+
+void Simplifier::collapseTo( int target ){
+  while( liveFaces > target && !queue.empty( ) ){
+    Collapse c = queue.top( );
+    queue.pop( );
+    if( removed[c.from] || removed[c.to] || version[c.from] != c.fromVersion || version[c.to] != c.toVersion ){
+      continue;
+    }
+    if( canCollapse(c.from, c.to) ){
+      collapse(c.from, c.to);
+    }
+  }
+}
+
+// The live vertex v was collapsed onto, through any number of collapses
+int Simplifier::representative( int v ){
+  int r = v;
+  while( collapsedTo[r] >= 0 ){
+    r = collapsedTo[r];
+  }
+  // shorten the path for the next lookup
+  while( collapsedTo[v] >= 0 && collapsedTo[v] != r ){
+    int next = collapsedTo[v];
+    collapsedTo[v] = r;
+    v = next;
+  }
+  return r;
+}
+
+// Squared distance from p to the triangle abc (Ericson, Real-Time
+// Collision Detection, 5.1.5)
+static double triangleDistance2( const double p[3], const double a[3], const double b[3], const double c[3] ){
+  double ab[3], ac[3], ap[3], bp[3], cp[3];
+  for( int j = 0; j < 3; j++ ){
+    ab[j] = b[j] - a[j];
+    ac[j] = c[j] - a[j];
+    ap[j] = p[j] - a[j];
+    bp[j] = p[j] - b[j];
+    cp[j] = p[j] - c[j];
+  }
+  double d1 = dot(ab, ap), d2 = dot(ac, ap);
+  double d3 = dot(ab, bp), d4 = dot(ac, bp);
+  double d5 = dot(ab, cp), d6 = dot(ac, cp);
+  double va = d3 * d6 - d5 * d4;
+  double vb = d5 * d2 - d1 * d6;
+  double vc = d1 * d4 - d3 * d2;
+  // the closest point as a + v ab + w ac
+  double v, w;
+  if( d1 <= 0.0 && d2 <= 0.0 ){
+    v = w = 0.0;
+  }else if( d3 >= 0.0 && d4 <= d3 ){
+    v = 1.0;
+    w = 0.0;
+  }else if( d6 >= 0.0 && d5 <= d6 ){
+    v = 0.0;
+    w = 1.0;
+  }else if( vc <= 0.0 && d1 >= 0.0 && d3 <= 0.0 ){
+    v = d1 / (d1 - d3);
+    w = 0.0;
+  }else if( vb <= 0.0 && d2 >= 0.0 && d6 <= 0.0 ){
+    v = 0.0;
+    w = d2 / (d2 - d6);
+  }else if( va <= 0.0 && d4 - d3 >= 0.0 && d5 - d6 >= 0.0 ){
+    w = (d4 - d3) / ((d4 - d3) + (d5 - d6));
+    v = 1.0 - w;
+  }else{
+    double denominator = va + vb + vc;
+    v = vb / denominator;
+    w = vc / denominator;
+  }
+  double d2sum = 0.0;
+  for( int j = 0; j < 3; j++ ){
+    double e = a[j] + v * ab[j] + w * ac[j] - p[j];
+    d2sum += e * e;
+  }
+  return d2sum;
+}
+
+/*
+ * Each removed vertex is measured against the faces within two edges
+ * of the vertex it ended up collapsed onto. Those are nearly always
+ * the nearest faces, and when not the distance only errs on the large
+ * side.
+ */
+double Simplifier::error( ){
+  double worst = 0.0;
+  std::vector<int> ring;
+  for( int v = 0; v < (int)removed.size( ); v++ ){
+    if( !removed[v] ){
+      continue;
+    }
+    int r = representative(v);
+    int s = markNeighbours(r, markFrom);
+    ring.assign(1, r);
+    for( size_t i = 0; i < vertexFaces[r].size( ); i++ ){
+      int f = vertexFaces[r][i];
+      for( int k = 0; faceAlive[f] && k < 3; k++ ){
+        int w = faces[3 * f + k];
+        if( markFrom[w] == s ){
+          // each neighbour once
+          markFrom[w] = 0;
+          ring.push_back(w);
+        }
+      }
+    }
+    double nearest = HUGE_VAL;
+    for( size_t j = 0; j < ring.size( ); j++ ){
+      for( size_t i = 0; i < vertexFaces[ring[j]].size( ); i++ ){
+        int f = vertexFaces[ring[j]][i];
+        if( faceAlive[f] ){
+          nearest = std::min(nearest, triangleDistance2(position(v), position(faces[3 * f]), position(faces[3 * f + 1]), position(faces[3 * f + 2])));
+        }
+      }
+    }
+    if( nearest == HUGE_VAL ){
+      nearest = 0.0;
+      for( int j = 0; j < 3; j++ ){
+        nearest += (position(v)[j] - position(r)[j]) * (position(v)[j] - position(r)[j]);
+      }
+    }
+    worst = std::max(worst, nearest);
+  }
+  return sqrt(worst);
+}
+
+int buildLods( FaceList* fl, int maxLevels, int minFaces ){
+  std::vector< std::vector<int> > levels;
+  std::vector<double> errors;
+  if( fl->fc > 0 ){
+    Simplifier s(fl);
+    int previous = fl->fc;
+    while( (int)levels.size( ) < maxLevels && previous / 2 >= minFaces ){
+      s.collapseTo(previous / 2);
+      // a level that saves little is not worth keeping, and means the
+      // mesh has run out of edges that can go
+      if( s.liveFaces > previous * 3 / 4 ){
+        break;
+      }
+      levels.push_back(std::vector<int>( ));
+      for( int f = 0; f < fl->fc; f++ ){
+        if( s.faceAlive[f] ){
+          levels.back( ).insert(levels.back( ).end( ), &s.faces[3 * f], &s.faces[3 * f] + 3);
+        }
+      }
+      // a coarser level is never counted as closer than a finer one
+      errors.push_back(std::max(s.error( ), errors.empty( ) ? 0.0 : errors.back( )));
+      previous = s.liveFaces;
+    }
+  }
+
+  int total = 0;
+  for( size_t i = 0; i < levels.size( ); i++ ){
+    total += (int)levels[i].size( ) / 3;
+  }
+  fl->allocLods((int)levels.size( ), total);
+  int first = 0;
+  for( size_t i = 0; i < levels.size( ); i++ ){
+    MeshLod &lod = fl->lods[i];
+    lod.firstFace = first;
+    lod.faceCount = (int)levels[i].size( ) / 3;
+    lod.error = (float)errors[i];
+    std::copy(levels[i].begin( ), levels[i].end( ), fl->lodFaces[first]);
+    optimizeVertexCache(fl->lodFaces + first, lod.faceCount, fl->vc);
+    first += lod.faceCount;
+  }
+  return fl->lodCount;
+}
+
+/*
+ * The error is measured each time the faces drop by another sixteenth
+ * and spread over the collapses in between, rising evenly from the
+ * measurement before.
+ */
+void collapseEdges( const FaceList* fl, int minFaces, std::vector<EdgeCollapse> &collapses ){
+  collapses.clear( );
+  if( fl->fc == 0 ){
+    return;
+  }
+  Simplifier s(fl);
+  double error = 0.0;
+  while( s.liveFaces > minFaces ){
+    size_t first = s.collapses.size( );
+    s.collapseTo(std::max(minFaces, s.liveFaces - std::max(1, s.liveFaces / 16)));
+    size_t count = s.collapses.size( ) - first;
+    if( count == 0 ){
+      break;
+    }
+    double measured = std::max(s.error( ), error);
+    for( size_t i = 0; i < count; i++ ){
+      s.collapses[first + i].error = (float)(error + (measured - error) * (i + 1) / count);
+    }
+    error = measured;
+  }
+  collapses.swap(s.collapses);
+}
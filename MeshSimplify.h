@@ -0,0 +1,54 @@
+/*
+ * MeshSimplify
+ *
+ * Levels of detail for a FaceList, made by collapsing edges in order of
+ * least quadric error (Garland and Heckbert 1997). Each collapse moves
+ * a vertex onto one of its neighbours, so a level is just a new set of
+ * faces over the FaceList's own vertices and drawing it needs nothing
+ * but its indices.
+ *
+ * Vertices on the border of an open mesh only move along the border,
+ * and planes standing on the border edges keep them near it, so holes
+ * and outlines survive simplification.
+ */
+
+#include <vector>
+
+#include "FaceList.h"
+
+#ifndef _MESHSIMPLIFY_H_
+#define _MESHSIMPLIFY_H_
+
+// Longest chain built, and the fewest faces worth a level of their own
+static const int lodMaxLevels = 6;
+static const int lodMinFaces = 64;
+
+/*
+ * Replace fl's levels of detail with a chain of coarser ones, each with
+ * about half the faces of the one before. The chain ends after
+ * maxLevels levels, before a level would have fewer than minFaces
+ * faces, or when no more edges can be collapsed. Each level's error is
+ * the farthest any vertex it dropped lies from its faces, and never
+ * less than the level before's. The faces of each level are ordered for
+ * the vertex cache. Returns the number of levels.
+ */
+int buildLods( FaceList* fl, int maxLevels = lodMaxLevels, int minFaces = lodMinFaces );
+
+// An edge collapse: vertex from is moved onto vertex to
+struct EdgeCollapse{
+  int from;
+  int to;
+  // how far the mesh is from the full one once this and every earlier
+  // collapse are made, in model units
+  float error;
+};
+
+/*
+ * The collapses buildLods would make, without stopping at levels: fl is
+ * simplified until no more than minFaces faces are left or no edge can
+ * be collapsed. fl itself is not changed. The errors never decrease
+ * along the list.
+ */
+void collapseEdges( const FaceList* fl, int minFaces, std::vector<EdgeCollapse> &collapses );
+
+#endif
@@ -0,0 +1,266 @@
+/*
+ * Meshlets
+ *
+ * Building and culling face clusters.
+ */
+
+#include "Meshlets.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+typedef FaceList::Real Real;
+
+/*
+ * Each meshlet starts at the first face not yet taken and grows one
+ * face at a time. The next face is the neighbour that adds the fewest
+ * new vertices, which keeps the cluster compact, and among those the
+ * one whose normal is closest to the cluster's, which keeps its cone
+ * narrow.
+ */
+static void growMeshlets( const FaceList* fl, int maxVertices, int maxFaces, std::vector<int> &meshletOf, int *count ){
+  const int vc = fl->vc;
+  const int fc = fl->fc;
+
+  // faces around each vertex, in compressed rows
+  std::vector<int> firstFace(vc + 1, 0);
+  for( int f = 0; f < fc; f++ ){
+    for( int k = 0; k < 3; k++ ){
+      firstFace[fl->faces[f][k] + 1]++;
+    }
+  }
+  for( int v = 0; v < vc; v++ ){
+    firstFace[v + 1] += firstFace[v];
+  }
+  std::vector<int> vertexFaces(3 * (size_t)fc);
+  {
+    std::vector<int> fill(firstFace.begin( ), firstFace.end( ) - 1);
+    for( int f = 0; f < fc; f++ ){
+      for( int k = 0; k < 3; k++ ){
+        vertexFaces[fill[fl->faces[f][k]]++] = f;
+      }
+    }
+  }
+
+  meshletOf.assign(fc, -1);
+  // the meshlet each vertex and each candidate face was last added to
+  std::vector<int> vertexIn(vc, -1);
+  std::vector<int> candidateIn(fc, -1);
+  std::vector<int> candidates;
+  int meshlet = 0;
+
+  for( int seed = 0; seed < fc; seed++ ){
+    if( meshletOf[seed] >= 0 ){
+      continue;
+    }
+    int vertices = 0;
+    int faces = 0;
+    double normal[3] = { 0.0, 0.0, 0.0 };
+    candidates.clear( );
+    int next = seed;
+    while( next >= 0 ){
+      meshletOf[next] = meshlet;
+      faces++;
+      for( int j = 0; j < 3; j++ ){
+        normal[j] += fl->f_normals[next][j];
+      }
+      for( int k = 0; k < 3; k++ ){
+        int v = fl->faces[next][k];
+        if( vertexIn[v] == meshlet ){
+          continue;
+        }
+        vertexIn[v] = meshlet;
+        vertices++;
+        for( int i = firstFace[v]; i < firstFace[v + 1]; i++ ){
+          int f = vertexFaces[i];
+          if( meshletOf[f] < 0 && candidateIn[f] != meshlet ){
+            candidateIn[f] = meshlet;
+            candidates.push_back(f);
+          }
+        }
+      }
+      if( faces == maxFaces ){
+        break;
+      }
+
+      next = -1;
+      int fewestNew = 4;
+      double bestAlignment = 0.0;
+      size_t kept = 0;
+      for( size_t i = 0; i < candidates.size( ); i++ ){
+        int f = candidates[i];
+        if( meshletOf[f] >= 0 ){
+          continue;
+        }
+        candidates[kept++] = f;
+        int added = 0;
+        for( int k = 0; k < 3; k++ ){
+          added += vertexIn[fl->faces[f][k]] != meshlet;
+        }
+        if( vertices + added > maxVertices || added > fewestNew ){
+          continue;
+        }
+        double alignment = normal[0] * fl->f_normals[f][0] + normal[1] * fl->f_normals[f][1] + normal[2] * fl->f_normals[f][2];
+        if( added < fewestNew || alignment > bestAlignment ){
+          fewestNew = added;
+          bestAlignment = alignment;
+          next = f;
+        }
+      }
+      candidates.resize(kept);
+    }
+    meshlet++;
+  }
+  *count = meshlet;
+}
+
+/*
+ * The sphere is centered on the cluster's box. The cone's axis is the
+ * average face normal; coneCutoff turns the widest angle from it to a
+ * face normal, a, into the sine test meshletVisible uses, since a
+ * cluster faces away when the eye is more than 90 degrees + a from
+ * every normal.
+ */
+static void meshletBounds( const FaceList* fl, Meshlet &m ){
+  double low[3], high[3];
+  for( int j = 0; j < 3; j++ ){
+    low[j] = high[j] = fl->vertices[fl->faces[m.firstFace][0]][j];
+  }
+  double axis[3] = { 0.0, 0.0, 0.0 };
+  for( int f = m.firstFace; f < m.firstFace + m.faceCount; f++ ){
+    for( int k = 0; k < 3; k++ ){
+      const Real *p = fl->vertices[fl->faces[f][k]];
+      for( int j = 0; j < 3; j++ ){
+        low[j] = std::min(low[j], (double)p[j]);
+        high[j] = std::max(high[j], (double)p[j]);
+      }
+    }
+    for( int j = 0; j < 3; j++ ){
+      axis[j] += fl->f_normals[f][j];
+    }
+  }
+
+  double center[3];
+  for( int j = 0; j < 3; j++ ){
+    center[j] = 0.5 * (low[j] + high[j]);
+  }
+  double radius2 = 0.0;
+  for( int f = m.firstFace; f < m.firstFace + m.faceCount; f++ ){
+    for( int k = 0; k < 3; k++ ){
+      const Real *p = fl->vertices[fl->faces[f][k]];
+      double d2 = 0.0;
+      for( int j = 0; j < 3; j++ ){
+        d2 += (p[j] - center[j]) * (p[j] - center[j]);
+      }
+      radius2 = std::max(radius2, d2);
+    }
+  }
+  for( int j = 0; j < 3; j++ ){
+    m.center[j] = (float)center[j];
+  }
+  // float rounding must not shrink the sphere
+  m.radius = (float)sqrt(radius2) * (1.0f + 1e-5f);
+
+  double length = sqrt(axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2]);
+  double minCos = length > 0.0 ? 1.0 : -1.0;
+  for( int f = m.firstFace; f < m.firstFace + m.faceCount && minCos > 0.0; f++ ){
+    const Real *n = fl->f_normals[f];
+    minCos = std::min(minCos, (axis[0] * n[0] + axis[1] * n[1] + axis[2] * n[2]) / length);
+  }
+  if( minCos <= 0.0 ){
+    m.coneAxis[0] = m.coneAxis[1] = m.coneAxis[2] = 0.0f;
+    m.coneCutoff = 1.0f;
+    return;
+  }
+  for( int j = 0; j < 3; j++ ){
+    m.coneAxis[j] = (float)(axis[j] / length);
+  }
+  m.coneCutoff = (float)sqrt(1.0 - minCos * minCos);
+}
+
+void buildMeshlets( FaceList* fl, int maxVertices, int maxFaces ){
+  if( fl->fc == 0 ){
+    fl->meshletCount = 0;
+    return;
+  }
+  std::vector<int> meshletOf;
+  int count;
+  growMeshlets(fl, maxVertices, maxFaces, meshletOf, &count);
+
+  // Gather each meshlet's faces, in their old order
+  std::vector<int> firstFace(count + 1, 0);
+  for( int f = 0; f < fl->fc; f++ ){
+    firstFace[meshletOf[f] + 1]++;
+  }
+  for( int i = 0; i < count; i++ ){
+    firstFace[i + 1] += firstFace[i];
+  }
+  std::vector<int> faces(fl->faces[0], fl->faces[0] + 3 * (size_t)fl->fc);
+  std::vector<Real> normals(fl->f_normals[0], fl->f_normals[0] + 3 * (size_t)fl->fc);
+  std::vector<int> fill(firstFace.begin( ), firstFace.end( ) - 1);
+  for( int f = 0; f < fl->fc; f++ ){
+    int to = fill[meshletOf[f]]++;
+    for( int j = 0; j < 3; j++ ){
+      fl->faces[to][j] = faces[3 * (size_t)f + j];
+      fl->f_normals[to][j] = normals[3 * (size_t)f + j];
+    }
+  }
+
+  fl->allocMeshlets(count);
+  for( int i = 0; i < count; i++ ){
+    Meshlet &m = fl->meshlets[i];
+    m.firstFace = firstFace[i];
+    m.faceCount = firstFace[i + 1] - firstFace[i];
+    meshletBounds(fl, m);
+  }
+}
+
+/*
+ * Planes from the rows of the matrix (Gribb and Hartmann), scaled to
+ * unit normals so they give distances.
+ */
+MeshletFrustum meshletFrustum( const Mat4& modelViewProjection, const Vec3& eye, bool backfaces ){
+  MeshletFrustum frustum;
+  const Mat4 &m = modelViewProjection;
+  for( int i = 0; i < 6; i++ ){
+    int row = i / 2;
+    double sign = i % 2 == 0 ? 1.0 : -1.0;
+    double length = 0.0;
+    for( int j = 0; j < 4; j++ ){
+      frustum.planes[i][j] = m(j, 3) + sign * m(j, row);
+      if( j < 3 ){
+        length += frustum.planes[i][j] * frustum.planes[i][j];
+      }
+    }
+    length = sqrt(length);
+    for( int j = 0; j < 4; j++ ){
+      frustum.planes[i][j] /= length;
+    }
+  }
+  for( int j = 0; j < 3; j++ ){
+    frustum.eye[j] = eye[j];
+  }
+  frustum.backfaces = backfaces;
+  return frustum;
+}
+
+bool meshletVisible( const Meshlet& m, const MeshletFrustum& frustum ){
+  for( int i = 0; i < 6; i++ ){
+    const double *p = frustum.planes[i];
+    if( p[0] * m.center[0] + p[1] * m.center[1] + p[2] * m.center[2] + p[3] < -m.radius ){
+      return false;
+    }
+  }
+  if( frustum.backfaces ){
+    double view[3];
+    for( int j = 0; j < 3; j++ ){
+      view[j] = m.center[j] - frustum.eye[j];
+    }
+    double distance = sqrt(view[0] * view[0] + view[1] * view[1] + view[2] * view[2]);
+    if( view[0] * m.coneAxis[0] + view[1] * m.coneAxis[1] + view[2] * m.coneAxis[2] >= m.coneCutoff * distance + m.radius ){
+      return false;
+    }
+  }
+  return true;
+}
@@ -0,0 +1,54 @@
+/*
+ * Meshlets
+ *
+ * Splitting a FaceList into small clusters of neighbouring faces, each
+ * with a bounding sphere and a cone around its face normals, so a mesh
+ * that is only partly on screen, or partly facing away, is drawn only
+ * in part. The faces of each cluster are made contiguous, so drawing
+ * the clusters that survive culling is one draw call per run of them.
+ *
+ * Backface culling by cones assumes closed meshes whose faces wind the
+ * same way; for any other mesh only the frustum test is safe.
+ */
+
+#include "FaceList.h"
+#include "GFXMath.h"
+
+#ifndef _MESHLETS_H_
+#define _MESHLETS_H_
+
+// Cluster limits; small enough to cull finely, large enough that a
+// cluster is worth a draw call
+static const int meshletMaxVertices = 64;
+static const int meshletMaxFaces = 128;
+
+/*
+ * Group fl's faces into meshlets of at most maxVertices distinct
+ * vertices and maxFaces faces, grown from face to neighbouring face.
+ * The faces are reordered so each meshlet is a contiguous range, with
+ * the faces of a meshlet in the order they had; optimizeVertexCache
+ * can then order each meshlet on its own.
+ */
+void buildMeshlets( FaceList* fl, int maxVertices = meshletMaxVertices, int maxFaces = meshletMaxFaces );
+
+/*
+ * What a meshlet is culled against, in the model space of its mesh:
+ * the six frustum planes, facing in, and where the eye is.
+ */
+struct MeshletFrustum{
+  double planes[6][4];
+  double eye[3];
+  bool backfaces;
+};
+
+/*
+ * The frustum of modelViewProjection, the full transform from model
+ * space to clip space, seen from eye in model space. With backfaces
+ * set meshlets facing away from the eye are culled as well.
+ */
+MeshletFrustum meshletFrustum( const Mat4& modelViewProjection, const Vec3& eye, bool backfaces );
+
+// False when no face of m can be seen through frustum
+bool meshletVisible( const Meshlet& m, const MeshletFrustum& frustum );
+
+#endif
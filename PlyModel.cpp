@@ -36,13 +36,25 @@
 
 
 #include "PlyModel.h"
+#include "PlyParse.h"
+#include "MappedFile.h"
+#include "ThreadPool.h"
+#include "MeshCache.h"
+#include "MeshOptimize.h"
+#include "ProgressiveMesh.h"
+#include "VertexPacking.h"
+#include "ConvexHull.h"
 #include "GFXMath.h"
 //#include "GFXExtra.h"
+#include <algorithm>
 #include <cassert>
 #include <iostream>
-#include <fstream>
-#include <cassert>
 #include <cstring>
+#include <string>
+#include <atomic>
+#include <mutex>
+#include <random>
+#include <vector>
 
 
 #ifndef SQR
@@ -51,18 +63,21 @@
 
 
 
-int vecPrint3d(FILE* f, double *v){
+template <typename A>
+int vecPrint3d(FILE* f, const A *v){
   return fprintf( f, "(%.16f, %.16f, %.16f)\n", v[0], v[1], v[2] );
 }
 
-void vecCopy3d(double *dest, double *src){
+template <typename C, typename A>
+void vecCopy3d(C *dest, const A *src){
   int i;
   for(i = 0; i < 3; i++){
     dest[i] = src[i];
   }
 }
 
-double vecSquaredLength3d(double *a){
+template <typename A>
+double vecSquaredLength3d(const A *a){
   double accumulate = 0.0;
   int i;
   for(i = 0; i < 3; i++){
@@ -72,11 +87,13 @@ double vecSquaredLength3d(double *a){
 }
 
 
-double vecLength3d(double *a){
+template <typename A>
+double vecLength3d(const A *a){
   return(sqrt( vecSquaredLength3d(a) ) );
 }
 
-void vecDifference3d(double *c, double *a, double *b){
+template <typename C, typename A, typename B>
+void vecDifference3d(C *c, const A *a, const B *b){
   int i;
   for(i = 0; i < 3; i++){
     c[i] = a[i] - b[i];
@@ -84,14 +101,16 @@ void vecDifference3d(double *c, double *a, double *b){
 }
 
 
-void vecCross3d(double *n, double *u, double *v){
+template <typename N, typename U, typename V>
+void vecCross3d(N *n, const U *u, const V *v){
   n[0] = u[1] * v[2] - u[2] * v[1];
   n[1] = u[2] * v[0] - u[0] * v[2];
   n[2] = u[0] * v[1] - u[1] * v[0]; 
 }
 
 
-void vecNormalize3d(double *vout, double* v){
+template <typename C, typename A>
+void vecNormalize3d(C *vout, const A* v){
   double length;
   length = vecLength3d(v);
    if( length <= 0.0 ){
@@ -109,7 +128,8 @@ void vecNormalize3d(double *vout, double* v){
   }
 }
 
-double vecDot3d(double *a, double *b){
+template <typename A, typename B>
+double vecDot3d(const A *a, const B *b){
   double accumulate = 0.0;
   int i;
   for(i = 0; i < 3; i++){
@@ -118,7 +138,8 @@ double vecDot3d(double *a, double *b){
   return( accumulate );
 }
 
-void vecCalcNormal3d(double *n, double *p, double *p1, double *p2){
+template <typename N, typename P>
+void vecCalcNormal3d(N *n, const P *p, const P *p1, const P *p2){
   double pa[3],pb[3];
 
   vecDifference3d(pa, p1, p);
@@ -128,20 +149,23 @@ void vecCalcNormal3d(double *n, double *p, double *p1, double *p2){
   vecNormalize3d(n, n);
 }
 
-double vecDistanceBetween3d(double *a, double *b ){
+template <typename A, typename B>
+double vecDistanceBetween3d(const A *a, const B *b ){
   double c[3];
   vecDifference3d(c, a, b);
   return( vecLength3d(c) ); 
 }
 
-double vecSquaredDistanceBetween3d(double *a, double *b ){
+template <typename A, typename B>
+double vecSquaredDistanceBetween3d(const A *a, const B *b ){
   double c[3];
   vecDifference3d(c, a, b);
   return( vecSquaredLength3d(c) ); 
 }
 
 
-void vecSum3d(double *c, double *a, double *b){
+template <typename C, typename A, typename B>
+void vecSum3d(C *c, const A *a, const B *b){
   int i;
   for(i = 0; i < 3; i++){
     c[i] = a[i] + b[i];
@@ -152,7 +176,8 @@ double r(){
   return double(rand( ))/double(RAND_MAX);
 }
 
-void midpoint(double *m, double *a, double *b){
+template <typename A>
+void midpoint(double *m, const A *a, const A *b){
   double s[3];
   vecSum3d(s, a, b);
   for(int i = 0; i < 3; i++ ){
@@ -160,7 +185,7 @@ void midpoint(double *m, double *a, double *b){
   }
 }
 
-void calcRitterBoundingSphere(double* center, double* radius, FaceList *fl){
+void calcRitterBoundingSphere(double* center, double* radius, const FaceList *fl){
   /*
   An Efficient Bounding Sphere
   by Jack Ritter
@@ -173,7 +198,7 @@ void calcRitterBoundingSphere(double* center, double* radius, FaceList *fl){
   double x_min, x_max, y_min, y_max, z_min, z_max;
   int px_min, px_max, py_min, py_max, pz_min, pz_max;
 
-  double *p;
+  const FaceList::Real *p;
   
   // Intialize
   // Select a point in the mesh as an arbitrary starting point.
@@ -267,179 +292,996 @@ void calcRitterBoundingSphere(double* center, double* radius, FaceList *fl){
   //printf("Grew the sphere %d times\n", count);
 }
 
-void calcBoundingSphere(double* center, double* radius, FaceList *fl){
-  double maxDistance = 0.0;
-  for( int i = 0; i < fl->vc-1; i++ ){
-    for(int j = i + 1; j < fl->vc; j++){
-      double *a = fl->vertices[i];
-      double *b = fl->vertices[j];
-      double distance = vecSquaredDistanceBetween3d(a, b);
-      if( distance > maxDistance){
-        midpoint(center, a, b);
-        *radius = sqrt(distance) * 0.5;
-        maxDistance = distance;
+// smallest sphere with a and b on its surface
+static void sphereThrough(double* center, double* radiusSq, const FaceList::Real* a, const FaceList::Real* b){
+  midpoint(center, a, b);
+  *radiusSq = vecSquaredDistanceBetween3d(a, b) * 0.25;
+}
+
+// smallest sphere with a, b and c on its surface; a line of three
+// points gets the sphere of the two farthest apart
+static void sphereThrough(double* center, double* radiusSq, const FaceList::Real* a, const FaceList::Real* b, const FaceList::Real* c){
+  double u[3], v[3], w[3];
+  vecDifference3d(u, a, c);
+  vecDifference3d(v, b, c);
+  vecCross3d(w, u, v);
+  double uu = vecSquaredLength3d(u);
+  double vv = vecSquaredLength3d(v);
+  double ww = vecSquaredLength3d(w);
+  if( ww <= 1e-12 * uu * vv ){
+    double ab = vecSquaredDistanceBetween3d(a, b);
+    if( ab >= uu && ab >= vv ){
+      sphereThrough(center, radiusSq, a, b);
+    }else if( uu >= vv ){
+      sphereThrough(center, radiusSq, a, c);
+    }else{
+      sphereThrough(center, radiusSq, b, c);
+    }
+    return;
+  }
+  double t[3], o[3];
+  for( int i = 0; i < 3; i++ ){
+    t[i] = uu * v[i] - vv * u[i];
+  }
+  vecCross3d(o, t, w);
+  for( int i = 0; i < 3; i++ ){
+    center[i] = c[i] + o[i] / (2.0 * ww);
+  }
+  *radiusSq = vecSquaredDistanceBetween3d(center, c);
+}
+
+// the sphere with a, b, c and d on its surface; false if they are
+// (nearly) in one plane and there is none
+static bool sphereThrough(double* center, double* radiusSq, const FaceList::Real* a, const FaceList::Real* b, const FaceList::Real* c, const FaceList::Real* d){
+  double u[3], v[3], w[3], vw[3], wu[3], uv[3];
+  vecDifference3d(u, a, d);
+  vecDifference3d(v, b, d);
+  vecDifference3d(w, c, d);
+  vecCross3d(vw, v, w);
+  vecCross3d(wu, w, u);
+  vecCross3d(uv, u, v);
+  double det = vecDot3d(u, vw);
+  double uu = vecSquaredLength3d(u);
+  double vv = vecSquaredLength3d(v);
+  double ww = vecSquaredLength3d(w);
+  if( SQR(det) <= 1e-12 * uu * vv * ww ){
+    return false;
+  }
+  for( int i = 0; i < 3; i++ ){
+    center[i] = d[i] + (uu * vw[i] + vv * wu[i] + ww * uv[i]) / (2.0 * det);
+  }
+  *radiusSq = vecSquaredDistanceBetween3d(center, d);
+  return true;
+}
+
+void calcMinimalBoundingSphere(double* center, double* radius, const FaceList *fl){
+  /*
+  Smallest Enclosing Disks (Balls and Ellipsoids)
+  by Emo Welzl
+  from "New Results and New Trends in Computer Science", LNCS 555, 1991
+  p. 359-370
+
+  The recursion is unrolled into one loop for each point that can be
+  on the surface, as in Gaertner's miniball. Points are taken in a
+  shuffled order, which is what makes the expected time linear; the
+  shuffle is seeded so every load gives the same sphere.
+  */
+
+  center[0] = center[1] = center[2] = 0.0;
+  *radius = 0.0;
+  if( fl->vc == 0 ){
+    return;
+  }
+  // the shuffled copy is read in order, which the loops below do often
+  std::vector<int> order(fl->vc);
+  for( int i = 0; i < fl->vc; i++ ){
+    order[i] = i;
+  }
+  std::shuffle(order.begin( ), order.end( ), std::minstd_rand(fl->vc));
+  std::vector<FaceList::Real> points(3 * (size_t)fl->vc);
+  for( int i = 0; i < fl->vc; i++ ){
+    vecCopy3d(&points[3 * (size_t)i], fl->vertices[order[i]]);
+  }
+
+  // a point counts as outside once it is past rounding error
+  const double slack = 1.0 + 1e-10;
+  double c[3], r2;
+  vecCopy3d(c, &points[0]);
+  r2 = 0.0;
+  for( int i = 1; i < fl->vc; i++ ){
+    const FaceList::Real *a = &points[3 * (size_t)i];
+    if( vecSquaredDistanceBetween3d(a, c) <= r2 * slack ){
+      continue;
+    }
+    // a is on the surface of the sphere of the first i + 1 points
+    vecCopy3d(c, a);
+    r2 = 0.0;
+    for( int j = 0; j < i; j++ ){
+      const FaceList::Real *b = &points[3 * (size_t)j];
+      if( vecSquaredDistanceBetween3d(b, c) <= r2 * slack ){
+        continue;
+      }
+      sphereThrough(c, &r2, a, b);
+      for( int k = 0; k < j; k++ ){
+        const FaceList::Real *p = &points[3 * (size_t)k];
+        if( vecSquaredDistanceBetween3d(p, c) <= r2 * slack ){
+          continue;
+        }
+        sphereThrough(c, &r2, a, b, p);
+        for( int l = 0; l < k; l++ ){
+          const FaceList::Real *q = &points[3 * (size_t)l];
+          double d2 = vecSquaredDistanceBetween3d(q, c);
+          if( d2 <= r2 * slack ){
+            continue;
+          }
+          if( !sphereThrough(c, &r2, a, b, p, q) ){
+            // only rounding puts a fourth point off a flat support
+            r2 = d2;
+          }
+        }
       }
     }
   }
+  // rounding must not leave any vertex outside
+  for( int i = 0; i < fl->vc; i++ ){
+    r2 = std::max(r2, vecSquaredDistanceBetween3d(fl->vertices[i], c));
+  }
+  *radius = sqrt(r2);
+  for( int j = 0; j < 3; j++ ){
+    center[j] = c[j];
+  }
 }
 
-FaceList* readPlyModel( const char* filename ){
-  char buffer[255], type[128], c;
-  std::ifstream inputfile;
-  unsigned int i;
-  int k;
-  unsigned int nv;
-  unsigned int nf;
-  FaceList *fl;
-  assert( filename );
-  inputfile.open( filename, std::ios::in );
-  if( inputfile.fail( ) ){
-    std::cerr << "File \"" << filename << "\" not found." << std::endl;
-    exit( 1 );
+void calcBoundingBox(double* min, double* max, const FaceList *fl){
+  for( int j = 0; j < 3; j++ ){
+    min[j] = fl->vc > 0 ? fl->vertices[0][j] : 0.0;
+    max[j] = min[j];
+  }
+  for( int i = 1; i < fl->vc; i++ ){
+    const FaceList::Real *p = fl->vertices[i];
+    for( int j = 0; j < 3; j++ ){
+      min[j] = std::min(min[j], (double)p[j]);
+      max[j] = std::max(max[j], (double)p[j]);
+    }
+  }
+}
+
+void calcBoundingSphere(double* center, double* radius, const FaceList *fl, BoundingSphereMethod method){
+  if( method == MINIMAL_SPHERE ){
+    calcMinimalBoundingSphere(center, radius, fl);
+  }else{
+    calcRitterBoundingSphere(center, radius, fl);
+  }
+}
+
+PlyType plyTypeFromName(const char *name){
+  if( strcmp(name, "char") == 0 || strcmp(name, "int8") == 0 ){
+    return PLY_INT8;
+  }else if( strcmp(name, "uchar") == 0 || strcmp(name, "uint8") == 0 ){
+    return PLY_UINT8;
+  }else if( strcmp(name, "short") == 0 || strcmp(name, "int16") == 0 ){
+    return PLY_INT16;
+  }else if( strcmp(name, "ushort") == 0 || strcmp(name, "uint16") == 0 ){
+    return PLY_UINT16;
+  }else if( strcmp(name, "int") == 0 || strcmp(name, "int32") == 0 ){
+    return PLY_INT32;
+  }else if( strcmp(name, "uint") == 0 || strcmp(name, "uint32") == 0 ){
+    return PLY_UINT32;
+  }else if( strcmp(name, "float") == 0 || strcmp(name, "float32") == 0 ){
+    return PLY_FLOAT32;
+  }else if( strcmp(name, "double") == 0 || strcmp(name, "float64") == 0 ){
+    return PLY_FLOAT64;
+  }
+  return PLY_INVALID;
+}
+
+PlyAttribute plyAttributeFromName(const char *name){
+  static const struct{
+    const char *name;
+    PlyAttribute attribute;
+  } names[] = {
+    { "x", PLY_X }, { "y", PLY_Y }, { "z", PLY_Z },
+    { "nx", PLY_NX }, { "ny", PLY_NY }, { "nz", PLY_NZ },
+    { "red", PLY_RED }, { "green", PLY_GREEN }, { "blue", PLY_BLUE },
+    { "diffuse_red", PLY_RED }, { "diffuse_green", PLY_GREEN }, { "diffuse_blue", PLY_BLUE },
+    { "u", PLY_U }, { "v", PLY_V }, { "s", PLY_U }, { "t", PLY_V },
+    { "texture_u", PLY_U }, { "texture_v", PLY_V }
+  };
+  for( size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++ ){
+    if( strcmp(name, names[i].name) == 0 ){
+      return names[i].attribute;
+    }
+  }
+  return PLY_OTHER;
+}
+
+/*
+ * Integer colors are stored as fractions of their type's largest value.
+ */
+static double plyColorScale(PlyType t){
+  switch( t ){
+  case PLY_INT8:
+    return 1.0 / 127.0;
+  case PLY_UINT8:
+    return 1.0 / 255.0;
+  case PLY_INT16:
+    return 1.0 / 32767.0;
+  case PLY_UINT16:
+    return 1.0 / 65535.0;
+  case PLY_INT32:
+    return 1.0 / 2147483647.0;
+  case PLY_UINT32:
+    return 1.0 / 4294967295.0;
+  default:
+    return 1.0;
+  }
+}
+
+/*
+ * Work out which attribute groups the vertex properties carry, how far
+ * into a record the used ones reach and whether they are in canonical
+ * order. Returns false when x, y or z is missing.
+ */
+static bool compileVertexSchema(PlyHeader *header){
+  static const struct{
+    unsigned int bit;
+    PlyAttribute first;
+    int size;
+  } groups[] = {
+    { PLY_NORMALS, PLY_NX, 3 },
+    { PLY_COLORS, PLY_RED, 3 },
+    { PLY_TEXCOORDS, PLY_U, 2 }
+  };
+  std::vector<PlyProperty> &properties = header->vertexProperties;
+  int present[PLY_OTHER + 1];
+  int k, g;
+  for( k = 0; k <= PLY_OTHER; k++ ){
+    present[k] = 0;
+  }
+  for( k = 0; k < (int)properties.size( ); k++ ){
+    present[properties[k].attribute]++;
+  }
+  if( !present[PLY_X] || !present[PLY_Y] || !present[PLY_Z] ){
+    return false;
+  }
+
+  // A group is used only when all of its properties are there
+  header->attributes = 0;
+  for( g = 0; g < 3; g++ ){
+    bool complete = true;
+    for( k = 0; k < groups[g].size; k++ ){
+      complete = complete && present[groups[g].first + k];
+    }
+    if( complete ){
+      header->attributes |= groups[g].bit;
+    }
+    for( k = 0; k < (int)properties.size( ); k++ ){
+      PlyAttribute a = properties[k].attribute;
+      if( a >= groups[g].first && a < groups[g].first + groups[g].size ){
+        if( !complete ){
+          properties[k].attribute = PLY_OTHER;
+        }else if( groups[g].bit == PLY_COLORS ){
+          properties[k].scale = plyColorScale(properties[k].type);
+        }
+      }
+    }
   }
+
+  // PlyAttribute lists the attributes in canonical order, so the used
+  // properties are canonical when they come first and keep that order
+  header->vertexFields = 0;
+  for( k = 0; k < (int)properties.size( ); k++ ){
+    if( properties[k].attribute != PLY_OTHER ){
+      header->vertexFields = k + 1;
+    }
+  }
+  header->canonical = true;
+  for( k = 0; k < header->vertexFields; k++ ){
+    if( properties[k].attribute == PLY_OTHER ||
+        (k > 0 && properties[k].attribute <= properties[k - 1].attribute) ){
+      header->canonical = false;
+    }
+  }
+  return true;
+}
+
+/*
+ * Copy the next header line into line, without its line ending, and
+ * advance first past it. Header lines are short and few, so unlike the
+ * body they are copied out.
+ */
+static bool plyNextHeaderLine(const char *&first, const char *last, std::string &line){
+  if( first >= last ){
+    return false;
+  }
+  const char *eol = plyLineEnd(first, last);
+  const char *end = eol;
+  // Tolerate files written with DOS line endings
+  if( end > first && end[-1] == '\r' ){
+    end--;
+  }
+  line.assign(first, end);
+  first = eol < last ? eol + 1 : last;
+  return true;
+}
+
+static bool startsWith(const std::string &line, const char *prefix){
+  return line.compare(0, strlen(prefix), prefix) == 0;
+}
+
+const char* parsePlyHeader( const char* first, const char* last, PlyHeader* header, const char* filename ){
+  std::string buffer;
+  char type[128], name[128], countTypeName[128], indexTypeName[128];
+  unsigned int i;
+  const char *p = first;
+
   // Parse the header
-  if(inputfile.getline(buffer, sizeof(buffer), '\n') != NULL){
-    if( strcmp(buffer, "ply") != 0){
-      std::cerr << "Error: Input file is not of .ply type." << std::endl;
+  if( plyNextHeaderLine(p, last, buffer) ){
+    if( buffer != "ply" ){
+      std::cerr << "Error: \"" << filename << "\" is not of .ply type." << std::endl;
       exit(1);
     }
   }else{
     std::cerr << "End of input?" << std::endl;
     exit( 1 );
   }
-  if(inputfile.getline(buffer, sizeof(buffer), '\n') != NULL){
-    if( strncmp(buffer, "format ascii", 12) != 0){
-      std::cerr << "Error: Input file is not in ASCII format." << std::endl;
+  if( plyNextHeaderLine(p, last, buffer) ){
+    if( startsWith(buffer, "format ascii") ){
+      header->format = PLY_ASCII;
+    }else if( startsWith(buffer, "format binary_little_endian") ){
+      header->format = PLY_BINARY_LITTLE_ENDIAN;
+    }else if( startsWith(buffer, "format binary_big_endian") ){
+      header->format = PLY_BINARY_BIG_ENDIAN;
+    }else{
+      std::cerr << "Error: Input file is not in a known PLY format." << std::endl;
       exit(1);
     }
   }else{
     std::cerr << "End of input?" << std::endl;
     exit( 1 );
   }
-  if(inputfile.getline(buffer, sizeof(buffer), '\n') != NULL){
-    while (strncmp(buffer, "comment", 7) == 0){
-      inputfile.getline(buffer, sizeof(buffer), '\n');
-  }
+  if( plyNextHeaderLine(p, last, buffer) ){
+    while( startsWith(buffer, "comment") || startsWith(buffer, "obj_info") ){
+      if( !plyNextHeaderLine(p, last, buffer) ){
+        std::cerr << "End of input?" << std::endl;
+        exit( 1 );
+      }
+    }
   }else{
     std::cerr << "End of input?" << std::endl;
     exit( 1 );
   }
 
-  if (strncmp(buffer, "element vertex", 14) == 0){
-    sscanf(buffer, "element vertex %u\n", &nv);
+  if( startsWith(buffer, "element vertex") ){
+    sscanf(buffer.c_str( ), "element vertex %u", &header->nv);
   }else{
     std::cerr << "Error: number of vertices expected." << std::endl;
     exit(1);
   }
 
-  i = 0;
-  inputfile.getline(buffer, sizeof(buffer), '\n');
-  while (strncmp(buffer, "property", 8) == 0) {
-    if (i < 3) {
-      sscanf(buffer, "property %s %c\n", type, &c);
-      switch (i) {
-      case 0:
-        if (c != 'x') {
-          std::cerr << "Error: first coordinate is not x." << std::endl;
+  header->vertexProperties.clear( );
+  header->vertexStride = 0;
+  if( !plyNextHeaderLine(p, last, buffer) ){
+    std::cerr << "End of input?" << std::endl;
+    exit( 1 );
+  }
+  while( startsWith(buffer, "property") ){
+    PlyProperty property;
+    if( startsWith(buffer, "property list") || sscanf(buffer.c_str( ), "property %127s %127s", type, name) != 2 ){
+      std::cerr << "Error: unsupported vertex property." << std::endl;
+      exit(1);
+    }
+    property.type = plyTypeFromName(type);
+    if( property.type == PLY_INVALID ){
+      std::cerr << "Error: unknown property type " << type << "." << std::endl;
+      exit(1);
+    }
+    property.attribute = plyAttributeFromName(name);
+    property.offset = header->vertexStride;
+    property.scale = 1.0;
+    // The first of a repeated property is the one used
+    for( i = 0; i < header->vertexProperties.size( ); i++ ){
+      if( header->vertexProperties[i].attribute == property.attribute ){
+        property.attribute = PLY_OTHER;
+      }
+    }
+    header->vertexStride += plyTypeSize(property.type);
+    header->vertexProperties.push_back(property);
+    if( !plyNextHeaderLine(p, last, buffer) ){
+      std::cerr << "End of input?" << std::endl;
+      exit( 1 );
+    }
+  }
+  if( !compileVertexSchema(header) ){
+    std::cerr << "Error: vertices need x, y and z properties." << std::endl;
+    exit(1);
+  }
+  
+  if( startsWith(buffer, "element face") ){
+    sscanf(buffer.c_str( ), "element face %u", &header->nf);
+  }else{
+    std::cerr << "Error: number of faces expected." << std::endl;
+    exit(1);
+  }
+
+  // The first list is the index list; scalars may come before or after it
+  bool haveList = false;
+  header->facePropertiesBefore = 0;
+  header->faceBytesBefore = 0;
+  header->faceBytesAfter = 0;
+  if( !plyNextHeaderLine(p, last, buffer) ){
+    std::cerr << "End of input?" << std::endl;
+    exit( 1 );
+  }
+  while( startsWith(buffer, "property") ){
+    if( startsWith(buffer, "property list") ){
+      if( haveList ){
+        // A second list would make the binary face size depend on it too.
+        // On an ASCII line it comes after the indices and is never read.
+        if( header->format != PLY_ASCII ){
+          std::cerr << "Error: unsupported face property in binary file." << std::endl;
           exit(1);
         }
-        break;
-      case 1:
-        if (c != 'y') {
-          std::cerr << "Error: first coordinate is not y." << std::endl;
+      }else{
+        if( sscanf(buffer.c_str( ), "property list %127s %127s", countTypeName, indexTypeName) != 2 ){
+          std::cerr << "Error: property list expected." << std::endl;
           exit(1);
         }
-        break;
-      case 2:
-        if (c != 'z') {
-          std::cerr << "Error: first coordinate is not z." << std::endl;
+        header->countType = plyTypeFromName(countTypeName);
+        header->indexType = plyTypeFromName(indexTypeName);
+        if( header->countType == PLY_INVALID || header->indexType == PLY_INVALID ||
+            header->countType == PLY_FLOAT32 || header->countType == PLY_FLOAT64 ||
+            header->indexType == PLY_FLOAT32 || header->indexType == PLY_FLOAT64 ){
+          std::cerr << "Error: face list must use integer types." << std::endl;
           exit(1);
         }
-        break;
-      default:
-        break;
+        haveList = true;
+      }
+    }else{
+      if( sscanf(buffer.c_str( ), "property %127s %127s", type, name) != 2 ){
+        std::cerr << "Error: unsupported face property." << std::endl;
+        exit(1);
+      }
+      PlyType t = plyTypeFromName(type);
+      if( t == PLY_INVALID ){
+        std::cerr << "Error: unknown property type " << type << "." << std::endl;
+        exit(1);
+      }
+      if( haveList ){
+        header->faceBytesAfter += plyTypeSize(t);
+      }else{
+        header->facePropertiesBefore++;
+        header->faceBytesBefore += plyTypeSize(t);
       }
-      i++;
     }
-    inputfile.getline(buffer, sizeof(buffer), '\n');
+    if( !plyNextHeaderLine(p, last, buffer) ){
+      std::cerr << "End of input?" << std::endl;
+      exit( 1 );
+    }
   }
-  
-  if (strncmp(buffer, "element face", 12) == 0)
-    sscanf(buffer, "element face %u\n", &nf);
-  else {
-    std::cerr << "Error: number of faces expected." << std::endl;
+  if( !haveList ){
+    std::cerr << "Error: property list expected." << std::endl;
     exit(1);
   }
 
-  inputfile.getline(buffer, sizeof(buffer), '\n');
-  if (strncmp(buffer, "property list", 13) != 0) {
-    std::cerr << "Error: property list expected." << std::endl;
+  // Elements after the faces are not read
+  while( !startsWith(buffer, "end_header") ){
+    if( !plyNextHeaderLine(p, last, buffer) ){
+      std::cerr << "End of input?" << std::endl;
+      exit( 1 );
+    }
+  }
+  return p;
+}
+
+static void malformedFace( ){
+  fprintf(stderr, "Error: malformed face.\n");
+  exit(1);
+}
+
+/*
+ * A FaceList for header's vertices and the given number of triangles,
+ * with room for whatever optional attributes the file carries.
+ */
+static FaceList* newPlyFaceList(const PlyHeader &header, long triangles, Arena *arena){
+  FaceList *fl;
+  if( !(fl = FaceList::create( header.nv, (int)triangles, (header.attributes & PLY_TEXCOORDS) != 0, arena)) ){
+    std::cerr << "Could not allocate a new face list for the model." << std::endl;
     exit(1);
   }
-  
-  inputfile.getline(buffer, sizeof(buffer), '\n');
-  while (strncmp(buffer, "end_header", 10) != 0){
-    inputfile.getline(buffer, sizeof(buffer), '\n');
+  return fl;
+}
+
+static inline PlyVertex<FaceList::Real> plyVertexOf(FaceList *fl, int i){
+  PlyVertex<FaceList::Real> v;
+  v.position = fl->vertices[i];
+  v.normal = fl->v_normals[i];
+  v.color = fl->colors[i];
+  v.texcoord = fl->texcoords ? fl->texcoords[i] : NULL;
+  return v;
+}
+
+/*
+ * Size of the next binary face record at p, which has n corners.
+ * Exits if the record runs past last.
+ */
+static size_t binaryFaceRecord(const char *p, const char *last, const PlyBinaryLayout &layout, int *n){
+  *n = -1;
+  if( (size_t)(last - p) >= plyBinaryFaceSize(layout, 0) ){
+    *n = plyBinaryFaceCorners(p, layout);
   }
-  
-  // Allocate FaceList object
-  if( !(fl = new FaceList( nv, nf)) ){
-    std::cerr << "Could not allocate a new face list for the model." << std::endl;
+  if( *n < 0 || (size_t)(last - p) < plyBinaryFaceSize(layout, *n) ){
+    std::cerr << "Error: unexpected end of face data." << std::endl;
     exit(1);
   }
+  return plyBinaryFaceSize(layout, *n);
+}
 
-  /* Process the body of the input file*/
+/*
+ * Read the vertex and face blocks of a binary PLY body in [p, last).
+ * Faces are assumed to be triangles until one is not; the triangles
+ * the remaining faces fan into are then counted and the face list
+ * grown to fit, so triangle meshes pay nothing for polygon support.
+ */
+static FaceList* readPlyBinaryBody(const char *p, const char *last, const PlyHeader &header, Arena *arena){
+  PlyBinaryLayout layout = plyBinaryLayout(header);
+  PlyBinaryVertexDecoder<FaceList::Real> decodeVertex = plyBinaryVertexDecoder<FaceList::Real>(header, layout.swap);
+  FaceList *fl = newPlyFaceList(header, header.nf, arena);
+  unsigned int i;
+
+  if( (size_t)(last - p) < (size_t)header.nv * layout.vertexStride ){
+    std::cerr << "Error: unexpected end of vertex data." << std::endl;
+    exit(1);
+  }
+  for( i = 0; i < header.nv; i++, p += layout.vertexStride ){
+    PlyVertex<FaceList::Real> v = plyVertexOf(fl, i);
+    decodeVertex(p, header, layout.swap, v);
+  }
+
+  std::vector<int> corners(3);
+  bool resized = false;
+  int t = 0;
+  for( i = 0; i < header.nf; i++ ){
+    int n;
+    size_t size = binaryFaceRecord(p, last, layout, &n);
+    if( n == 3 ){
+      if( !plyDecodeBinaryFace(p, layout, n, fl->faces[t++]) ){
+        malformedFace( );
+      }
+    }else{
+      if( !resized ){
+        long triangles = t;
+        const char *q = p;
+        for( unsigned int j = i; j < header.nf; j++ ){
+          int m;
+          q += binaryFaceRecord(q, last, layout, &m);
+          triangles += plyFanTriangles(m);
+        }
+        fl->resizeFaces(triangles);
+        resized = true;
+      }
+      if( (int)corners.size( ) < n ){
+        corners.resize(n);
+      }
+      if( !plyDecodeBinaryFace(p, layout, n, corners.data( )) ){
+        malformedFace( );
+      }
+      for( int k = 0; k < plyFanTriangles(n); k++ ){
+        plyFanTriangle(corners.data( ), k, fl->faces[t++]);
+      }
+    }
+    p += size;
+  }
+  return fl;
+}
+
+/*
+ * Tokenize an ASCII PLY body in [p, last) in place. Each vertex and
+ * face occupies one line; anything past the values that are needed on
+ * a line is skipped. As with binary bodies, faces are taken to be
+ * triangles until the first one that is not.
+ */
+static FaceList* readPlyAsciiBody(const char *p, const char *last, const PlyHeader &header, Arena *arena){
+  PlyAsciiVertexParser<FaceList::Real> parseVertex = plyAsciiVertexParser<FaceList::Real>(header);
+  FaceList *fl = newPlyFaceList(header, header.nf, arena);
+  unsigned int i;
 
   // read vertex data from PLY file
-  for (i = 0; i < nv; i++) {
-    inputfile.getline(buffer, sizeof(buffer), '\n');
-    sscanf(buffer,"%lf %lf %lf", &(fl->vertices[i][0]), &(fl->vertices[i][1]), &(fl->vertices[i][2]));
+  for( i = 0; i < header.nv && p < last; i++ ){
+    const char *eol = plyLineEnd(p, last);
+    PlyVertex<FaceList::Real> v = plyVertexOf(fl, i);
+    parseVertex(p, eol, header, v);
+    p = eol < last ? eol + 1 : last;
   }
 
   // read face data from PLY file
-  for (i = 0; i < nf; i++) {
-    inputfile.getline(buffer, sizeof(buffer), '\n');
-    sscanf(buffer, "%d %d %d %d", &k, &(fl->faces[i][0]), &(fl->faces[i][1]), &(fl->faces[i][2]) );
-    if (k != 3) {
-      fprintf(stderr, "Error: not a triangular face.\n");
-      exit(1);
+  std::vector<int> corners(3);
+  bool resized = false;
+  int t = 0;
+  for( i = 0; i < header.nf; i++ ){
+    const char *eol = plyLineEnd(p, last);
+    int n = plyParseFaceLine(p, eol, header, corners);
+    if( n < 0 ){
+      malformedFace( );
     }
+    if( n != 3 && !resized ){
+      long triangles = t;
+      const char *q = p;
+      for( unsigned int j = i; j < header.nf; j++ ){
+        const char *end = plyLineEnd(q, last);
+        int m;
+        if( q >= last || !plyParseFaceCount(q, end, header, &m) ){
+          malformedFace( );
+        }
+        triangles += plyFanTriangles(m);
+        q = end + 1;
+      }
+      fl->resizeFaces(triangles);
+      resized = true;
+    }
+    for( int k = 0; k < plyFanTriangles(n); k++ ){
+      plyFanTriangle(corners.data( ), k, fl->faces[t++]);
+    }
+    p = eol < last ? eol + 1 : last;
   }
+  return fl;
+}
 
-  inputfile.close( );
-  
-  calcRitterBoundingSphere(fl->center, &(fl->radius), fl);
+/*
+ * Bodies smaller than this are not worth splitting across threads.
+ */
+static const size_t parallelParseMinBytes = 1 << 20;
 
-  for( i = 0; i < nv; i++){
-    vecDifference3d(fl->vertices[i], fl->vertices[i], fl->center);
+static ThreadPool* plyPool( ){
+  static ThreadPool *pool = NULL;
+  static std::mutex poolMutex;
+  std::lock_guard<std::mutex> lock(poolMutex);
+  int threads = plyLoadOptions( ).threads;
+  if( threads < 1 ){
+    threads = ThreadPool::hardwareThreads( );
+  }
+  if( !pool || pool->size( ) != threads ){
+    delete pool;
+    pool = new ThreadPool(threads);
   }
+  return pool;
+}
 
-  // compute face normals
-  for( i = 0; i < nf; i++){
-    vecCalcNormal3d(fl->f_normals[i],
-      fl->vertices[fl->faces[i][0]],
-      fl->vertices[fl->faces[i][1]],
-      fl->vertices[fl->faces[i][2]]);
+/*
+ * Parse an ASCII body on the thread pool. The body is cut into chunks
+ * that each start at the beginning of a line. A first parallel pass
+ * counts the lines in every chunk and a second the triangles its face
+ * lines fan into; running totals of those counts tell each chunk the
+ * index of its first line and first triangle, so the final parallel
+ * pass knows exactly which slot every line fills. The result does not
+ * depend on the number of threads or chunks.
+ */
+static FaceList* readPlyAsciiBodyParallel(const char *first, const char *last, const PlyHeader &header, ThreadPool *pool, Arena *arena){
+  PlyAsciiVertexParser<FaceList::Real> parseVertex = plyAsciiVertexParser<FaceList::Real>(header);
+  const long nv = header.nv;
+  const long lineCount = nv + header.nf;
+  int chunkCount = pool->size( ) * 4;
+  std::vector<const char*> chunkStart(chunkCount + 1);
+  std::vector<long> chunkLines(chunkCount + 1, 0);
+  std::vector<long> chunkTriangles(chunkCount + 1, 0);
+  size_t chunkBytes = (last - first) / chunkCount + 1;
+  int i;
 
-    for(int j = 0; j < 3; j++){
-      vecSum3d(fl->v_normals[fl->faces[i][j]],
-        fl->v_normals[fl->faces[i][j]], fl->f_normals[i] );
+  chunkStart[0] = first;
+  for( i = 1; i < chunkCount; i++ ){
+    const char *p = chunkStart[i - 1] + chunkBytes;
+    if( p >= last ){
+      chunkStart[i] = last;
+    }else{
+      const char *eol = plyLineEnd(p, last);
+      chunkStart[i] = eol < last ? eol + 1 : last;
     }
   }
+  chunkStart[chunkCount] = last;
 
-  // normalize the v_normals
-  for( i = 0; i < nv; i++ ){
-    for(int j = 0; j < 3; j++){
-      // set some colors
-      fl->colors[i][j] = r( );
-      // Scale the vertices
-      fl->vertices[i][j] /= fl->radius;
+  pool->parallelFor(chunkCount, [&](int c){
+    long lines = 0;
+    const char *p = chunkStart[c];
+    const char *end = chunkStart[c + 1];
+    while( p < end ){
+      p = plyLineEnd(p, end) + 1;
+      lines++;
     }
-    vecNormalize3d(fl->v_normals[i], fl->v_normals[i]);
+    chunkLines[c + 1] = lines;
+  });
+  for( i = 1; i <= chunkCount; i++ ){
+    chunkLines[i] += chunkLines[i - 1];
+  }
+  if( chunkLines[chunkCount] < lineCount ){
+    malformedFace( );
+  }
+
+  std::atomic<bool> badFace(false);
+  pool->parallelFor(chunkCount, [&](int c){
+    long line = chunkLines[c];
+    long triangles = 0;
+    const char *p = chunkStart[c];
+    const char *end = chunkStart[c + 1];
+    for( ; p < end && line < lineCount; line++ ){
+      const char *eol = plyLineEnd(p, end);
+      int n;
+      if( line >= nv ){
+        if( plyParseFaceCount(p, eol, header, &n) ){
+          triangles += plyFanTriangles(n);
+        }else{
+          badFace = true;
+        }
+      }
+      p = eol + 1;
+    }
+    chunkTriangles[c + 1] = triangles;
+  });
+  if( badFace ){
+    malformedFace( );
+  }
+  for( i = 1; i <= chunkCount; i++ ){
+    chunkTriangles[i] += chunkTriangles[i - 1];
+  }
+
+  FaceList *fl = newPlyFaceList(header, chunkTriangles[chunkCount], arena);
+  pool->parallelFor(chunkCount, [&](int c){
+    std::vector<int> corners(3);
+    long line = chunkLines[c];
+    long t = chunkTriangles[c];
+    const char *p = chunkStart[c];
+    const char *end = chunkStart[c + 1];
+    for( ; p < end && line < lineCount; line++ ){
+      const char *eol = plyLineEnd(p, end);
+      if( line < nv ){
+        PlyVertex<FaceList::Real> v = plyVertexOf(fl, line);
+        parseVertex(p, eol, header, v);
+      }else{
+        int n = plyParseFaceLine(p, eol, header, corners);
+        if( n < 0 ){
+          badFace = true;
+          n = 0;
+        }
+        for( int k = 0; k < plyFanTriangles(n); k++ ){
+          plyFanTriangle(corners.data( ), k, fl->faces[t++]);
+        }
+      }
+      p = eol + 1;
+    }
+  });
+  if( badFace ){
+    malformedFace( );
+  }
+  return fl;
+}
+
+/*
+ * Meshes with fewer vertices than this are processed on the calling
+ * thread.
+ */
+static const int parallelProcessMinVertices = 1 << 16;
+
+/*
+ * Call fn(first, last) on blocks covering [0, count), spread over pool
+ * when there is one.
+ */
+template <typename Fn>
+static void forBlocks(ThreadPool *pool, int count, Fn fn){
+  if( !pool ){
+    fn(0, count);
+    return;
+  }
+  int blocks = pool->size( ) * 4;
+  int blockSize = (count + blocks - 1) / blocks;
+  pool->parallelFor(blocks, [&](int b){
+    int first = b * blockSize;
+    int last = std::min(count, first + blockSize);
+    if( first < last ){
+      fn(first, last);
+    }
+  });
+}
+
+/*
+ * Center the mesh on its bounding sphere, scale it to unit radius and
+ * fill in its normals and colors, in as few passes as possible:
+ *
+ *   1. the bounding sphere (Ritter's two passes over the vertices)
+ *   2. face normals, in parallel over faces, from re-centered corners
+ *   3. re-centering, scaling and vertex normals in one parallel pass
+ *      over vertices
+ *
+ * On one thread each face adds its normal into its corners as it goes.
+ * In parallel that scatter would race, so instead every vertex gathers
+ * the normals of the faces around it through a vertex to face index
+ * (compressed rows, faces in ascending order). Both add the same terms
+ * in the same order, so the result does not depend on the number of
+ * threads.
+ *
+ * The sphere of the processed mesh is the first sphere moved and scaled
+ * the same way, i.e. the unit sphere at the origin, so it is not
+ * measured a second time. Normals and colors read from the file are
+ * kept.
+ */
+static void processPlyMesh(FaceList *fl, unsigned int attributes){
+  const bool fileNormals = (attributes & PLY_NORMALS) != 0;
+  const bool fileColors = (attributes & PLY_COLORS) != 0;
+  ThreadPool *pool = plyLoadOptions( ).threads != 1 && fl->vc >= parallelProcessMinVertices ? plyPool( ) : NULL;
+  if( pool && pool->size( ) < 2 ){
+    pool = NULL;
   }
+  int i;
 
   calcRitterBoundingSphere(fl->center, &(fl->radius), fl);
+  double center[3] = { fl->center[0], fl->center[1], fl->center[2] };
+  double radius = fl->radius;
 
-  return( fl );
+  // Gather rather than scatter when running in parallel
+  const bool gather = pool && !fileNormals;
+
+  // compute face normals
+  forBlocks(pool, fl->fc, [&](int first, int last){
+    for( int f = first; f < last; f++ ){
+      double corner[3][3];
+      for( int k = 0; k < 3; k++ ){
+        vecDifference3d(corner[k], fl->vertices[fl->faces[f][k]], center);
+      }
+      vecCalcNormal3d(fl->f_normals[f], corner[0], corner[1], corner[2]);
+      if( !fileNormals && !gather ){
+        for( int k = 0; k < 3; k++ ){
+          vecSum3d(fl->v_normals[fl->faces[f][k]],
+            fl->v_normals[fl->faces[f][k]], fl->f_normals[f] );
+        }
+      }
+    }
+  });
+
+  // faces around each vertex
+  std::vector<int> firstFace;
+  std::vector<int> vertexFaces;
+  if( gather ){
+    firstFace.assign(fl->vc + 1, 0);
+    for( i = 0; i < fl->fc; i++ ){
+      for( int k = 0; k < 3; k++ ){
+        firstFace[fl->faces[i][k] + 1]++;
+      }
+    }
+    for( i = 0; i < fl->vc; i++ ){
+      firstFace[i + 1] += firstFace[i];
+    }
+    std::vector<int> fill(firstFace.begin( ), firstFace.end( ) - 1);
+    vertexFaces.resize(3 * (size_t)fl->fc);
+    for( i = 0; i < fl->fc; i++ ){
+      for( int k = 0; k < 3; k++ ){
+        vertexFaces[fill[fl->faces[i][k]]++] = i;
+      }
+    }
+  }
+
+  forBlocks(pool, fl->vc, [&](int first, int last){
+    for( int v = first; v < last; v++ ){
+      FaceList::Real *p = fl->vertices[v];
+      vecDifference3d(p, p, center);
+      for( int j = 0; j < 3; j++ ){
+        p[j] /= radius;
+      }
+      FaceList::Real *n = fl->v_normals[v];
+      if( gather ){
+        for( int k = firstFace[v]; k < firstFace[v + 1]; k++ ){
+          vecSum3d(n, n, fl->f_normals[vertexFaces[k]]);
+        }
+      }
+      vecNormalize3d(n, n);
+    }
+  });
+
+  // rand( ) is not to be shared between threads
+  if( !fileColors ){
+    for( i = 0; i < fl->vc; i++ ){
+      for( int j = 0; j < 3; j++ ){
+        fl->colors[i][j] = r( );
+      }
+    }
+  }
+
+  for( int j = 0; j < 3; j++ ){
+    fl->center[j] = 0.0;
+  }
+  fl->radius = 1.0;
+  // unlike the sphere, the box does not follow from the one before
+  calcBoundingBox(fl->boxMin, fl->boxMax, fl);
+}
+
+PlyLoadOptions& plyLoadOptions( ){
+  static PlyLoadOptions options = { 0, true, true, true, hullMaxPlanes };
+  return options;
 }
 
+// An optimized mesh, or one with a hull of another size, is a different
+// bake of the same file
+static uint64_t cacheKey( const char* data, size_t size ){
+  uint64_t key = hashBytes(data, size);
+  if( plyLoadOptions( ).optimize ){
+    key ^= 0x9e3779b97f4a7c15ull;
+  }
+  key ^= (uint64_t)plyLoadOptions( ).hullPlanes * 0xc2b2ae3d27d4eb4full;
+  return key;
+}
+
+bool plyCacheKey( const char* filename, uint64_t* key ){
+  MappedFile inputfile;
+  if( !inputfile.open( filename ) ){
+    return false;
+  }
+  *key = cacheKey(inputfile.data( ), inputfile.size( ));
+  return true;
+}
+
+FaceList* readPlyModel( const char* filename, Arena* arena ){
+  MappedFile inputfile;
+  PlyHeader header;
+  FaceList *fl;
+  assert( filename );
+  if( !inputfile.open( filename ) ){
+    std::cerr << "File \"" << filename << "\" not found." << std::endl;
+    exit( 1 );
+  }
+  const char *last = inputfile.data( ) + inputfile.size( );
+
+  // A baked copy built from this exact file skips parsing entirely
+  uint64_t sourceHash = 0;
+  std::string bakedPath;
+  if( plyLoadOptions( ).useCache ){
+    sourceHash = cacheKey(inputfile.data( ), inputfile.size( ));
+    bakedPath = bakedMeshPath(filename);
+    if( (fl = readBakedMesh(bakedPath.c_str( ), sourceHash, arena)) ){
+      if( plyLoadOptions( ).pack ){
+        packVertices(fl);
+      }
+      return( fl );
+    }
+  }
+
+  const char *body = parsePlyHeader(inputfile.data( ), last, &header, filename);
+
+  /* Process the body of the input file*/
+
+  if( header.format != PLY_ASCII ){
+    fl = readPlyBinaryBody(body, last, header, arena);
+  }else{
+    ThreadPool *pool = plyLoadOptions( ).threads != 1 && (size_t)(last - body) >= parallelParseMinBytes ? plyPool( ) : NULL;
+    if( pool && pool->size( ) > 1 ){
+      fl = readPlyAsciiBodyParallel(body, last, header, pool, arena);
+    }else{
+      fl = readPlyAsciiBody(body, last, header, arena);
+    }
+  }
+
+  inputfile.close( );
+
+  processPlyMesh(fl, header.attributes);
+  if( plyLoadOptions( ).optimize ){
+    optimizeMesh(fl);
+    // Ritter's sphere depends on the order of the vertices, which has
+    // changed; the one kept is the sphere a fresh pass would find
+    calcRitterBoundingSphere(fl->center, &(fl->radius), fl);
+  }
+  if( plyLoadOptions( ).hullPlanes > 0 ){
+    buildHull(fl, plyLoadOptions( ).hullPlanes);
+  }
+
+  // Failing to write the cache (e.g. a read-only data directory) only
+  // costs the next load a parse.
+  if( plyLoadOptions( ).useCache ){
+    writeBakedMesh(bakedPath.c_str( ), sourceHash, fl);
+    if( plyLoadOptions( ).optimize ){
+      ProgressiveMesh *pm = buildProgressiveMesh(fl);
+      writeProgressiveMesh(progressiveMeshPath(filename).c_str( ), sourceHash, pm);
+      delete pm;
+    }
+  }
+  if( plyLoadOptions( ).pack ){
+    packVertices(fl);
+  }
+
+  return( fl );
+}
@@ -38,9 +38,63 @@
 #ifndef _PLYMODEL_H_
 #define _PLYMODEL_H_
 
+#include <stdint.h>
+
 #include "FaceList.h"
 
-FaceList* readPlyModel( const char* filename );
-void calcRitterBoundingSphere(double* center, double* radius, FaceList *fl);
+/*
+ * Settings that control how readPlyModel loads a file. Change them
+ * through plyLoadOptions( ) before loading.
+ */
+struct PlyLoadOptions{
+  // Worker threads used to parse large ASCII bodies. 0 uses one per
+  // hardware thread and 1 parses on the calling thread.
+  int threads;
+  // Keep a baked copy of each processed model beside its PLY file
+  // (see MeshCache.h) and load from it while the PLY file is unchanged.
+  // Optimized models also get their progressive mesh written beside
+  // it (see ProgressiveMesh.h).
+  bool useCache;
+  // Weld the vertices, split the faces into meshlets that are culled
+  // on their own and reorder the faces and vertices for the GPU's
+  // vertex caches (see MeshOptimize.h and Meshlets.h)
+  bool optimize;
+  // Give each model a packed copy of its vertices and faces to draw
+  // from (see VertexPacking.h); it is made on every load, never baked
+  bool pack;
+  // Give each model a convex hull of at most this many planes (see
+  // ConvexHull.h), baked with it; 0 for none
+  int hullPlanes;
+};
+
+PlyLoadOptions& plyLoadOptions( );
+
+/*
+ * Load and process filename. With an arena the FaceList and all of its
+ * data are placed in it; otherwise free it with FaceList::release( ).
+ */
+FaceList* readPlyModel( const char* filename, Arena* arena = NULL );
+
+/*
+ * The hash readPlyModel files the baked copy of filename under with the
+ * current options; other files derived from the same load, such as its
+ * progressive mesh, are keyed by it too. Returns false if filename
+ * cannot be read.
+ */
+bool plyCacheKey( const char* filename, uint64_t* key );
+
+// How the bounding sphere of a mesh is found
+enum BoundingSphereMethod{
+  // Ritter's two passes: fast, but up to about a fifth too large
+  RITTER_SPHERE,
+  // the smallest sphere there is (Welzl), in expected linear time
+  MINIMAL_SPHERE
+};
+
+void calcRitterBoundingSphere(double* center, double* radius, const FaceList *fl);
+void calcMinimalBoundingSphere(double* center, double* radius, const FaceList *fl);
+void calcBoundingSphere(double* center, double* radius, const FaceList *fl, BoundingSphereMethod method);
+// The smallest axis aligned box around fl's vertices
+void calcBoundingBox(double* min, double* max, const FaceList *fl);
 
 #endif
@@ -0,0 +1,716 @@
+/*
+ * PlyParse
+ *
+ * Pieces shared by the PLY readers: the scalar types a header may name,
+ * the parsed header itself, and allocation-free number tokenizers that
+ * work directly on a [first, last) character range in the manner of
+ * std::from_chars. None of the tokenizers require the input to be NUL
+ * terminated.
+ *
+ * The header's vertex properties form a schema that picks a decoder
+ * once per file. The common layouts (xyz, xyz + normal, xyz + rgb and
+ * xyz + normal + uv, in that order) get decoders instantiated for them
+ * at compile time; anything else is routed property by property.
+ */
+
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#ifndef _PLYPARSE_H_
+#define _PLYPARSE_H_
+
+/*
+ * Scalar types that may appear in a PLY header. Both the old style
+ * names (uchar, int, float) and the sized names (uint8, int32, float32)
+ * are accepted.
+ */
+enum PlyType{
+  PLY_INVALID = 0,
+  PLY_INT8,
+  PLY_UINT8,
+  PLY_INT16,
+  PLY_UINT16,
+  PLY_INT32,
+  PLY_UINT32,
+  PLY_FLOAT32,
+  PLY_FLOAT64
+};
+
+enum PlyFormat{
+  PLY_ASCII,
+  PLY_BINARY_LITTLE_ENDIAN,
+  PLY_BINARY_BIG_ENDIAN
+};
+
+/*
+ * Vertex properties the readers have a use for. Any other vertex
+ * property is read past and dropped.
+ */
+enum PlyAttribute{
+  PLY_X,
+  PLY_Y,
+  PLY_Z,
+  PLY_NX,
+  PLY_NY,
+  PLY_NZ,
+  PLY_RED,
+  PLY_GREEN,
+  PLY_BLUE,
+  PLY_U,
+  PLY_V,
+  PLY_OTHER
+};
+
+/*
+ * Optional groups of vertex attributes, as a bit set. Positions are
+ * always present. A group counts only when all of its properties do.
+ */
+enum{
+  PLY_NORMALS = 1,
+  PLY_COLORS = 2,
+  PLY_TEXCOORDS = 4
+};
+
+struct PlyProperty{
+  PlyType type;
+  PlyAttribute attribute;
+  // byte offset in a binary vertex record
+  int offset;
+  // multiplies the value read; maps integer colors onto [0, 1]
+  double scale;
+};
+
+struct PlyHeader{
+  PlyFormat format;
+  // number of vertices and faces
+  unsigned int nv;
+  unsigned int nf;
+  // every vertex property in file order
+  std::vector<PlyProperty> vertexProperties;
+  // properties up to and including the last one that is used
+  int vertexFields;
+  // size of a binary vertex record
+  int vertexStride;
+  // optional groups the vertices carry
+  unsigned int attributes;
+  // the used properties come first, in the order x y z, nx ny nz,
+  // red green blue, u v, so a fixed layout decoder can read them
+  bool canonical;
+  // types of the face's vertex_indices list
+  PlyType countType;
+  PlyType indexType;
+  // scalar face properties before the list, and the bytes they and
+  // any after the list take in a binary face record
+  int facePropertiesBefore;
+  int faceBytesBefore;
+  int faceBytesAfter;
+};
+
+/*
+ * Parse the header found at the start of [first, last). Exits with a
+ * message naming filename if it is not a header this reader supports.
+ * Returns a pointer to the first byte of the body.
+ */
+const char* parsePlyHeader( const char* first, const char* last, PlyHeader* header, const char* filename );
+
+PlyType plyTypeFromName( const char* name );
+PlyAttribute plyAttributeFromName( const char* name );
+
+static inline int plyTypeSize(PlyType t){
+  switch( t ){
+  case PLY_INT8:
+  case PLY_UINT8:
+    return 1;
+  case PLY_INT16:
+  case PLY_UINT16:
+    return 2;
+  case PLY_INT32:
+  case PLY_UINT32:
+  case PLY_FLOAT32:
+    return 4;
+  case PLY_FLOAT64:
+    return 8;
+  default:
+    return 0;
+  }
+}
+
+static inline bool hostIsLittleEndian( ){
+  const unsigned short one = 1;
+  return *((const unsigned char*)&one) == 1;
+}
+
+/*
+ * Copy n bytes from src to dest, reversing their order when swap is set.
+ */
+static inline void plyCopyBytes(void *dest, const char *src, int n, bool swap){
+  if( swap ){
+    char *d = (char*)dest;
+    for( int i = 0; i < n; i++ ){
+      d[i] = src[n - 1 - i];
+    }
+  }else{
+    memcpy(dest, src, n);
+  }
+}
+
+/*
+ * Decode a single binary scalar of type t at p as a double.
+ */
+static inline double plyBinaryScalar(const char *p, PlyType t, bool swap){
+  switch( t ){
+  case PLY_INT8:{
+    int8_t v; plyCopyBytes(&v, p, 1, swap); return v;
+  }
+  case PLY_UINT8:{
+    uint8_t v; plyCopyBytes(&v, p, 1, swap); return v;
+  }
+  case PLY_INT16:{
+    int16_t v; plyCopyBytes(&v, p, 2, swap); return v;
+  }
+  case PLY_UINT16:{
+    uint16_t v; plyCopyBytes(&v, p, 2, swap); return v;
+  }
+  case PLY_INT32:{
+    int32_t v; plyCopyBytes(&v, p, 4, swap); return v;
+  }
+  case PLY_UINT32:{
+    uint32_t v; plyCopyBytes(&v, p, 4, swap); return v;
+  }
+  case PLY_FLOAT32:{
+    float v; plyCopyBytes(&v, p, 4, swap); return v;
+  }
+  case PLY_FLOAT64:{
+    double v; plyCopyBytes(&v, p, 8, swap); return v;
+  }
+  default:
+    return 0.0;
+  }
+}
+
+static inline bool plyIsDigit(char c){
+  return c >= '0' && c <= '9';
+}
+
+/*
+ * Skip spaces, tabs and carriage returns. Newlines are significant in an
+ * ASCII PLY body and are not skipped.
+ */
+static inline const char* plySkipSpace(const char *first, const char *last){
+  while( first < last && (*first == ' ' || *first == '\t' || *first == '\r') ){
+    first++;
+  }
+  return first;
+}
+
+/*
+ * Returns a pointer to the '\n' ending the line that starts at first, or
+ * last if the final line is not terminated.
+ */
+static inline const char* plyLineEnd(const char *first, const char *last){
+  const char *eol = (const char*)memchr(first, '\n', last - first);
+  return eol ? eol : last;
+}
+
+/*
+ * Parse a decimal integer at first. Returns one past the last character
+ * consumed, or first when there is no integer there or it does not fit
+ * in an int.
+ */
+static inline const char* plyParseInt(const char *first, const char *last, int *value){
+  const char *p = first;
+  bool negative = false;
+  if( p < last && (*p == '-' || *p == '+') ){
+    negative = *p == '-';
+    p++;
+  }
+  const char *digits = p;
+  const long long limit = negative ? -(long long)INT_MIN : INT_MAX;
+  long long v = 0;
+  while( p < last && plyIsDigit(*p) ){
+    v = v * 10 + (*p - '0');
+    if( v > limit ){
+      return first;
+    }
+    p++;
+  }
+  if( p == digits ){
+    return first;
+  }
+  *value = (int)(negative ? -v : v);
+  return p;
+}
+
+/*
+ * Hand a token the fast path can not represent exactly to strtod. The
+ * token is copied out because the input need not be NUL terminated.
+ */
+static inline const char* plyParseDoubleSlow(const char *first, const char *last, double *value){
+  const char *p = first;
+  while( p < last && *p != ' ' && *p != '\t' && *p != '\r' && *p != '\n' ){
+    p++;
+  }
+  char local[64];
+  std::string longToken;
+  const char *token = local;
+  size_t n = p - first;
+  if( n < sizeof(local) ){
+    memcpy(local, first, n);
+    local[n] = '\0';
+  }else{
+    longToken.assign(first, n);
+    token = longToken.c_str( );
+  }
+  char *end;
+  double v = strtod(token, &end);
+  if( end == token ){
+    return first;
+  }
+  *value = v;
+  return first + (end - token);
+}
+
+/*
+ * Parse a decimal floating point number at first. Returns one past the
+ * last character consumed, or first when there is no number there.
+ *
+ * Numbers with at most 15 significant digits and a small decimal
+ * exponent are converted with a single exact multiply or divide by a
+ * power of ten (Clinger's fast path), which is correctly rounded and so
+ * gives the same result as strtod. Everything else falls back to strtod.
+ */
+static inline const char* plyParseDouble(const char *first, const char *last, double *value){
+  static const double powersOfTen[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+  };
+  const char *p = first;
+  bool negative = false;
+  if( p < last && (*p == '-' || *p == '+') ){
+    negative = *p == '-';
+    p++;
+  }
+  uint64_t mantissa = 0;
+  int significant = 0;
+  int exponent = 0;
+  bool anyDigits = false;
+  while( p < last && plyIsDigit(*p) ){
+    anyDigits = true;
+    if( mantissa != 0 || *p != '0' ){
+      mantissa = mantissa * 10 + (*p - '0');
+      significant++;
+    }
+    p++;
+  }
+  if( p < last && *p == '.' ){
+    p++;
+    while( p < last && plyIsDigit(*p) ){
+      anyDigits = true;
+      if( mantissa != 0 || *p != '0' ){
+        mantissa = mantissa * 10 + (*p - '0');
+        significant++;
+      }
+      exponent--;
+      p++;
+    }
+  }
+  if( !anyDigits || significant > 15 ){
+    // inf, nan or too many digits to hold exactly
+    return plyParseDoubleSlow(first, last, value);
+  }
+  if( p < last && (*p == 'e' || *p == 'E') ){
+    const char *q = p + 1;
+    bool negativeExponent = false;
+    if( q < last && (*q == '-' || *q == '+') ){
+      negativeExponent = *q == '-';
+      q++;
+    }
+    if( q < last && plyIsDigit(*q) ){
+      int e = 0;
+      while( q < last && plyIsDigit(*q) ){
+        if( e < 10000 ){
+          e = e * 10 + (*q - '0');
+        }
+        q++;
+      }
+      exponent += negativeExponent ? -e : e;
+      p = q;
+    }
+  }
+  double v = (double)mantissa;
+  if( mantissa != 0 ){
+    if( exponent < -22 || exponent > 22 ){
+      return plyParseDoubleSlow(first, last, value);
+    }
+    v = exponent < 0 ? v / powersOfTen[-exponent] : v * powersOfTen[exponent];
+  }
+  *value = negative ? -v : v;
+  return p;
+}
+
+/*
+ * Where one decoded vertex goes, as values of type T. Groups the file
+ * does not carry are never written, so their pointers may be NULL.
+ */
+template <typename T>
+struct PlyVertex{
+  T *position;
+  T *normal;
+  T *color;
+  T *texcoord;
+};
+
+/*
+ * Copy a vertex decoded into values, indexed by PlyAttribute, to out.
+ */
+template <typename T>
+static inline void plyStoreVertex(const double *values, unsigned int attributes, PlyVertex<T> &out){
+  int j;
+  for( j = 0; j < 3; j++ ){
+    out.position[j] = values[PLY_X + j];
+  }
+  if( attributes & PLY_NORMALS ){
+    for( j = 0; j < 3; j++ ){
+      out.normal[j] = values[PLY_NX + j];
+    }
+  }
+  if( attributes & PLY_COLORS ){
+    for( j = 0; j < 3; j++ ){
+      out.color[j] = values[PLY_RED + j];
+    }
+  }
+  if( attributes & PLY_TEXCOORDS ){
+    for( j = 0; j < 2; j++ ){
+      out.texcoord[j] = values[PLY_U + j];
+    }
+  }
+}
+
+/*
+ * Parse up to n numbers in [p, eol) into v. Values missing from a short
+ * line are left untouched. Returns where parsing stopped.
+ */
+template <typename T>
+static inline const char* plyParseFields(const char *p, const char *eol, T *v, int n){
+  for( int j = 0; j < n; j++ ){
+    double value;
+    const char *q = plySkipSpace(p, eol);
+    p = plyParseDouble(q, eol, &value);
+    if( p == q ){
+      return eol;
+    }
+    v[j] = (T)value;
+  }
+  return p;
+}
+
+/*
+ * Parses one ASCII vertex line in [p, eol). plyAsciiVertexParser picks
+ * the one for a header.
+ */
+template <typename T>
+using PlyAsciiVertexParser = void (*)(const char *p, const char *eol, const PlyHeader &header, PlyVertex<T> &out);
+
+/*
+ * Any schema: every property up to the last used one is parsed and
+ * routed by its attribute.
+ */
+template <typename T>
+static inline void plyParseVertexLineGeneric(const char *p, const char *eol, const PlyHeader &header, PlyVertex<T> &out){
+  double values[PLY_OTHER] = { 0.0 };
+  const PlyProperty *property = header.vertexProperties.data( );
+  for( int k = 0; k < header.vertexFields; k++ ){
+    double v;
+    const char *q = plySkipSpace(p, eol);
+    p = plyParseDouble(q, eol, &v);
+    if( p == q ){
+      break;
+    }
+    if( property[k].attribute != PLY_OTHER ){
+      values[property[k].attribute] = v * property[k].scale;
+    }
+  }
+  plyStoreVertex(values, header.attributes, out);
+}
+
+/*
+ * A canonical schema carrying the groups in Attributes. The fields are
+ * parsed straight into place.
+ */
+template <unsigned int Attributes, typename T>
+static void plyParseVertexLineAs(const char *p, const char *eol, const PlyHeader &header, PlyVertex<T> &out){
+  p = plyParseFields(p, eol, out.position, 3);
+  if( Attributes & PLY_NORMALS ){
+    p = plyParseFields(p, eol, out.normal, 3);
+  }
+  if( Attributes & PLY_COLORS ){
+    const PlyProperty *property = &header.vertexProperties[(Attributes & PLY_NORMALS) ? 6 : 3];
+    p = plyParseFields(p, eol, out.color, 3);
+    for( int j = 0; j < 3; j++ ){
+      out.color[j] *= property[j].scale;
+    }
+  }
+  if( Attributes & PLY_TEXCOORDS ){
+    p = plyParseFields(p, eol, out.texcoord, 2);
+  }
+}
+
+template <typename T>
+static inline PlyAsciiVertexParser<T> plyAsciiVertexParser(const PlyHeader &header){
+  if( header.canonical ){
+    switch( header.attributes ){
+    case 0:
+      return plyParseVertexLineAs<0, T>;
+    case PLY_NORMALS:
+      return plyParseVertexLineAs<PLY_NORMALS, T>;
+    case PLY_COLORS:
+      return plyParseVertexLineAs<PLY_COLORS, T>;
+    case PLY_NORMALS | PLY_TEXCOORDS:
+      return plyParseVertexLineAs<PLY_NORMALS | PLY_TEXCOORDS, T>;
+    default:
+      break;
+    }
+  }
+  return plyParseVertexLineGeneric<T>;
+}
+
+/*
+ * Number of triangles a face with n corners is fanned into.
+ */
+static inline int plyFanTriangles(int n){
+  return n < 3 ? 0 : n - 2;
+}
+
+/*
+ * Triangle t of the fan around the first corner of a face.
+ */
+static inline void plyFanTriangle(const int *corners, int t, int *f){
+  f[0] = corners[0];
+  f[1] = corners[t + 1];
+  f[2] = corners[t + 2];
+}
+
+/*
+ * Skip the scalar face properties in front of the index list and read
+ * the list's length. Returns one past it, or NULL when the line is
+ * malformed or too short for that many indices.
+ */
+static inline const char* plyParseFaceCount(const char *p, const char *eol, const PlyHeader &header, int *n){
+  const char *q;
+  for( int k = 0; k < header.facePropertiesBefore; k++ ){
+    double skipped;
+    q = plySkipSpace(p, eol);
+    p = plyParseDouble(q, eol, &skipped);
+    if( p == q ){
+      return NULL;
+    }
+  }
+  q = plySkipSpace(p, eol);
+  p = plyParseInt(q, eol, n);
+  // each corner takes a space and a digit at least, so a count the line
+  // cannot hold is malformed, and nothing is allocated for it
+  if( p == q || *n < 0 || *n > (eol - p + 1) / 2 ){
+    return NULL;
+  }
+  return p;
+}
+
+/*
+ * Parse one face line in [p, eol) into corners, which grows as needed.
+ * Returns the number of corners, or -1 when the line is malformed or
+ * names a vertex the header does not have.
+ */
+static inline int plyParseFaceLine(const char *p, const char *eol, const PlyHeader &header, std::vector<int> &corners){
+  int n;
+  if( !(p = plyParseFaceCount(p, eol, header, &n)) ){
+    return -1;
+  }
+  if( (int)corners.size( ) < n ){
+    corners.resize(n);
+  }
+  for( int j = 0; j < n; j++ ){
+    const char *q = plySkipSpace(p, eol);
+    p = plyParseInt(q, eol, &corners[j]);
+    if( p == q || (unsigned int)corners[j] >= header.nv ){
+      return -1;
+    }
+  }
+  return n;
+}
+
+/*
+ * Where things are in the vertex and face records of a binary body.
+ * Vertices have a fixed stride; a face's size depends on its number of
+ * corners.
+ */
+struct PlyBinaryLayout{
+  bool swap;
+  int vertexStride;
+  PlyType countType;
+  PlyType indexType;
+  int countSize;
+  int indexSize;
+  int faceBytesBefore;
+  int faceBytesAfter;
+  // corner indices must be below it
+  unsigned int vertexCount;
+};
+
+static inline PlyBinaryLayout plyBinaryLayout(const PlyHeader &header){
+  PlyBinaryLayout layout;
+  layout.swap = (header.format == PLY_BINARY_LITTLE_ENDIAN) != hostIsLittleEndian( );
+  layout.vertexStride = header.vertexStride;
+  layout.countType = header.countType;
+  layout.indexType = header.indexType;
+  layout.countSize = plyTypeSize(header.countType);
+  layout.indexSize = plyTypeSize(header.indexType);
+  layout.faceBytesBefore = header.faceBytesBefore;
+  layout.faceBytesAfter = header.faceBytesAfter;
+  layout.vertexCount = header.nv;
+  return layout;
+}
+
+/*
+ * Decodes one binary vertex record. plyBinaryVertexDecoder picks the
+ * one for a header.
+ */
+template <typename T>
+using PlyBinaryVertexDecoder = void (*)(const char *p, const PlyHeader &header, bool swap, PlyVertex<T> &out);
+
+template <typename T>
+static inline void plyDecodeBinaryVertexGeneric(const char *p, const PlyHeader &header, bool swap, PlyVertex<T> &out){
+  double values[PLY_OTHER] = { 0.0 };
+  const PlyProperty *property = header.vertexProperties.data( );
+  for( int k = 0; k < header.vertexFields; k++ ){
+    if( property[k].attribute != PLY_OTHER ){
+      values[property[k].attribute] = plyBinaryScalar(p + property[k].offset, property[k].type, swap) * property[k].scale;
+    }
+  }
+  plyStoreVertex(values, header.attributes, out);
+}
+
+/*
+ * A canonical schema in host byte order whose positions, normals and
+ * texture coordinates are all of type Real and whose colors are 8 bit.
+ */
+template <unsigned int Attributes, typename Real, typename T>
+static void plyDecodeBinaryVertexAs(const char *p, const PlyHeader &header, bool swap, PlyVertex<T> &out){
+  Real v[3];
+  int j;
+  memcpy(v, p, sizeof(v));
+  p += sizeof(v);
+  for( j = 0; j < 3; j++ ){
+    out.position[j] = v[j];
+  }
+  if( Attributes & PLY_NORMALS ){
+    memcpy(v, p, sizeof(v));
+    p += sizeof(v);
+    for( j = 0; j < 3; j++ ){
+      out.normal[j] = v[j];
+    }
+  }
+  if( Attributes & PLY_COLORS ){
+    // scaled as the other decoders scale them, to the same last bit
+    const PlyProperty *property = &header.vertexProperties[(Attributes & PLY_NORMALS) ? 6 : 3];
+    unsigned char c[3];
+    memcpy(c, p, sizeof(c));
+    p += sizeof(c);
+    for( j = 0; j < 3; j++ ){
+      out.color[j] = c[j] * property[j].scale;
+    }
+  }
+  if( Attributes & PLY_TEXCOORDS ){
+    memcpy(v, p, 2 * sizeof(Real));
+    for( j = 0; j < 2; j++ ){
+      out.texcoord[j] = v[j];
+    }
+  }
+}
+
+template <typename Real, typename T>
+static inline PlyBinaryVertexDecoder<T> plyPackedVertexDecoder(unsigned int attributes){
+  switch( attributes ){
+  case 0:
+    return plyDecodeBinaryVertexAs<0, Real, T>;
+  case PLY_NORMALS:
+    return plyDecodeBinaryVertexAs<PLY_NORMALS, Real, T>;
+  case PLY_COLORS:
+    return plyDecodeBinaryVertexAs<PLY_COLORS, Real, T>;
+  case PLY_NORMALS | PLY_TEXCOORDS:
+    return plyDecodeBinaryVertexAs<PLY_NORMALS | PLY_TEXCOORDS, Real, T>;
+  default:
+    return NULL;
+  }
+}
+
+/*
+ * True when every used property has type real, or uint8 for colors.
+ */
+static inline bool plyPackedVertex(const PlyHeader &header, PlyType real){
+  for( int k = 0; k < header.vertexFields; k++ ){
+    PlyAttribute a = header.vertexProperties[k].attribute;
+    PlyType expected = (a >= PLY_RED && a <= PLY_BLUE) ? PLY_UINT8 : real;
+    if( header.vertexProperties[k].type != expected ){
+      return false;
+    }
+  }
+  return true;
+}
+
+template <typename T>
+static inline PlyBinaryVertexDecoder<T> plyBinaryVertexDecoder(const PlyHeader &header, bool swap){
+  PlyBinaryVertexDecoder<T> decode = NULL;
+  if( header.canonical && !swap ){
+    if( plyPackedVertex(header, PLY_FLOAT32) ){
+      decode = plyPackedVertexDecoder<float, T>(header.attributes);
+    }else if( plyPackedVertex(header, PLY_FLOAT64) ){
+      decode = plyPackedVertexDecoder<double, T>(header.attributes);
+    }
+  }
+  return decode ? decode : plyDecodeBinaryVertexGeneric<T>;
+}
+
+/*
+ * Number of corners of the binary face record at p, or -1 if the count
+ * is negative.
+ */
+static inline int plyBinaryFaceCorners(const char *p, const PlyBinaryLayout &layout){
+  double n = plyBinaryScalar(p + layout.faceBytesBefore, layout.countType, layout.swap);
+  return n < 0.0 ? -1 : (int)n;
+}
+
+/*
+ * Size of a binary face record with n corners.
+ */
+static inline size_t plyBinaryFaceSize(const PlyBinaryLayout &layout, int n){
+  return layout.faceBytesBefore + layout.countSize + (size_t)n * layout.indexSize + layout.faceBytesAfter;
+}
+
+/*
+ * Read the n corner indices of the binary face record at p. Returns
+ * false when one names a vertex the header does not have.
+ */
+static inline bool plyDecodeBinaryFace(const char *p, const PlyBinaryLayout &layout, int n, int *corners){
+  int j;
+  p += layout.faceBytesBefore + layout.countSize;
+  if( n > 0 && !layout.swap && (layout.indexType == PLY_INT32 || layout.indexType == PLY_UINT32) ){
+    memcpy(corners, p, n * sizeof(int));
+  }else{
+    for( j = 0; j < n; j++ ){
+      double index = plyBinaryScalar(p + j * layout.indexSize, layout.indexType, layout.swap);
+      corners[j] = index < 0.0 || index >= layout.vertexCount ? -1 : (int)index;
+    }
+  }
+  for( j = 0; j < n; j++ ){
+    if( (unsigned int)corners[j] >= layout.vertexCount ){
+      return false;
+    }
+  }
+  return true;
+}
+
+#endif
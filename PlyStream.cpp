@@ -0,0 +1,316 @@
+/*
+ * PlyStream
+ *
+ * Reads a PLY model front to back and hands its vertices and faces to a
+ * handler in chunks of a fixed size.
+ */
+
+#include "PlyStream.h"
+
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+/*
+ * Headers longer than this are assumed to be garbage.
+ */
+static const size_t maxHeaderBytes = 1 << 20;
+
+/*
+ * Size of the body read buffer; also the longest ASCII line accepted.
+ */
+static const size_t readBufferBytes = 1 << 20;
+
+/*
+ * A sliding window over the input. Unconsumed bytes are moved to the
+ * front before each read, so the buffer never grows.
+ */
+class PlyReadBuffer{
+public:
+  PlyReadBuffer( FILE* input ) : _input(input), _buffer(readBufferBytes), _begin(0), _end(0), _eof(false){ }
+
+  const char* begin( ) const { return _buffer.data( ) + _begin; }
+  const char* end( ) const { return _buffer.data( ) + _end; }
+  size_t available( ) const { return _end - _begin; }
+  bool eof( ) const { return _eof; }
+
+  void consume( size_t n ){ _begin += n; }
+
+  // Read more input. Returns false once nothing more can be read.
+  bool fill( ){
+    if( _eof ){
+      return false;
+    }
+    if( _begin > 0 ){
+      memmove(_buffer.data( ), _buffer.data( ) + _begin, _end - _begin);
+      _end -= _begin;
+      _begin = 0;
+    }
+    if( _end == _buffer.size( ) ){
+      return false;
+    }
+    size_t n = fread(_buffer.data( ) + _end, 1, _buffer.size( ) - _end, _input);
+    _end += n;
+    if( n == 0 ){
+      _eof = true;
+    }
+    return n > 0;
+  }
+
+private:
+  FILE *_input;
+  std::vector<char> _buffer;
+  size_t _begin;
+  size_t _end;
+  bool _eof;
+};
+
+/*
+ * Read the header a character at a time up to and including the
+ * end_header line, leaving input positioned at the body.
+ */
+static std::string readStreamHeader( FILE* input, const char* name ){
+  std::string header;
+  size_t lineStart = 0;
+  int c;
+  while( (c = getc(input)) != EOF ){
+    header += (char)c;
+    if( c == '\n' ){
+      if( header.compare(lineStart, 10, "end_header") == 0 ){
+        return header;
+      }
+      lineStart = header.size( );
+    }
+    if( header.size( ) > maxHeaderBytes ){
+      break;
+    }
+  }
+  std::cerr << "Error: no end_header in \"" << name << "\"." << std::endl;
+  exit(1);
+}
+
+/*
+ * Collects elements into a chunk and passes full chunks on.
+ */
+template <typename T>
+class PlyChunk{
+public:
+  PlyChunk( unsigned int size ) : _values(size * 3), _size(size), _first(0), _count(0){ }
+
+  T* next( ){ return &_values[_count * 3]; }
+
+  template <typename Flush>
+  void push( Flush flush ){
+    if( ++_count == _size ){
+      finish(flush);
+    }
+  }
+
+  template <typename Flush>
+  void finish( Flush flush ){
+    if( _count > 0 ){
+      flush(_first, _count, _values.data( ));
+      _first += _count;
+      _count = 0;
+    }
+  }
+
+private:
+  std::vector<T> _values;
+  unsigned int _size;
+  unsigned int _first;
+  unsigned int _count;
+};
+
+static void malformedFace( ){
+  fprintf(stderr, "Error: malformed face.\n");
+  exit(1);
+}
+
+/*
+ * Hand the next line of an ASCII body to parse. Returns false at the end
+ * of the input.
+ */
+template <typename Parse>
+static bool nextAsciiLine( PlyReadBuffer& in, Parse parse ){
+  for( ; ; ){
+    const char *eol = (const char*)memchr(in.begin( ), '\n', in.available( ));
+    if( eol ){
+      parse(in.begin( ), eol);
+      in.consume(eol - in.begin( ) + 1);
+      return true;
+    }
+    if( !in.fill( ) ){
+      if( in.available( ) == 0 ){
+        return false;
+      }
+      if( !in.eof( ) ){
+        std::cerr << "Error: line longer than " << readBufferBytes << " bytes." << std::endl;
+        exit(1);
+      }
+      // unterminated last line
+      parse(in.begin( ), in.end( ));
+      in.consume(in.available( ));
+      return true;
+    }
+  }
+}
+
+/*
+ * Make at least n bytes available. Returns false at the end of the
+ * input.
+ */
+static bool ensureBytes( PlyReadBuffer& in, size_t n ){
+  while( in.available( ) < n ){
+    if( !in.fill( ) ){
+      return false;
+    }
+  }
+  return true;
+}
+
+void streamPlyModel( FILE* input, const char* name, PlyStreamHandler& handler, unsigned int chunkSize ){
+  PlyHeader header;
+  std::string headerText = readStreamHeader(input, name);
+  parsePlyHeader(headerText.data( ), headerText.data( ) + headerText.size( ), &header, name);
+  handler.begin(header);
+
+  if( chunkSize < 1 ){
+    chunkSize = 1;
+  }
+  PlyReadBuffer in(input);
+  PlyChunk<double> vertexChunk(chunkSize);
+  PlyChunk<int> faceChunk(chunkSize);
+  unsigned int i;
+
+  struct VertexFlush{
+    PlyStreamHandler *h;
+    void operator ()( unsigned int first, unsigned int count, const double* v ){ h->vertices(first, count, v); }
+  } vertexFlush = { &handler };
+  struct FaceFlush{
+    PlyStreamHandler *h;
+    void operator ()( unsigned int first, unsigned int count, const int* f ){ h->faces(first, count, f); }
+  } faceFlush = { &handler };
+
+  // Only positions are handed on; the other attributes land here
+  double normal[3], color[3], texcoord[2];
+  std::vector<int> corners(3);
+
+  if( header.format == PLY_ASCII ){
+    PlyAsciiVertexParser<double> parseVertex = plyAsciiVertexParser<double>(header);
+    for( i = 0; i < header.nv; i++ ){
+      PlyVertex<double> v = { vertexChunk.next( ), normal, color, texcoord };
+      v.position[0] = v.position[1] = v.position[2] = 0.0;
+      if( !nextAsciiLine(in, [&](const char *p, const char *eol){ parseVertex(p, eol, header, v); }) ){
+        std::cerr << "Error: unexpected end of vertex data." << std::endl;
+        exit(1);
+      }
+      vertexChunk.push(vertexFlush);
+    }
+    vertexChunk.finish(vertexFlush);
+    for( i = 0; i < header.nf; i++ ){
+      int n = -1;
+      if( !nextAsciiLine(in, [&](const char *p, const char *eol){ n = plyParseFaceLine(p, eol, header, corners); }) || n < 0 ){
+        malformedFace( );
+      }
+      for( int k = 0; k < plyFanTriangles(n); k++ ){
+        plyFanTriangle(corners.data( ), k, faceChunk.next( ));
+        faceChunk.push(faceFlush);
+      }
+    }
+    faceChunk.finish(faceFlush);
+  }else{
+    PlyBinaryLayout layout = plyBinaryLayout(header);
+    PlyBinaryVertexDecoder<double> decodeVertex = plyBinaryVertexDecoder<double>(header, layout.swap);
+    for( i = 0; i < header.nv; i++ ){
+      if( !ensureBytes(in, layout.vertexStride) ){
+        std::cerr << "Error: unexpected end of vertex data." << std::endl;
+        exit(1);
+      }
+      PlyVertex<double> v = { vertexChunk.next( ), normal, color, texcoord };
+      decodeVertex(in.begin( ), header, layout.swap, v);
+      in.consume(layout.vertexStride);
+      vertexChunk.push(vertexFlush);
+    }
+    vertexChunk.finish(vertexFlush);
+    for( i = 0; i < header.nf; i++ ){
+      int n = -1;
+      if( ensureBytes(in, plyBinaryFaceSize(layout, 0)) ){
+        n = plyBinaryFaceCorners(in.begin( ), layout);
+      }
+      if( n < 0 || !ensureBytes(in, plyBinaryFaceSize(layout, n)) ){
+        std::cerr << "Error: unexpected end of face data." << std::endl;
+        exit(1);
+      }
+      if( (int)corners.size( ) < n ){
+        corners.resize(n);
+      }
+      if( !plyDecodeBinaryFace(in.begin( ), layout, n, corners.data( )) ){
+        malformedFace( );
+      }
+      in.consume(plyBinaryFaceSize(layout, n));
+      for( int k = 0; k < plyFanTriangles(n); k++ ){
+        plyFanTriangle(corners.data( ), k, faceChunk.next( ));
+        faceChunk.push(faceFlush);
+      }
+    }
+    faceChunk.finish(faceFlush);
+  }
+  handler.end( );
+}
+
+void streamPlyModel( const char* filename, PlyStreamHandler& handler, unsigned int chunkSize ){
+  if( strcmp(filename, "-") == 0 ){
+    streamPlyModel(stdin, "<stdin>", handler, chunkSize);
+    return;
+  }
+  FILE *input = fopen(filename, "rb");
+  if( !input ){
+    std::cerr << "File \"" << filename << "\" not found." << std::endl;
+    exit( 1 );
+  }
+  streamPlyModel(input, filename, handler, chunkSize);
+  fclose(input);
+}
+
+PlyBoundsHandler::PlyBoundsHandler( ) : radius(-1.0), count(0){
+  for( int j = 0; j < 3; j++ ){
+    min[j] = max[j] = center[j] = 0.0;
+  }
+}
+
+void PlyBoundsHandler::vertices( unsigned int first, unsigned int n, const double* xyz ){
+  for( unsigned int i = 0; i < n; i++, xyz += 3 ){
+    if( count++ == 0 ){
+      for( int j = 0; j < 3; j++ ){
+        min[j] = max[j] = center[j] = xyz[j];
+      }
+      radius = 0.0;
+      continue;
+    }
+    double d[3], sq = 0.0;
+    for( int j = 0; j < 3; j++ ){
+      if( xyz[j] < min[j] ){
+        min[j] = xyz[j];
+      }
+      if( xyz[j] > max[j] ){
+        max[j] = xyz[j];
+      }
+      d[j] = xyz[j] - center[j];
+      sq += d[j] * d[j];
+    }
+    if( sq > radius * radius ){
+      // grow the sphere just enough to reach the point
+      double dist = sqrt(sq);
+      double newRadius = (radius + dist) * 0.5;
+      double shift = (newRadius - radius) / dist;
+      for( int j = 0; j < 3; j++ ){
+        center[j] += d[j] * shift;
+      }
+      radius = newRadius;
+    }
+  }
+}
@@ -0,0 +1,60 @@
+/*
+ * PlyStream
+ *
+ * Reads a PLY model front to back and hands its vertices and faces to a
+ * handler in chunks of a fixed size. Only one chunk and one read buffer
+ * are held at a time, so a model of any size can be consumed in bounded
+ * memory. The input may be a file or a pipe; nothing is seeked.
+ *
+ * The result is the raw file positions and faces: no centering, scaling
+ * or normals are computed, since those need the whole mesh.
+ */
+
+#include <cstdio>
+
+#include "PlyParse.h"
+
+#ifndef _PLYSTREAM_H_
+#define _PLYSTREAM_H_
+
+class PlyStreamHandler{
+public:
+  virtual ~PlyStreamHandler( ){ }
+  // Called once the header has been read, before any chunk.
+  virtual void begin( const PlyHeader& header ){ }
+  // count vertices starting at vertex index first, as count * 3 doubles
+  virtual void vertices( unsigned int first, unsigned int count, const double* xyz ){ }
+  // count triangles starting at triangle index first, as count * 3
+  // indices. Polygons arrive fanned into triangles.
+  virtual void faces( unsigned int first, unsigned int count, const int* indices ){ }
+  // Called after the last chunk.
+  virtual void end( ){ }
+};
+
+/*
+ * Stream filename through handler, chunkSize elements at a time. A
+ * filename of "-" reads standard input. Exits with a message on
+ * malformed input, like readPlyModel.
+ */
+void streamPlyModel( const char* filename, PlyStreamHandler& handler, unsigned int chunkSize = 65536 );
+void streamPlyModel( FILE* input, const char* name, PlyStreamHandler& handler, unsigned int chunkSize = 65536 );
+
+/*
+ * Computes the bounds of a streamed model in a single pass: its axis
+ * aligned box and an enclosing sphere. The sphere is grown one point at
+ * a time the way the second pass of Ritter's algorithm does, so it is
+ * looser than calcRitterBoundingSphere's but never needs a second read.
+ */
+class PlyBoundsHandler : public PlyStreamHandler{
+public:
+  double min[3];
+  double max[3];
+  double center[3];
+  double radius;
+  unsigned int count;
+
+  PlyBoundsHandler( );
+  void vertices( unsigned int first, unsigned int count, const double* xyz );
+};
+
+#endif
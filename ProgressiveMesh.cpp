@@ -0,0 +1,420 @@
+/*
+ * ProgressiveMesh
+ *
+ * Building, refining, writing and streaming progressive meshes.
+ */
+
+#include "ProgressiveMesh.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <unistd.h>
+
+typedef FaceList::Real Real;
+
+/*
+ * The file is this header, then the base mesh: positions and normals
+ * (baseVertices * 3 reals each) and faces (baseFaces * 3 int32s). Then
+ * come the splits in order. Each is a SplitRecord followed by its
+ * vertex's position and normal (3 reals each), its new faces (newFaces
+ * * 3 int32s) and the corners it moves (cornerCount int32s). Everything
+ * is in host byte order, as in MeshCache.
+ */
+struct ProgressiveMeshHeader{
+  char magic[8];
+  uint32_t version;
+  uint32_t byteOrder;
+  uint64_t sourceHash;
+  uint32_t realSize;
+  int32_t baseVertices;
+  int32_t baseFaces;
+  int32_t splitCount;
+  double center[3];
+  double radius;
+};
+
+struct SplitRecord{
+  int32_t parent;
+  int32_t newFaces;
+  int32_t cornerCount;
+  float error;
+};
+
+static const char progressiveMeshMagic[8] = { 'P', 'L', 'Y', 'P', 'R', 'O', 'G', 0 };
+static const uint32_t progressiveMeshVersion = 1;
+static const uint32_t progressiveMeshByteOrder = 0x01020304;
+// A collapse removes the one or two faces on its edge
+static const int maxNewFaces = 2;
+
+ProgressiveMesh::ProgressiveMesh( ){
+  baseVertices = 0;
+  baseFaces = 0;
+  center[0] = center[1] = center[2] = 0.0;
+  radius = 0.0;
+  _applied = 0;
+  _faces = 0;
+}
+
+void ProgressiveMesh::start( ){
+  _current = faces;
+  _applied = 0;
+  _faces = baseFaces;
+}
+
+void ProgressiveMesh::applySplit( int i ){
+  const VertexSplit &s = splits[i];
+  for( int c = s.firstCorner; c < s.firstCorner + s.cornerCount; c++ ){
+    _current[corners[c]] = baseVertices + i;
+  }
+  std::copy(&faces[3 * (size_t)_faces], &faces[3 * (size_t)(_faces + s.newFaces)], &_current[3 * (size_t)_faces]);
+  _faces += s.newFaces;
+}
+
+void ProgressiveMesh::undoSplit( int i ){
+  const VertexSplit &s = splits[i];
+  _faces -= s.newFaces;
+  for( int c = s.firstCorner; c < s.firstCorner + s.cornerCount; c++ ){
+    _current[corners[c]] = s.parent;
+  }
+}
+
+void ProgressiveMesh::refine( int count ){
+  count = std::max(0, std::min(count, (int)splits.size( )));
+  while( _applied < count ){
+    applySplit(_applied++);
+  }
+  while( _applied > count ){
+    undoSplit(--_applied);
+  }
+}
+
+// The errors fall along the stream, so this is a binary search
+int ProgressiveMesh::splitsFor( double error ) const{
+  int low = 0;
+  int high = (int)splits.size( );
+  while( low < high ){
+    int middle = (low + high) / 2;
+    if( splits[middle].error <= error ){
+      high = middle;
+    }else{
+      low = middle + 1;
+    }
+  }
+  return low;
+}
+
+void ProgressiveMesh::append( ProgressiveMesh& more ){
+  int cornerBase = (int)corners.size( );
+  positions.insert(positions.end( ), more.positions.begin( ), more.positions.end( ));
+  normals.insert(normals.end( ), more.normals.begin( ), more.normals.end( ));
+  faces.insert(faces.end( ), more.faces.begin( ), more.faces.end( ));
+  corners.insert(corners.end( ), more.corners.begin( ), more.corners.end( ));
+  for( size_t i = 0; i < more.splits.size( ); i++ ){
+    VertexSplit s = more.splits[i];
+    s.firstCorner += cornerBase;
+    splits.push_back(s);
+  }
+  _current.resize(faces.size( ));
+  more = ProgressiveMesh( );
+}
+
+std::string progressiveMeshPath( const char* plyFilename ){
+  return std::string(plyFilename) + ".pm";
+}
+
+/*
+ * The collapses are replayed on fl's faces to find what each one does:
+ * which faces it removes, with their corners just before, and which
+ * corners it moves. A split does the reverse. Splitting runs the
+ * collapses backwards, so the vertices are numbered with the base's
+ * first, in their old order, then the removed ones in the reverse of
+ * the order they went. The faces are numbered the same way.
+ */
+ProgressiveMesh* buildProgressiveMesh( const FaceList* fl, int minFaces ){
+  std::vector<EdgeCollapse> collapses;
+  collapseEdges(fl, minFaces, collapses);
+  const int vc = fl->vc;
+  const int fc = fl->fc;
+  const int n = (int)collapses.size( );
+
+  std::vector<int> current(fl->faces[0], fl->faces[0] + 3 * (size_t)fc);
+  std::vector< std::vector<int> > vertexFaces(vc);
+  for( int f = 0; f < fc; f++ ){
+    for( int k = 0; k < 3; k++ ){
+      vertexFaces[current[3 * f + k]].push_back(f);
+    }
+  }
+  std::vector<bool> alive(fc, true);
+  std::vector<int> removedStart(1, 0), removedFaces, removedCorners;
+  std::vector<int> movedStart(1, 0), movedCorners;
+  for( int c = 0; c < n; c++ ){
+    int from = collapses[c].from;
+    int to = collapses[c].to;
+    for( size_t i = 0; i < vertexFaces[from].size( ); i++ ){
+      int f = vertexFaces[from][i];
+      if( !alive[f] ){
+        continue;
+      }
+      int *q = &current[3 * f];
+      if( q[0] == to || q[1] == to || q[2] == to ){
+        alive[f] = false;
+        removedFaces.push_back(f);
+        removedCorners.insert(removedCorners.end( ), q, q + 3);
+        continue;
+      }
+      for( int k = 0; k < 3; k++ ){
+        if( q[k] == from ){
+          q[k] = to;
+          movedCorners.push_back(3 * f + k);
+        }
+      }
+      vertexFaces[to].push_back(f);
+    }
+    std::vector<int>().swap(vertexFaces[from]);
+    removedStart.push_back((int)removedFaces.size( ));
+    movedStart.push_back((int)movedCorners.size( ));
+  }
+
+  std::vector<int> newIndex(vc, -1);
+  std::vector<int> order;
+  order.reserve(vc);
+  std::vector<bool> removed(vc, false);
+  for( int c = 0; c < n; c++ ){
+    removed[collapses[c].from] = true;
+  }
+  for( int v = 0; v < vc; v++ ){
+    if( !removed[v] ){
+      newIndex[v] = (int)order.size( );
+      order.push_back(v);
+    }
+  }
+  for( int c = n - 1; c >= 0; c-- ){
+    newIndex[collapses[c].from] = (int)order.size( );
+    order.push_back(collapses[c].from);
+  }
+  std::vector<int> position(fc, -1);
+  int next = 0;
+  for( int f = 0; f < fc; f++ ){
+    if( alive[f] ){
+      position[f] = next++;
+    }
+  }
+  for( int c = n - 1; c >= 0; c-- ){
+    for( int r = removedStart[c]; r < removedStart[c + 1]; r++ ){
+      position[removedFaces[r]] = next++;
+    }
+  }
+
+  ProgressiveMesh *pm = new ProgressiveMesh( );
+  pm->baseVertices = vc - n;
+  pm->baseFaces = fc - removedStart[n];
+  pm->positions.resize(3 * (size_t)vc);
+  pm->normals.resize(3 * (size_t)vc);
+  for( int i = 0; i < vc; i++ ){
+    for( int j = 0; j < 3; j++ ){
+      pm->positions[3 * (size_t)i + j] = fl->vertices[order[i]][j];
+      pm->normals[3 * (size_t)i + j] = fl->v_normals[order[i]][j];
+    }
+  }
+  pm->faces.reserve(3 * (size_t)fc);
+  for( int f = 0; f < fc; f++ ){
+    for( int k = 0; alive[f] && k < 3; k++ ){
+      pm->faces.push_back(newIndex[current[3 * f + k]]);
+    }
+  }
+  pm->splits.resize(n);
+  for( int i = 0; i < n; i++ ){
+    int c = n - 1 - i;
+    VertexSplit &s = pm->splits[i];
+    s.parent = newIndex[collapses[c].to];
+    s.newFaces = removedStart[c + 1] - removedStart[c];
+    s.firstCorner = (int)pm->corners.size( );
+    s.cornerCount = movedStart[c + 1] - movedStart[c];
+    s.error = collapses[c].error;
+    for( int r = 3 * removedStart[c]; r < 3 * removedStart[c + 1]; r++ ){
+      pm->faces.push_back(newIndex[removedCorners[r]]);
+    }
+    for( int m = movedStart[c]; m < movedStart[c + 1]; m++ ){
+      pm->corners.push_back(3 * position[movedCorners[m] / 3] + movedCorners[m] % 3);
+    }
+  }
+  for( int j = 0; j < 3; j++ ){
+    pm->center[j] = fl->center[j];
+  }
+  pm->radius = fl->radius;
+  pm->start( );
+  pm->refine(n);
+  return pm;
+}
+
+bool writeProgressiveMesh( const char* path, uint64_t sourceHash, const ProgressiveMesh* pm ){
+  ProgressiveMeshHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, progressiveMeshMagic, sizeof(progressiveMeshMagic));
+  header.version = progressiveMeshVersion;
+  header.byteOrder = progressiveMeshByteOrder;
+  header.sourceHash = sourceHash;
+  header.realSize = sizeof(Real);
+  header.baseVertices = pm->baseVertices;
+  header.baseFaces = pm->baseFaces;
+  header.splitCount = (int32_t)pm->splits.size( );
+  memcpy(header.center, pm->center, sizeof(header.center));
+  header.radius = pm->radius;
+
+  static std::atomic<int> writeCount(0);
+  char suffix[48];
+  snprintf(suffix, sizeof(suffix), ".%ld.%d.tmp", (long)getpid( ), writeCount++);
+  std::string tmp = std::string(path) + suffix;
+  FILE *f = fopen(tmp.c_str( ), "wb");
+  if( !f ){
+    return false;
+  }
+  bool ok = fwrite(&header, sizeof(header), 1, f) == 1;
+  const size_t vertexReals = 3 * (size_t)pm->baseVertices;
+  const size_t faceInts = 3 * (size_t)pm->baseFaces;
+  ok = ok && fwrite(&pm->positions[0], sizeof(Real), vertexReals, f) == vertexReals;
+  ok = ok && fwrite(&pm->normals[0], sizeof(Real), vertexReals, f) == vertexReals;
+  ok = ok && fwrite(&pm->faces[0], sizeof(int32_t), faceInts, f) == faceInts;
+  size_t face = pm->baseFaces;
+  for( size_t i = 0; ok && i < pm->splits.size( ); i++ ){
+    const VertexSplit &s = pm->splits[i];
+    SplitRecord r = { s.parent, s.newFaces, s.cornerCount, s.error };
+    size_t vertex = pm->baseVertices + i;
+    ok = fwrite(&r, sizeof(r), 1, f) == 1;
+    ok = ok && fwrite(&pm->positions[3 * vertex], sizeof(Real), 3, f) == 3;
+    ok = ok && fwrite(&pm->normals[3 * vertex], sizeof(Real), 3, f) == 3;
+    ok = ok && fwrite(&pm->faces[3 * face], sizeof(int32_t), 3 * s.newFaces, f) == 3 * (size_t)s.newFaces;
+    ok = ok && fwrite(&pm->corners[s.firstCorner], sizeof(int32_t), s.cornerCount, f) == (size_t)s.cornerCount;
+    face += s.newFaces;
+  }
+  ok = (fclose(f) == 0) && ok;
+  if( !ok || rename(tmp.c_str( ), path) != 0 ){
+    remove(tmp.c_str( ));
+    return false;
+  }
+  return true;
+}
+
+ProgressiveMeshReader::ProgressiveMeshReader( ){
+  _file = NULL;
+  _remaining = 0;
+  _vertices = 0;
+  _faces = 0;
+}
+
+ProgressiveMeshReader::~ProgressiveMeshReader( ){
+  if( _file ){
+    fclose(_file);
+  }
+}
+
+ProgressiveMesh* ProgressiveMeshReader::open( const char* path, uint64_t sourceHash ){
+  if( _file ){
+    fclose(_file);
+  }
+  _remaining = 0;
+  _file = fopen(path, "rb");
+  if( !_file ){
+    return NULL;
+  }
+  ProgressiveMeshHeader header;
+  if( fread(&header, sizeof(header), 1, _file) != 1 ||
+      memcmp(header.magic, progressiveMeshMagic, sizeof(progressiveMeshMagic)) != 0 ||
+      header.version != progressiveMeshVersion ||
+      header.byteOrder != progressiveMeshByteOrder ||
+      header.sourceHash != sourceHash ||
+      header.realSize != sizeof(Real) ||
+      header.baseVertices < 0 || header.baseFaces < 0 || header.splitCount < 0 ){
+    fclose(_file);
+    _file = NULL;
+    return NULL;
+  }
+
+  ProgressiveMesh *pm = new ProgressiveMesh( );
+  pm->baseVertices = header.baseVertices;
+  pm->baseFaces = header.baseFaces;
+  memcpy(pm->center, header.center, sizeof(header.center));
+  pm->radius = header.radius;
+  const size_t vertexReals = 3 * (size_t)header.baseVertices;
+  const size_t faceInts = 3 * (size_t)header.baseFaces;
+  pm->positions.resize(vertexReals);
+  pm->normals.resize(vertexReals);
+  pm->faces.resize(faceInts);
+  bool ok = fread(&pm->positions[0], sizeof(Real), vertexReals, _file) == vertexReals &&
+    fread(&pm->normals[0], sizeof(Real), vertexReals, _file) == vertexReals &&
+    fread(&pm->faces[0], sizeof(int32_t), faceInts, _file) == faceInts;
+  for( size_t i = 0; ok && i < faceInts; i++ ){
+    ok = pm->faces[i] >= 0 && pm->faces[i] < header.baseVertices;
+  }
+  if( !ok ){
+    delete pm;
+    fclose(_file);
+    _file = NULL;
+    return NULL;
+  }
+  pm->start( );
+  _remaining = header.splitCount;
+  _vertices = header.baseVertices;
+  _faces = header.baseFaces;
+  return pm;
+}
+
+/*
+ * Each split is checked against the stream so far before it is kept,
+ * so a damaged file ends the stream instead of handing out indices
+ * that point nowhere.
+ */
+ProgressiveMesh* ProgressiveMeshReader::readSplits( int count ){
+  if( !_file || _remaining == 0 ){
+    return NULL;
+  }
+  ProgressiveMesh *more = new ProgressiveMesh( );
+  std::vector<int> newFaces, moved;
+  for( ; count > 0 && _remaining > 0; count--, _remaining-- ){
+    SplitRecord r;
+    Real position[3], normal[3];
+    bool ok = fread(&r, sizeof(r), 1, _file) == 1 &&
+      r.parent >= 0 && r.parent < _vertices &&
+      r.newFaces >= 0 && r.newFaces <= maxNewFaces &&
+      r.cornerCount >= 0 && r.cornerCount <= 3 * _faces &&
+      fread(position, sizeof(Real), 3, _file) == 3 &&
+      fread(normal, sizeof(Real), 3, _file) == 3;
+    if( ok ){
+      newFaces.resize(3 * r.newFaces);
+      moved.resize(r.cornerCount);
+      ok = fread(&newFaces[0], sizeof(int32_t), newFaces.size( ), _file) == newFaces.size( ) &&
+        fread(&moved[0], sizeof(int32_t), moved.size( ), _file) == moved.size( );
+    }
+    for( size_t i = 0; ok && i < newFaces.size( ); i++ ){
+      ok = newFaces[i] >= 0 && newFaces[i] <= _vertices;
+    }
+    for( size_t i = 0; ok && i < moved.size( ); i++ ){
+      ok = moved[i] >= 0 && moved[i] < 3 * _faces;
+    }
+    if( !ok ){
+      _remaining = 0;
+      fclose(_file);
+      _file = NULL;
+      break;
+    }
+    VertexSplit s;
+    s.parent = r.parent;
+    s.newFaces = r.newFaces;
+    s.firstCorner = (int)more->corners.size( );
+    s.cornerCount = r.cornerCount;
+    s.error = r.error;
+    more->splits.push_back(s);
+    more->positions.insert(more->positions.end( ), position, position + 3);
+    more->normals.insert(more->normals.end( ), normal, normal + 3);
+    more->faces.insert(more->faces.end( ), newFaces.begin( ), newFaces.end( ));
+    more->corners.insert(more->corners.end( ), moved.begin( ), moved.end( ));
+    _vertices++;
+    _faces += r.newFaces;
+  }
+  if( more->splits.empty( ) ){
+    delete more;
+    return NULL;
+  }
+  return more;
+}
@@ -0,0 +1,181 @@
+/*
+ * ProgressiveMesh
+ *
+ * A mesh stored as a coarse base mesh and an ordered stream of vertex
+ * splits (Hoppe 1996). Each split adds one vertex back, along with the
+ * faces around it. Applying every split rebuilds the full mesh, and
+ * undoing them coarsens it again, one vertex at a time, so the detail
+ * drawn can follow the distance with no jump between fixed levels.
+ *
+ * The splits are the edge collapses of MeshSimplify.h in reverse. No
+ * vertex ever moves, so a split only rewrites a few indices. Each split
+ * carries its own vertex, so a prefix of the stream is a complete
+ * coarser mesh. A reader can draw the base as soon as it has it and
+ * refine it as more of the stream arrives.
+ */
+
+#include <stdint.h>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "FaceList.h"
+#include "MeshSimplify.h"
+
+#ifndef _PROGRESSIVEMESH_H_
+#define _PROGRESSIVEMESH_H_
+
+/*
+ * Split number i brings back vertex baseVertices + i, which had been
+ * collapsed onto parent.
+ */
+struct VertexSplit{
+  int parent;
+  // faces added back; they follow the faces of the splits before
+  int newFaces;
+  // corners of faces already there that move from parent to the new
+  // vertex, as 3 * face + corner, from corners[firstCorner] on
+  int firstCorner;
+  int cornerCount;
+  // how far the mesh is from the full one until this split is applied
+  float error;
+};
+
+class ProgressiveMesh{
+public:
+  typedef FaceList::Real Real;
+
+  ProgressiveMesh( );
+
+  // the base mesh
+  int baseVertices;
+  int baseFaces;
+  // per vertex position and normal, 3 reals each: the base's vertices,
+  // then one per split
+  std::vector<Real> positions;
+  std::vector<Real> normals;
+  // faces as they are first made: the base's, then each split's
+  std::vector<int> faces;
+  std::vector<VertexSplit> splits;
+  std::vector<int> corners;
+  // bounding sphere of the full mesh
+  double center[3];
+  double radius;
+
+  // Apply or undo splits until count of them are applied; count is
+  // clamped to the splits there are
+  void refine( int count );
+
+  int appliedSplits( ) const{
+    return _applied;
+  }
+  int vertexCount( ) const{
+    return baseVertices + _applied;
+  }
+  int faceCount( ) const{
+    return _faces;
+  }
+  // the faces with the splits applied so far, faceCount( ) of them
+  const int* currentFaces( ) const{
+    return _current.empty( ) ? NULL : &_current[0];
+  }
+
+  /*
+   * The fewest splits that bring the mesh within error of the full one.
+   * Asking for an error no split meets gives all of them.
+   */
+  int splitsFor( double error ) const;
+
+  /*
+   * Add the splits of more, which continues this stream and has no base
+   * of its own (see ProgressiveMeshReader); more is left empty.
+   */
+  void append( ProgressiveMesh& more );
+
+  // The mesh with the splits applied so far
+  void draw( ) const{
+    const GLenum type = sizeof(Real) == sizeof(float) ? GL_FLOAT : GL_DOUBLE;
+    if( _faces == 0 ){
+      return;
+    }
+    glPolygonMode( GL_FRONT_AND_BACK, GL_FILL );
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glEnableClientState(GL_NORMAL_ARRAY);
+    glVertexPointer(3, type, 0, &positions[0]);
+    glNormalPointer(type, 0, &normals[0]);
+    glDrawElements(GL_TRIANGLES, 3 * _faces, GL_UNSIGNED_INT, &_current[0]);
+    glDisableClientState(GL_NORMAL_ARRAY);
+    glDisableClientState(GL_VERTEX_ARRAY);
+  }
+
+private:
+  friend ProgressiveMesh* buildProgressiveMesh( const FaceList* fl, int minFaces );
+  friend class ProgressiveMeshReader;
+
+  // Start from the base, with no splits applied
+  void start( );
+  void applySplit( int i );
+  void undoSplit( int i );
+
+  // the faces as they are now
+  std::vector<int> _current;
+  int _applied;
+  int _faces;
+};
+
+// Where the progressive stream of plyFilename is kept
+std::string progressiveMeshPath( const char* plyFilename );
+
+/*
+ * The progressive form of fl, whose base has at most minFaces faces
+ * unless fl cannot be simplified that far. Every split is applied.
+ */
+ProgressiveMesh* buildProgressiveMesh( const FaceList* fl, int minFaces = lodMinFaces );
+
+/*
+ * Write pm to path as a stream: the base and then each split. Like
+ * writeBakedMesh, the file is renamed into place once complete and
+ * records sourceHash. Returns false on failure.
+ */
+bool writeProgressiveMesh( const char* path, uint64_t sourceHash, const ProgressiveMesh* pm );
+
+/*
+ * Reads a progressive mesh file a piece at a time: the base first, and
+ * then as many splits at a time as the caller wants. A file that ends
+ * early, or that goes wrong part way, still gives the splits before.
+ */
+class ProgressiveMeshReader{
+public:
+  ProgressiveMeshReader( );
+  ~ProgressiveMeshReader( );
+
+  /*
+   * Open path and read its base, with no splits yet. Returns NULL if
+   * there is no such file, it is not a progressive mesh, or it was
+   * built from a source whose hash is not sourceHash.
+   */
+  ProgressiveMesh* open( const char* path, uint64_t sourceHash );
+
+  /*
+   * Read up to count more splits, for append( ) to add to the base.
+   * Returns NULL when there are none left.
+   */
+  ProgressiveMesh* readSplits( int count );
+
+  // splits not read yet
+  int remaining( ) const{
+    return _remaining;
+  }
+
+private:
+  ProgressiveMeshReader( const ProgressiveMeshReader& );
+  ProgressiveMeshReader& operator =( const ProgressiveMeshReader& );
+
+  FILE *_file;
+  int _remaining;
+  // sizes of the stream read so far, to check the splits against
+  int _vertices;
+  int _faces;
+};
+
+#endif
@@ -6,7 +6,78 @@
 //	5/18/16							//
 //////////////////////////////////////////////////////////////////
 
+//glew has to come before the OpenGL headers pulled in by SceneGraph.h
+#include <GL/glew.h>
 #include "SceneGraph.h"
+#include <cassert>
+#include <cstdio>
+#include <utility>
+
+//models placed in the scene; each one is loaded on a loader thread
+struct SceneModel{
+	const char *name;
+	const char *filename;
+	float x, y, z;
+	BoundingSphereMethod sphere;	//the smallest sphere costs about ten times Ritter's; worth it where Ritter's is loose
+};
+
+static const SceneModel sceneModels[numObj-1] = {
+	{"Trico",	"data/trico.ply",	-2.0, 0.0, 0.0,	RITTER_SPHERE},
+	{"Spider",	"data/spider.ply",	2.0, 0.0, 2.0,	MINIMAL_SPHERE},
+	{"Shark",	"data/shark.ply",	2.0, 4.0, 2.0,	MINIMAL_SPHERE},
+	{"Urn",		"data/urn.ply",		0.5, 1.0, 0.0,	MINIMAL_SPHERE}
+};
+
+//scene chunks are backed by huge pages where the system allows it
+SceneGraph::SceneGraph() : arena(8 << 20, true), meshes(&arena){
+	loader = NULL;
+	uModelViewMatrix = -1;
+	uNormalMatrix = -1;
+	uPackedVertices = -1;
+	uPackScale = -1;
+	uPackOffset = -1;
+	projectionMatrix.identity();
+	cullBackfaces = false;
+	useHulls = false;
+	cullStats = CullStats();
+	lodMode = LOD_PROGRESSIVE;
+	lodPixels = 1.0;
+	viewportHeight = 0;
+}
+
+SceneGraph::~SceneGraph(){
+	clear();
+}
+
+//unload the whole scene; init() can load it again afterwards
+void SceneGraph::clear(){
+	delete loader;	//waits for loads still in flight
+	loader = NULL;
+	collectLoads();
+	for(int n = 1; n < numObj; n++){
+		myObjs[n].releaseMesh();
+	}
+	sphere.reset();
+	//the meshes only drop their bookkeeping above; their memory goes here,
+	//once the registry holds none of them
+	assert(meshes.meshCount() == 0);
+	arena.reset();
+}
+
+void SceneGraph::printMemoryStats(){
+	ArenaStats s = arena.stats();
+	printf("Scene memory: %lu allocations, %lu bytes requested, %lu used, %lu reserved in %d chunks (peak %lu, %d resets)\n",
+		(unsigned long)s.allocations, (unsigned long)s.requested, (unsigned long)s.used,
+		(unsigned long)s.reserved, s.chunks, (unsigned long)s.peakReserved, s.resets);
+}
+
+void SceneGraph::printCullStats(){
+	const CullStats &s = cullStats;
+	printf("Meshlets: %d of %d drawn; faces: %ld of %ld drawn (%.1f%% left out); %d models at a coarser level of detail%s\n",
+		s.meshletsDrawn, s.meshlets, s.facesDrawn, s.faces,
+		s.faces > 0 ? 100.0 * (s.faces - s.facesDrawn) / s.faces : 0.0,
+		s.coarseObjects, cullBackfaces ? ", backfaces culled" : "");
+}
 
 //basic data structure to act as scene graph
 void SceneGraph::init(){
@@ -14,63 +85,285 @@ void SceneGraph::init(){
 	showBB = -1; //keep track of which bounding volume to show
 	boolBB = true;
 	hitFlag = false; //keep track of whether the pick() hit a model
-	//myObjs[0] is the world
-	myObjs[1].FL = readPlyModel("data/trico.ply");
-	myObjs[1].FL->translate(-2.0, 0.0, 0.0);
-	//calcRitterBoundingSphere(myObjs[0]->center, &(myObjs[0]->radius), myObjs[0]);
-	myObjs[2].FL = readPlyModel("data/spider.ply");
-	myObjs[2].FL->translate(2.0, 0.0, 2.0);
-	myObjs[3].FL = readPlyModel("data/shark.ply");
-	myObjs[3].FL->translate(2.0, 4.0, 2.0);
-	myObjs[4].FL = readPlyModel("data/urn.ply");
-	myObjs[4].FL->translate(0.5, 1.0, 0.0);
-	myObjs[5].FL = readPlyModel("data/urn.ply");
-	myObjs[5].FL->translate(-2.0, -20.0, 2.0);
-	std::string myNames[6]={"World", "Trico", "Spider", "Shark", "Urn", "Test"};
-	for(int i = 0; i < numObj; i++){
-		calcRitterBoundingSphere(myObjs[i].FL->center, &(myObjs[i].FL->radius), myObjs[i].FL);
-		myObjs[i].BB.update(Vec3(myObjs[i].FL->center[0], myObjs[i].FL->center[1], myObjs[i].FL->center[2]), myObjs[i].FL->radius);
-	}
+	//the sphere is small and is needed for the very first frame
+	sphere = meshes.acquire("data/sphere.ply");
+	loader = new ThreadPool(0);
 
+	//myObjs[0] is the world
 	worldBB.update(Vec3(0,0,0), 10);
-	myObjs[0].init("World", worldBB, NULL);	//scene object that represents the world
+	myObjs[0].init("World", worldBB);	//scene object that represents the world
 	for(int n = 1; n < numObj; n++){			//All objects begin as children of World
-		myObjs[n].init(myNames[n], myObjs[n].BB, myObjs[n].FL);
+		const SceneModel &m = sceneModels[n-1];
+		BBox bb;
+		//readPlyModel scales every model to fit a unit sphere, so that
+		//is the model's bounding sphere until the real one is known
+		bb.update(Vec3(m.x, m.y, m.z), 1.0);
+		myObjs[n].init(m.name, bb);
+		myObjs[n].position = Vec3(m.x, m.y, m.z);
+		myObjs[n].sphereMethod = m.sphere;
+		myObjs[n].refreshBounds();
 		myObjs[0].addChild(&myObjs[n]);
 		myObjs[n].addParent(&myObjs[0]);
+		loadAsync(n, m.filename);
 	}
 }
 
+//splits of a progressive mesh handed over at a time while it streams in
+static const int splitsPerHandoff = 256;
+
+//load a model on a loader thread; collectLoads() hands it to myObjs[obj]
+//a progressive mesh saved by an earlier load comes first, its base and then
+//its splits, so the model is drawn coarse and fills in before the rest is read
+void SceneGraph::loadAsync(int obj, const char *filename){
+	HandoffQueue<LoadedMesh> *done = &loadedMeshes;
+	MeshRegistry *registry = &meshes;
+	loader->submit([=](){
+		std::string path = progressiveMeshPath(filename);
+		uint64_t key;
+		bool keyed = plyLoadOptions().useCache && plyLoadOptions().optimize && plyCacheKey(filename, &key);
+		bool streamed = false;
+		if(keyed){
+			ProgressiveMeshReader reader;
+			ProgressiveMesh *pm = reader.open(path.c_str(), key);
+			streamed = pm != NULL;
+			while(pm != NULL){
+				LoadedMesh part;
+				part.obj = obj;
+				part.progressive = pm;
+				done->push(std::move(part));
+				pm = reader.readSplits(splitsPerHandoff);
+			}
+		}
+		LoadedMesh m;
+		m.obj = obj;
+		m.mesh = registry->acquire(filename);
+		m.progressive = NULL;
+		//a first load saves the progressive mesh with the bake; make one if it did not
+		if(!streamed && plyLoadOptions().optimize){
+			ProgressiveMeshReader reader;
+			m.progressive = keyed ? reader.open(path.c_str(), key) : NULL;
+			if(m.progressive == NULL){
+				m.progressive = buildProgressiveMesh(m.mesh.get());
+				if(keyed){
+					writeProgressiveMesh(path.c_str(), key, m.progressive);
+				}
+			}else if(ProgressiveMesh *more = reader.readSplits(reader.remaining())){
+				m.progressive->append(*more);
+				delete more;
+			}
+		}
+		done->push(std::move(m));
+	});
+}
+
+//pick up models that finished loading since the last frame
+void SceneGraph::collectLoads(){
+	loadedMeshes.drain([this](LoadedMesh &m){
+		SceneObj &o = myObjs[m.obj];
+		if(m.progressive != NULL){
+			o.addProgressive(m.progressive);
+		}
+		if(m.mesh){
+			o.setMesh(std::move(m.mesh));
+		}
+		o.refreshBounds();
+	});
+}
+
 void SceneGraph::drawBoundingSphere(Vec3 center, float s){
-	FaceList *sphere = readPlyModel("data/sphere.ply");
-	sphere -> translate(center[0], center[1], center[2]);
-	sphere -> scale(s);
-	sphere -> drawSphere(); 
+	setVertexFormat(NULL);
+	sphere -> drawSphere(center[0], center[1], center[2], s); 
 }
 
+//keep each object's BB on its model; see SceneObj::refreshBounds()
 void SceneGraph::updatePly(){
 	for(int p = 1; p<numObj; p++){
-		calcRitterBoundingSphere(myObjs[p].FL->center, &(myObjs[p].FL->radius), myObjs[p].FL);
+		myObjs[p].refreshBounds();
 	}
 }
 
 void SceneGraph::draw(Vec3 centerPosition, Vec3 eyePosition, Vec3 upVector, Mat4 modelViewMatrix){
+	cullStats = CullStats();
 	for(int p = 1; p <numObj; p++){
-		if(myObjs[p].draw)
-		{
-			myObjs[p].FL->draw();//call FaceList draw() function
+		const FaceList *fl = myObjs[p].FL;
+		ProgressiveMesh *pm = myObjs[p].progressive;
+		if(fl != NULL){
+			cullStats.faces += fl->fc;
+		}else if(pm != NULL){
+			cullStats.faces += pm->faces.size() / 3;
+		}
+		if(!myObjs[p].draw){
+			continue;
+		}
+		if(fl == NULL && pm == NULL){
+			//still loading; stand in with its bounding sphere, which is in world space
+			setModelView(modelViewMatrix);
+			drawBoundingSphere(myObjs[p].BB.center, myObjs[p].BB.width);
+		}else{
+			//place the model with its own transform
+			Mat4 model = myObjs[p].modelMatrix();
+			Vec4 eye = model.inverse() * Vec4(eyePosition[0], eyePosition[1], eyePosition[2], 1);
+			Vec3 modelEye(eye[0], eye[1], eye[2]);
+			Mat4 modelViewProjection = projectionMatrix * modelViewMatrix * model;
+			setModelView(modelViewMatrix * model);
+			if(fl == NULL){
+				//still loading; draw the progressive mesh as far as it has arrived
+				drawProgressive(pm, chooseSplits(pm, modelEye), modelViewProjection);
+				continue;
+			}
+			//near enough to need half the faces, culling meshlets leaves out more than refining does
+			if(lodMode == LOD_PROGRESSIVE && pm != NULL){
+				pm->refine(chooseSplits(pm, modelEye));
+				if(pm->faceCount() * 2 <= fl->fc){
+					drawProgressive(pm, pm->appliedSplits(), modelViewProjection);
+				}else{
+					drawMeshlets(fl, modelViewProjection, modelEye);
+				}
+				continue;
+			}
+			int level = chooseLod(fl, modelEye);
+			if(level > 0){
+				drawLod(fl, level, modelViewProjection);
+			}else{
+				drawMeshlets(fl, modelViewProjection, modelEye);
+			}
 		}
-		myObjs[p].BB.update(Vec3(myObjs[p].FL->center[0], myObjs[p].FL->center[1], myObjs[p].FL->center[2]), myObjs[p].FL->radius);
+	}
+	setModelView(modelViewMatrix);
+	//whatever is drawn next is not packed
+	setVertexFormat(NULL);
+}
+
+//pixels on screen per unit of model space at the nearest point of a bounding sphere,
+//or 0 if the eye is inside it; eye is in model space
+float SceneGraph::screenScale(const double *center, double radius, Vec3 eye){
+	float dx = eye[0] - center[0];
+	float dy = eye[1] - center[1];
+	float dz = eye[2] - center[2];
+	float nearest = sqrt(dx*dx + dy*dy + dz*dz) - radius;
+	if(nearest <= 0 || viewportHeight <= 0){
+		return 0;
+	}
+	//projectionMatrix(1, 1) is cot(fovy / 2): a length of 1 at distance 1 spans half the viewport
+	return projectionMatrix(1, 1) * viewportHeight / (2 * nearest);
+}
+
+//the coarsest level of detail of fl that stays within lodPixels of the model on screen; eye is in fl's model space
+int SceneGraph::chooseLod(const FaceList *fl, Vec3 eye){
+	float pixels = lodMode != LOD_OFF ? screenScale(fl->center, fl->radius, eye) : 0;
+	if(pixels <= 0 || fl->lodCount == 0){
+		return 0;
+	}
+	int level = 0;
+	while(level < fl->lodCount && fl->lods[level].error * pixels <= lodPixels){
+		level++;
+	}
+	return level;
+}
+
+//the fewest splits of pm that keep it within lodPixels of the model on screen; eye is in pm's model space
+int SceneGraph::chooseSplits(const ProgressiveMesh *pm, Vec3 eye){
+	float pixels = lodMode == LOD_PROGRESSIVE ? screenScale(pm->center, pm->radius, eye) : 0;
+	if(pixels <= 0){
+		return pm->splits.size();
+	}
+	return pm->splitsFor(lodPixels / pixels);
+}
+
+//whether any of a bounding sphere given in model space is on screen
+bool SceneGraph::sphereVisible(const double *center, double radius, Mat4 modelViewProjection){
+	Meshlet whole = Meshlet();
+	for(int j = 0; j < 3; j++){
+		whole.center[j] = center[j];
+	}
+	whole.radius = radius;
+	whole.coneCutoff = 1;
+	return meshletVisible(whole, meshletFrustum(modelViewProjection, Vec3(0,0,0), false));
+}
+
+//draw a level of detail of fl, unless all of fl is off screen
+void SceneGraph::drawLod(const FaceList *fl, int level, Mat4 modelViewProjection){
+	if(!sphereVisible(fl->center, fl->radius, modelViewProjection)){
+		return;
+	}
+	setVertexFormat(fl);
+	fl->drawLod(level);
+	cullStats.coarseObjects++;
+	cullStats.facesDrawn += fl->lods[level-1].faceCount;
+}
+
+//draw pm with splits of its splits applied, unless all of it is off screen
+void SceneGraph::drawProgressive(ProgressiveMesh *pm, int splits, Mat4 modelViewProjection){
+	if(!sphereVisible(pm->center, pm->radius, modelViewProjection)){
+		return;
+	}
+	pm->refine(splits);
+	setVertexFormat(NULL);
+	pm->draw();
+	if(splits < (int)pm->splits.size()){
+		cullStats.coarseObjects++;
+	}
+	cullStats.facesDrawn += pm->faceCount();
+}
+
+//draw the meshlets of fl that pass culling; the matrix and eye are in fl's model space
+void SceneGraph::drawMeshlets(const FaceList *fl, Mat4 modelViewProjection, Vec3 eye){
+	setVertexFormat(fl);
+	if(fl->meshletCount == 0){
+		fl->draw();
+		cullStats.facesDrawn += fl->fc;
+		return;
+	}
+	MeshletFrustum frustum = meshletFrustum(modelViewProjection, eye, cullBackfaces);
+	//meshlets are in face order, so neighbouring visible ones are drawn together
+	int first = 0;
+	int count = 0;
+	for(int i = 0; i < fl->meshletCount; i++){
+		const Meshlet &m = fl->meshlets[i];
+		cullStats.meshlets++;
+		if(!meshletVisible(m, frustum)){
+			continue;
+		}
+		cullStats.meshletsDrawn++;
+		cullStats.facesDrawn += m.faceCount;
+		if(count > 0 && first + count == m.firstFace){
+			count += m.faceCount;
+		}else{
+			if(count > 0){
+				fl->drawFaces(first, count);
+			}
+			first = m.firstFace;
+			count = m.faceCount;
+		}
+	}
+	if(count > 0){
+		fl->drawFaces(first, count);
+	}
+}
+
+void SceneGraph::setModelView(Mat4 modelView){
+	Mat4 normalMatrix = modelView.inverse().transpose();
+	glUniformMatrix4fv(uModelViewMatrix, 1, false, modelView);
+	glUniformMatrix4fv(uNormalMatrix, 1, false, normalMatrix);
+}
+
+//tell the shader whether fl is drawn from packed vertices and how to decode them; NULL for full precision ones
+void SceneGraph::setVertexFormat(const FaceList *fl){
+	bool packed = fl != NULL && fl->packed != NULL;
+	glUniform1i(uPackedVertices, packed);
+	if(packed){
+		glUniform3fv(uPackScale, 1, fl->packScale);
+		glUniform3fv(uPackOffset, 1, fl->packOffset);
 	}
 }
 
 void SceneGraph::update(Vec3 centerPosition, Vec3 eyePosition, Vec3 upVector, Mat4 modelViewMatrix){
-	float dist;
-	//check for collisions
+	collectLoads();
+	//check for collisions; the boxes rule out spheres that only touch past the ends of long models,
+	//and the hulls, when used, boxes that only overlap past the models' corners
 	for(int x = 1; x < numObj; x++){
 		for(int y = x+1; y < numObj; y++){
-			dist = distance(myObjs[x].BB.center, myObjs[y].BB.center);
-			if(dist<=(float(myObjs[x].BB.width+ myObjs[y].BB.width))){
+			if(myObjs[x].collides(myObjs[y], useHulls)){
 				if(myObjs[x].BB.width > myObjs[y].BB.width){
 					//myObjs[x].BB is larger and will become the parent
 					//but first we have to make sure the smaller obj doesn't already have a parent
@@ -120,12 +413,20 @@ void SceneGraph::testPar(){
 }
 
 void SceneGraph::translate(SceneObj *s, float x, float y){
-	s->FL->translate(x,y,0);
+	s->position += Vec3(x,y,0);
+	s->transformChanged();
 	for(int n = 0; n < s->numChildren; n++){
-		s->children[n]->FL->translate(x,y,0);
+		s->children[n]->position += Vec3(x,y,0);
+		s->children[n]->transformChanged();
 	}
 }
 
+//rotate the object's model about its own center; angle is in radians
+void SceneGraph::rotate(SceneObj *s, Vec3 axis, float angle){
+	s->rotation = ::rotate(radiansToDegrees(angle), normalize(axis)) * s->rotation;
+	s->transformChanged();
+}
+
 void SceneGraph::drawSphere(float radius, int slices, int stacks, double x, double y, double z){
 	GLUquadricObj *quadObj;
 	quadObj = gluNewQuadric();
@@ -10,6 +10,11 @@
 #include "PlyModel.h"
 #include "SceneObj.h"
 #include "BBox.h"
+#include "ThreadPool.h"
+#include "HandoffQueue.h"
+#include "Arena.h"
+#include "MeshRegistry.h"
+#include "Meshlets.h"
 #include <cmath>
 
 const int numObj = 5;
@@ -17,6 +22,29 @@ const int numObj = 5;
 #ifndef Included_SceneGraph_H
 #define Included_SceneGraph_H
 
+//a model finished on a loader thread, waiting to be picked up by the main thread
+struct LoadedMesh{
+	int obj;
+	MeshHandle mesh;	//empty while only the progressive mesh has arrived
+	ProgressiveMesh *progressive;	//the base of obj's progressive mesh, its next splits, or NULL
+};
+
+//how models that are small on screen are simplified
+enum LodMode{
+	LOD_OFF,	//always the whole model
+	LOD_LEVELS,	//the coarsest of the fixed levels of detail that is close enough
+	LOD_PROGRESSIVE	//as many splits of the progressive mesh as it takes to be close enough, or the levels without one
+};
+
+//what meshlet culling left out of the last frame
+struct CullStats{
+	int meshlets;	//meshlets of the objects that were drawn
+	int meshletsDrawn;
+	long faces;	//faces of every loaded object
+	long facesDrawn;
+	int coarseObjects;	//objects drawn at a coarser level of detail
+};
+
 class SceneGraph{
 	public:
 	//basic data structure to act as scene graph
@@ -24,13 +52,47 @@ class SceneGraph{
 	SceneObj myObjs[numObj];
 	BBox worldBB;
 
+	Arena arena;	//all mesh memory of the scene, freed in one go by clear()
+	MeshRegistry meshes;	//the scene's models, loaded into arena
+
+	ThreadPool *loader;	//loads models in the background
+	HandoffQueue<LoadedMesh> loadedMeshes;	//finished models for the main thread
+	MeshHandle sphere;	//unit sphere for bounding volumes and models still loading
+
 	int showBB; //keep track of which bounding volume to show
 	int selectedObj;
 	bool boolBB; //A switch used when toggling bounding volumes on/off
 	bool hitFlag; //keep track of weather the pick() hit a model
+	int uModelViewMatrix;	//shader uniforms set per object in draw()
+	int uNormalMatrix;
+	int uPackedVertices;	//how the shader decodes packed vertices, set in setVertexFormat()
+	int uPackScale;
+	int uPackOffset;
+	Mat4 projectionMatrix;	//the camera's, for culling meshlets
+	bool cullBackfaces;	//also cull meshlets facing away; only safe for closed, outward wound models
+	bool useHulls;	//also test the models' convex hulls when culling and checking for collisions
+	CullStats cullStats;
+	LodMode lodMode;	//draw models that are small on screen at a coarser level of detail
+	float lodPixels;	//the most a level of detail may differ from the model, in pixels
+	int viewportHeight;	//in pixels, for lodPixels
+
+	SceneGraph();
+
+	~SceneGraph();
 
 	void init();
 
+	void clear();
+
+	void printMemoryStats();
+
+	void printCullStats();
+
+	void loadAsync(int obj, const char *filename);
+
+	void collectLoads();
+
+
 	void drawBoundingSphere(Vec3 center, float s);
 
 	void updatePly();
@@ -39,6 +101,24 @@ class SceneGraph{
 
 	void draw(Vec3 centerPosition, Vec3 eyePosition, Vec3 upVector, Mat4 modelViewMatrix);
 
+	void setModelView(Mat4 modelView);
+
+	void setVertexFormat(const FaceList *fl);
+
+	void drawMeshlets(const FaceList *fl, Mat4 modelViewProjection, Vec3 eye);
+
+	float screenScale(const double *center, double radius, Vec3 eye);
+
+	int chooseLod(const FaceList *fl, Vec3 eye);
+
+	int chooseSplits(const ProgressiveMesh *pm, Vec3 eye);
+
+	bool sphereVisible(const double *center, double radius, Mat4 modelViewProjection);
+
+	void drawLod(const FaceList *fl, int level, Mat4 modelViewProjection);
+
+	void drawProgressive(ProgressiveMesh *pm, int splits, Mat4 modelViewProjection);
+
 	void update(Vec3 centerPosition, Vec3 eyePosition, Vec3 upVector, Mat4 modelViewMatrix);
 
 	float distance(Vec3 a, Vec3 b);
@@ -47,6 +127,8 @@ class SceneGraph{
 
 	void translate(SceneObj *s, float x, float y);
 
+	void rotate(SceneObj *s, Vec3 axis, float angle);
+
 	void drawSphere(float radius, int slices, int stacks, double x, double y, double z);
 };
 #endif
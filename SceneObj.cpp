@@ -7,15 +7,174 @@
 //////////////////////////////////////////////////////////////////
 
 #include "SceneObj.h"
+#include <algorithm>
+#include <utility>
 
 //basic data structure to act as objects in scene graph
-void SceneObj::init(std::string n, BBox bb, FaceList *fl){
+void SceneObj::init(std::string n, BBox bb){
 	name = n;
 	parent = NULL;
 	numChildren = 0;
 	BB = bb;
-	FL = fl;
+	FL = NULL;
+	progressive = NULL;
 	draw = true;
+	position = Vec3(0,0,0);
+	rotation.identity();
+	scale = 1.0f;
+	//models are scaled to fit a unit sphere, so that stands in until the model is there
+	localCenter = Vec3(0,0,0);
+	localRadius = 1.0f;
+	localBox = BBox();
+	localMin = Vec3(-1,-1,-1);
+	localMax = Vec3(1,1,1);
+	sphereMethod = RITTER_SPHERE;
+	boundsSource = NULL;
+	boundsVersion = 0;
+	boundsMoved = true;
+}
+
+//share mesh; the handle is passed along, the mesh itself is never copied
+void SceneObj::setMesh(MeshHandle mesh){
+	sharedFL = std::move(mesh);
+	FL = sharedFL.get();
+}
+
+//take pm, or the next splits of the one already set
+void SceneObj::addProgressive(ProgressiveMesh *pm){
+	if(progressive == NULL){
+		progressive = pm;
+		return;
+	}
+	progressive->append(*pm);
+	delete pm;
+}
+
+void SceneObj::releaseMesh(){
+	delete progressive;
+	sharedFL.reset();
+	progressive = NULL;
+	boundsSource = NULL;
+	FL = NULL;
+}
+
+//the model's center, about which it is rotated and scaled
+Vec3 SceneObj::pivot(){
+	if(FL == NULL){
+		//the base of a progressive mesh is drawn while the rest loads
+		if(progressive != NULL){
+			return Vec3(progressive->center[0], progressive->center[1], progressive->center[2]);
+		}
+		return Vec3(0,0,0);
+	}
+	return Vec3(FL->center[0], FL->center[1], FL->center[2]);
+}
+
+//model space to world space; the mesh is drawn through this instead of
+//having its vertices moved, so editing the transform costs the same for
+//any size of mesh
+Mat4 SceneObj::modelMatrix(){
+	Vec3 c = pivot();
+	return translate(position + c) * rotation * ::scale(scale) * translate(-c);
+}
+
+Vec3 SceneObj::toWorld(Vec3 p){
+	Vec4 w = modelMatrix() * Vec4(p[0], p[1], p[2], 1);
+	return Vec3(w[0], w[1], w[2]);
+}
+
+//BB from a sphere given in model space, localBox and the box from localMin to
+//localMax; rotation keeps the sphere's radius, and the boxes only need the
+//transform, so none of them reads a vertex
+void SceneObj::updateBounds(Vec3 localCenter, float localRadius){
+	Mat4 model = modelMatrix();
+	BB.update(toWorld(localCenter), localRadius * fabs(scale));
+	BB.orient(localBox, model, scale);
+	BB.enclose(localMin, localMax, model);
+}
+
+//whether the object is wholly on the side of the plane that normal points to;
+//with useHull the model's convex hull is tried once BB is not enough
+bool SceneObj::outside(Vec3 normal, Vec3 point, bool useHull){
+	if(BB.outside(normal, point)){
+		return true;
+	}
+	return useHull && FL != NULL && hullOutside(FL, modelMatrix(), normal, point);
+}
+
+//whether the object meets other; with useHull the hulls rule out boxes that only
+//overlap where neither model is
+bool SceneObj::collides(SceneObj &other, bool useHull){
+	if(!BB.overlaps(other.BB)){
+		return false;
+	}
+	if(!useHull || FL == NULL || other.FL == NULL){
+		return true;
+	}
+	return hullsIntersect(FL, modelMatrix(), other.FL, other.modelMatrix());
+}
+
+//call after changing position, rotation or scale
+void SceneObj::transformChanged(){
+	boundsMoved = true;
+}
+
+//bring BB up to date; the vertices are only read again after they were edited,
+//and a new transform only moves the sphere, so an object that did not change costs nothing
+//the sphere FL keeps is a Ritter sphere, so the smallest one is always found from the vertices
+void SceneObj::refreshBounds(){
+	const void *source = FL != NULL ? (const void*)FL : (const void*)progressive;
+	unsigned int version = FL != NULL ? FL->version : 0;
+	if(source != boundsSource || version != boundsVersion){
+		if(FL != NULL && (!FL->boundsCurrent() || sphereMethod != RITTER_SPHERE)){
+			double center[3], radius;
+			calcBoundingSphere(center, &radius, FL, sphereMethod);
+			localCenter = Vec3(center[0], center[1], center[2]);
+			localRadius = radius;
+		}else if(FL != NULL){
+			localCenter = Vec3(FL->center[0], FL->center[1], FL->center[2]);
+			localRadius = FL->radius;
+		}else if(progressive != NULL){
+			localCenter = Vec3(progressive->center[0], progressive->center[1], progressive->center[2]);
+			localRadius = progressive->radius;
+		}else{
+			localCenter = Vec3(0,0,0);
+			localRadius = 1.0f;
+		}
+		if(FL != NULL){
+			double boxMin[3], boxMax[3];
+			if(FL->boundsCurrent()){
+				std::copy(FL->boxMin, FL->boxMin + 3, boxMin);
+				std::copy(FL->boxMax, FL->boxMax + 3, boxMax);
+			}else{
+				calcBoundingBox(boxMin, boxMax, FL);
+			}
+			localMin = Vec3(boxMin[0], boxMin[1], boxMin[2]);
+			localMax = Vec3(boxMax[0], boxMax[1], boxMax[2]);
+		}else{
+			//the box around the sphere until there are vertices to fit
+			localMin = localCenter - Vec3(localRadius, localRadius, localRadius);
+			localMax = localCenter + Vec3(localRadius, localRadius, localRadius);
+		}
+		//only the whole model is fitted; the base of a progressive mesh goes by the sphere
+		localBox.align(FL);
+		boundsSource = source;
+		boundsVersion = version;
+		boundsMoved = true;
+	}
+	if(boundsMoved){
+		updateBounds(localCenter, localRadius);
+		boundsMoved = false;
+	}
+}
+
+//find the sphere again with method at the next refreshBounds()
+void SceneObj::setSphereMethod(BoundingSphereMethod method){
+	if(method != sphereMethod){
+		sphereMethod = method;
+		boundsSource = NULL;
+		boundsVersion = 0;
+	}
 }
 
 void SceneObj::addParent(SceneObj *p){
@@ -8,6 +8,10 @@
 
 #include "GFXMath.h"
 #include "BBox.h"
+#include "MeshRegistry.h"
+#include "ProgressiveMesh.h"
+#include "PlyModel.h"
+#include "ConvexHull.h"
 #include <cmath>
 
 #ifndef Included_SceneObj_H
@@ -22,9 +26,47 @@ class SceneObj{
 	int numChildren;
 	BBox BB;
 	bool draw;
-	FaceList *FL = readPlyModel("data/trico.ply");
+	Vec3 position;	//where the model is placed in the world
+	Mat4 rotation;	//orientation of the model about its center
+	float scale;	//uniform scale of the model about its center
+	const FaceList *FL = NULL;	//model that is drawn, sharedFL's mesh
+	MeshHandle sharedFL;	//model shared with other objects through the registry
+	ProgressiveMesh *progressive = NULL;	//FL as a base mesh and vertex splits, for continuous detail
+	Vec3 localCenter;	//bounding sphere of the model in model space, which BB is made from
+	float localRadius;
+	Vec3 localMin;	//axis aligned box of the model in model space, which BB's axis aligned box is made from
+	Vec3 localMax;
+	BBox localBox;	//box turned to fit the model, in model space; BB's box is made from it
+	BoundingSphereMethod sphereMethod;	//how localCenter and localRadius are found from the vertices
+	const void *boundsSource;	//the mesh, and the version of its vertices, the sphere was found for
+	unsigned int boundsVersion;
+	bool boundsMoved;	//the transform changed since BB was last made
 
-	void init(std::string n, BBox bb, FaceList *fl);
+	void init(std::string n, BBox bb);
+
+	void setMesh(MeshHandle mesh);
+
+	void addProgressive(ProgressiveMesh *pm);
+
+	Vec3 pivot();
+
+	Mat4 modelMatrix();
+
+	Vec3 toWorld(Vec3 p);
+
+	void updateBounds(Vec3 localCenter, float localRadius);
+
+	void transformChanged();
+
+	void refreshBounds();
+
+	void setSphereMethod(BoundingSphereMethod method);
+
+	bool outside(Vec3 normal, Vec3 point, bool useHull);
+
+	bool collides(SceneObj &other, bool useHull);
+
+	void releaseMesh();
 
 	void addParent(SceneObj *p);
 
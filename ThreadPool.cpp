@@ -0,0 +1,107 @@
+/*
+ * ThreadPool
+ *
+ * A fixed set of worker threads fed from a single task queue.
+ */
+
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+
+ThreadPool::ThreadPool( int threadCount ) : _stopping(false){
+  if( threadCount < 1 ){
+    threadCount = hardwareThreads( );
+  }
+  for( int i = 0; i < threadCount; i++ ){
+    _workers.push_back(std::thread(&ThreadPool::workerLoop, this));
+  }
+}
+
+ThreadPool::~ThreadPool( ){
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _stopping = true;
+  }
+  _wake.notify_all( );
+  for( size_t i = 0; i < _workers.size( ); i++ ){
+    _workers[i].join( );
+  }
+}
+
+int ThreadPool::hardwareThreads( ){
+  int n = (int)std::thread::hardware_concurrency( );
+  return n > 0 ? n : 1;
+}
+
+void ThreadPool::submit( const std::function<void( )>& task ){
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _tasks.push_back(task);
+  }
+  _wake.notify_one( );
+}
+
+void ThreadPool::workerLoop( ){
+  for( ; ; ){
+    std::function<void( )> task;
+    {
+      std::unique_lock<std::mutex> lock(_mutex);
+      while( !_stopping && _tasks.empty( ) ){
+        _wake.wait(lock);
+      }
+      if( _tasks.empty( ) ){
+        return;
+      }
+      task = _tasks.front( );
+      _tasks.pop_front( );
+    }
+    task( );
+  }
+}
+
+/*
+ * Shared between the caller of parallelFor and the helpers it queues.
+ * Helpers may be dequeued after parallelFor has returned, so the state
+ * is reference counted rather than living on the caller's stack.
+ */
+struct ParallelForState{
+  std::function<void(int)> task;
+  int count;
+  std::atomic<int> next;
+  std::atomic<int> done;
+  std::mutex mutex;
+  std::condition_variable finished;
+};
+
+static void runParallelFor( const std::shared_ptr<ParallelForState>& state ){
+  int i;
+  while( (i = state->next++) < state->count ){
+    state->task(i);
+    if( ++state->done == state->count ){
+      std::lock_guard<std::mutex> lock(state->mutex);
+      state->finished.notify_all( );
+    }
+  }
+}
+
+void ThreadPool::parallelFor( int count, const std::function<void(int)>& task ){
+  if( count <= 0 ){
+    return;
+  }
+  std::shared_ptr<ParallelForState> state = std::make_shared<ParallelForState>( );
+  state->task = task;
+  state->count = count;
+  state->next = 0;
+  state->done = 0;
+  int helpers = std::min(size( ), count - 1);
+  for( int i = 0; i < helpers; i++ ){
+    submit(std::bind(runParallelFor, state));
+  }
+  runParallelFor(state);
+  std::unique_lock<std::mutex> lock(state->mutex);
+  while( state->done < count ){
+    state->finished.wait(lock);
+  }
+}
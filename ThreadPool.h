@@ -0,0 +1,50 @@
+/*
+ * ThreadPool
+ *
+ * A fixed set of worker threads fed from a single task queue.
+ */
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#ifndef _THREADPOOL_H_
+#define _THREADPOOL_H_
+
+class ThreadPool{
+public:
+  // threadCount < 1 means one worker per hardware thread
+  explicit ThreadPool( int threadCount );
+  ~ThreadPool( );
+
+  int size( ) const { return (int)_workers.size( ); }
+
+  // Queue task to run on a worker thread.
+  void submit( const std::function<void( )>& task );
+
+  /*
+   * Run task(i) for every i in [0, count) and return once all of them
+   * have finished. The calling thread works through the indices too, so
+   * this may safely be called from inside a task running on the pool.
+   */
+  void parallelFor( int count, const std::function<void(int)>& task );
+
+  static int hardwareThreads( );
+
+private:
+  ThreadPool( const ThreadPool& );
+  ThreadPool& operator =( const ThreadPool& );
+
+  void workerLoop( );
+
+  std::vector<std::thread> _workers;
+  std::deque< std::function<void( )> > _tasks;
+  std::mutex _mutex;
+  std::condition_variable _wake;
+  bool _stopping;
+};
+
+#endif
@@ -0,0 +1,363 @@
+/*
+ * VertexKernels
+ *
+ * Affine transforms of whole arrays of xyz rows.
+ *
+ * Every kernel computes m[0..2] * x + m[4..6] * y + m[8..10] * z +
+ * m[12..14] * w for each row. The SSE2 kernel does one row at a time
+ * with the matrix columns in registers; the AVX2 and AVX-512 ones do
+ * whole blocks of rows and leave what is left over to it. Those two use
+ * fused multiply-adds and may differ from the others in the last bit.
+ */
+
+#include "VertexKernels.h"
+
+#include <atomic>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define VERTEXKERNELS_X86 1
+#include <immintrin.h>
+#endif
+
+template <typename Real>
+static void transformRowsScalar( const Real *m, const Real (*in)[3], Real (*out)[3], int count, Real w ){
+  for( int i = 0; i < count; i++ ){
+    Real x = in[i][0];
+    Real y = in[i][1];
+    Real z = in[i][2];
+    for( int j = 0; j < 3; j++ ){
+      out[i][j] = m[j] * x + m[4 + j] * y + m[8 + j] * z + m[12 + j] * w;
+    }
+  }
+}
+
+#ifdef VERTEXKERNELS_X86
+
+__attribute__((target("sse2")))
+static void transformRowsSse2( const double *m, const double (*in)[3], double (*out)[3], int count, double w ){
+  // x and y of the result in one register, z in the low lane of another
+  const __m128d c0 = _mm_loadu_pd(m);
+  const __m128d c1 = _mm_loadu_pd(m + 4);
+  const __m128d c2 = _mm_loadu_pd(m + 8);
+  const __m128d c3 = _mm_mul_pd(_mm_loadu_pd(m + 12), _mm_set1_pd(w));
+  const __m128d z0 = _mm_load_sd(m + 2);
+  const __m128d z1 = _mm_load_sd(m + 6);
+  const __m128d z2 = _mm_load_sd(m + 10);
+  const __m128d z3 = _mm_set_sd(m[14] * w);
+  for( int i = 0; i < count; i++ ){
+    __m128d x = _mm_set1_pd(in[i][0]);
+    __m128d y = _mm_set1_pd(in[i][1]);
+    __m128d z = _mm_set1_pd(in[i][2]);
+    __m128d xy = _mm_add_pd(_mm_add_pd(_mm_mul_pd(c0, x), _mm_mul_pd(c1, y)), _mm_add_pd(_mm_mul_pd(c2, z), c3));
+    __m128d zz = _mm_add_sd(_mm_add_sd(_mm_mul_sd(z0, x), _mm_mul_sd(z1, y)), _mm_add_sd(_mm_mul_sd(z2, z), z3));
+    _mm_storeu_pd(out[i], xy);
+    _mm_store_sd(&out[i][2], zz);
+  }
+}
+
+__attribute__((target("sse2")))
+static void transformRowsSse2( const float *m, const float (*in)[3], float (*out)[3], int count, float w ){
+  const __m128 c0 = _mm_setr_ps(m[0], m[1], m[2], 0.0f);
+  const __m128 c1 = _mm_setr_ps(m[4], m[5], m[6], 0.0f);
+  const __m128 c2 = _mm_setr_ps(m[8], m[9], m[10], 0.0f);
+  const __m128 c3 = _mm_setr_ps(m[12] * w, m[13] * w, m[14] * w, 0.0f);
+  for( int i = 0; i < count; i++ ){
+    __m128 x = _mm_set1_ps(in[i][0]);
+    __m128 y = _mm_set1_ps(in[i][1]);
+    __m128 z = _mm_set1_ps(in[i][2]);
+    __m128 r = _mm_add_ps(_mm_add_ps(_mm_mul_ps(c0, x), _mm_mul_ps(c1, y)), _mm_add_ps(_mm_mul_ps(c2, z), c3));
+    _mm_storel_pi((__m64*)out[i], r);
+    _mm_store_ss(&out[i][2], _mm_movehl_ps(r, r));
+  }
+}
+
+/*
+ * The AVX2 and AVX-512 kernels work on blocks of as many rows as a
+ * register has lanes; the 3 values per row then fill exactly three
+ * registers. Each block is pulled apart into one register of x, one of
+ * y and one of z, transformed with nine multiply-adds and put back
+ * together the same way, with no loads or stores of single values.
+ * They return how many rows they did, a whole number of blocks, and
+ * leave the rest to transformRowsSse2.
+ */
+
+__attribute__((target("avx2,fma")))
+static int transformBlocksAvx2( const float *m, const float *p, float *q, int count, float w ){
+  __m256 a[3][4];
+  for( int c = 0; c < 3; c++ ){
+    for( int k = 0; k < 3; k++ ){
+      a[c][k] = _mm256_set1_ps(m[4 * k + c]);
+    }
+    a[c][3] = _mm256_set1_ps(m[12 + c] * w);
+  }
+  int blocks = count / 8;
+  for( int b = 0; b < blocks; b++, p += 24, q += 24 ){
+    // Rows 0-3 in the low halves and 4-7 in the high ones, so the
+    // shuffles never have to cross between halves
+    __m256 r03 = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(p)), _mm_loadu_ps(p + 12), 1);
+    __m256 r14 = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(p + 4)), _mm_loadu_ps(p + 16), 1);
+    __m256 r25 = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(p + 8)), _mm_loadu_ps(p + 20), 1);
+    __m256 xy = _mm256_shuffle_ps(r14, r25, _MM_SHUFFLE(2, 1, 3, 2));
+    __m256 yz = _mm256_shuffle_ps(r03, r14, _MM_SHUFFLE(1, 0, 2, 1));
+    __m256 x = _mm256_shuffle_ps(r03, xy, _MM_SHUFFLE(2, 0, 3, 0));
+    __m256 y = _mm256_shuffle_ps(yz, xy, _MM_SHUFFLE(3, 1, 2, 0));
+    __m256 z = _mm256_shuffle_ps(yz, r25, _MM_SHUFFLE(3, 0, 3, 1));
+
+    __m256 tx = _mm256_fmadd_ps(a[0][0], x, _mm256_fmadd_ps(a[0][1], y, _mm256_fmadd_ps(a[0][2], z, a[0][3])));
+    __m256 ty = _mm256_fmadd_ps(a[1][0], x, _mm256_fmadd_ps(a[1][1], y, _mm256_fmadd_ps(a[1][2], z, a[1][3])));
+    __m256 tz = _mm256_fmadd_ps(a[2][0], x, _mm256_fmadd_ps(a[2][1], y, _mm256_fmadd_ps(a[2][2], z, a[2][3])));
+
+    __m256 rxy = _mm256_shuffle_ps(tx, ty, _MM_SHUFFLE(2, 0, 2, 0));
+    __m256 ryz = _mm256_shuffle_ps(ty, tz, _MM_SHUFFLE(3, 1, 3, 1));
+    __m256 rzx = _mm256_shuffle_ps(tz, tx, _MM_SHUFFLE(3, 1, 2, 0));
+    r03 = _mm256_shuffle_ps(rxy, rzx, _MM_SHUFFLE(2, 0, 2, 0));
+    r14 = _mm256_shuffle_ps(ryz, rxy, _MM_SHUFFLE(3, 1, 2, 0));
+    r25 = _mm256_shuffle_ps(rzx, ryz, _MM_SHUFFLE(3, 1, 3, 1));
+    _mm_storeu_ps(q, _mm256_castps256_ps128(r03));
+    _mm_storeu_ps(q + 4, _mm256_castps256_ps128(r14));
+    _mm_storeu_ps(q + 8, _mm256_castps256_ps128(r25));
+    _mm_storeu_ps(q + 12, _mm256_extractf128_ps(r03, 1));
+    _mm_storeu_ps(q + 16, _mm256_extractf128_ps(r14, 1));
+    _mm_storeu_ps(q + 20, _mm256_extractf128_ps(r25, 1));
+  }
+  return blocks * 8;
+}
+
+__attribute__((target("avx2,fma")))
+static int transformBlocksAvx2( const double *m, const double *p, double *q, int count, double w ){
+  __m256d a[3][4];
+  for( int c = 0; c < 3; c++ ){
+    for( int k = 0; k < 3; k++ ){
+      a[c][k] = _mm256_set1_pd(m[4 * k + c]);
+    }
+    a[c][3] = _mm256_set1_pd(m[12 + c] * w);
+  }
+  int blocks = count / 4;
+  for( int b = 0; b < blocks; b++, p += 12, q += 12 ){
+    // x0 y0 z0 x1 | y1 z1 x2 y2 | z2 x3 y3 z3
+    __m256d r0 = _mm256_loadu_pd(p);
+    __m256d r1 = _mm256_loadu_pd(p + 4);
+    __m256d r2 = _mm256_loadu_pd(p + 8);
+    // Blending leaves each component in a fixed order, x0 x3 x2 x1,
+    // y1 y0 y3 y2 and z2 z1 z0 z3, which one permute sorts out; each of
+    // the permutes is its own inverse
+    __m256d x = _mm256_permute4x64_pd(_mm256_blend_pd(_mm256_blend_pd(r0, r1, 0x4), r2, 0x2), _MM_SHUFFLE(1, 2, 3, 0));
+    __m256d y = _mm256_permute4x64_pd(_mm256_blend_pd(_mm256_blend_pd(r0, r1, 0x9), r2, 0x4), _MM_SHUFFLE(2, 3, 0, 1));
+    __m256d z = _mm256_permute4x64_pd(_mm256_blend_pd(_mm256_blend_pd(r0, r1, 0x2), r2, 0x9), _MM_SHUFFLE(3, 0, 1, 2));
+
+    __m256d tx = _mm256_fmadd_pd(a[0][0], x, _mm256_fmadd_pd(a[0][1], y, _mm256_fmadd_pd(a[0][2], z, a[0][3])));
+    __m256d ty = _mm256_fmadd_pd(a[1][0], x, _mm256_fmadd_pd(a[1][1], y, _mm256_fmadd_pd(a[1][2], z, a[1][3])));
+    __m256d tz = _mm256_fmadd_pd(a[2][0], x, _mm256_fmadd_pd(a[2][1], y, _mm256_fmadd_pd(a[2][2], z, a[2][3])));
+
+    tx = _mm256_permute4x64_pd(tx, _MM_SHUFFLE(1, 2, 3, 0));
+    ty = _mm256_permute4x64_pd(ty, _MM_SHUFFLE(2, 3, 0, 1));
+    tz = _mm256_permute4x64_pd(tz, _MM_SHUFFLE(3, 0, 1, 2));
+    _mm256_storeu_pd(q, _mm256_blend_pd(_mm256_blend_pd(tx, ty, 0x2), tz, 0x4));
+    _mm256_storeu_pd(q + 4, _mm256_blend_pd(_mm256_blend_pd(ty, tz, 0x2), tx, 0x4));
+    _mm256_storeu_pd(q + 8, _mm256_blend_pd(_mm256_blend_pd(tz, tx, 0x2), ty, 0x4));
+  }
+  return blocks * 4;
+}
+
+/*
+ * AVX-512 permutes can pick lanes from any two registers, and write only
+ * the lanes set in a mask, so a block is taken apart with two permutes
+ * per register. For a block of L rows, component c takes its lanes
+ * from registers 0 and 1 by gather[c] and then those in gatherMask[c]
+ * from register 2 by the low bits of the same indices; scatter and
+ * scatterMask put register j back together from x and y and then z.
+ */
+template <int L, typename Index>
+struct RowShuffle{
+  Index gather[3][L];
+  unsigned int gatherMask[3];
+  Index scatter[3][L];
+  unsigned int scatterMask[3];
+
+  RowShuffle( ){
+    for( int i = 0; i < 3; i++ ){
+      gatherMask[i] = 0;
+      scatterMask[i] = 0;
+      for( int v = 0; v < L; v++ ){
+        int k = 3 * v + i;
+        gather[i][v] = k % (2 * L);
+        if( k >= 2 * L ){
+          gatherMask[i] |= 1u << v;
+        }
+        k = i * L + v;
+        scatter[i][v] = k / 3 + (k % 3 == 1 ? L : 0);
+        if( k % 3 == 2 ){
+          scatterMask[i] |= 1u << v;
+        }
+      }
+    }
+  }
+};
+
+__attribute__((target("avx512f")))
+static int transformBlocksAvx512( const float *m, const float *p, float *q, int count, float w ){
+  static const RowShuffle<16, int> s;
+  __m512i gather[3], scatter[3];
+  __mmask16 gatherMask[3], scatterMask[3];
+  __m512 a[3][4];
+  for( int c = 0; c < 3; c++ ){
+    gather[c] = _mm512_loadu_si512(s.gather[c]);
+    scatter[c] = _mm512_loadu_si512(s.scatter[c]);
+    gatherMask[c] = (__mmask16)s.gatherMask[c];
+    scatterMask[c] = (__mmask16)s.scatterMask[c];
+    for( int k = 0; k < 3; k++ ){
+      a[c][k] = _mm512_set1_ps(m[4 * k + c]);
+    }
+    a[c][3] = _mm512_set1_ps(m[12 + c] * w);
+  }
+  int blocks = count / 16;
+  for( int b = 0; b < blocks; b++, p += 48, q += 48 ){
+    __m512 r0 = _mm512_loadu_ps(p);
+    __m512 r1 = _mm512_loadu_ps(p + 16);
+    __m512 r2 = _mm512_loadu_ps(p + 32);
+    __m512 xyz[3];
+    for( int c = 0; c < 3; c++ ){
+      xyz[c] = _mm512_mask_permutexvar_ps(_mm512_permutex2var_ps(r0, gather[c], r1), gatherMask[c], gather[c], r2);
+    }
+    __m512 tx = _mm512_fmadd_ps(a[0][0], xyz[0], _mm512_fmadd_ps(a[0][1], xyz[1], _mm512_fmadd_ps(a[0][2], xyz[2], a[0][3])));
+    __m512 ty = _mm512_fmadd_ps(a[1][0], xyz[0], _mm512_fmadd_ps(a[1][1], xyz[1], _mm512_fmadd_ps(a[1][2], xyz[2], a[1][3])));
+    __m512 tz = _mm512_fmadd_ps(a[2][0], xyz[0], _mm512_fmadd_ps(a[2][1], xyz[1], _mm512_fmadd_ps(a[2][2], xyz[2], a[2][3])));
+    for( int j = 0; j < 3; j++ ){
+      _mm512_storeu_ps(q + 16 * j, _mm512_mask_permutexvar_ps(_mm512_permutex2var_ps(tx, scatter[j], ty), scatterMask[j], scatter[j], tz));
+    }
+  }
+  return blocks * 16;
+}
+
+__attribute__((target("avx512f")))
+static int transformBlocksAvx512( const double *m, const double *p, double *q, int count, double w ){
+  static const RowShuffle<8, long long> s;
+  __m512i gather[3], scatter[3];
+  __mmask8 gatherMask[3], scatterMask[3];
+  __m512d a[3][4];
+  for( int c = 0; c < 3; c++ ){
+    gather[c] = _mm512_loadu_si512(s.gather[c]);
+    scatter[c] = _mm512_loadu_si512(s.scatter[c]);
+    gatherMask[c] = (__mmask8)s.gatherMask[c];
+    scatterMask[c] = (__mmask8)s.scatterMask[c];
+    for( int k = 0; k < 3; k++ ){
+      a[c][k] = _mm512_set1_pd(m[4 * k + c]);
+    }
+    a[c][3] = _mm512_set1_pd(m[12 + c] * w);
+  }
+  int blocks = count / 8;
+  for( int b = 0; b < blocks; b++, p += 24, q += 24 ){
+    __m512d r0 = _mm512_loadu_pd(p);
+    __m512d r1 = _mm512_loadu_pd(p + 8);
+    __m512d r2 = _mm512_loadu_pd(p + 16);
+    __m512d xyz[3];
+    for( int c = 0; c < 3; c++ ){
+      xyz[c] = _mm512_mask_permutexvar_pd(_mm512_permutex2var_pd(r0, gather[c], r1), gatherMask[c], gather[c], r2);
+    }
+    __m512d tx = _mm512_fmadd_pd(a[0][0], xyz[0], _mm512_fmadd_pd(a[0][1], xyz[1], _mm512_fmadd_pd(a[0][2], xyz[2], a[0][3])));
+    __m512d ty = _mm512_fmadd_pd(a[1][0], xyz[0], _mm512_fmadd_pd(a[1][1], xyz[1], _mm512_fmadd_pd(a[1][2], xyz[2], a[1][3])));
+    __m512d tz = _mm512_fmadd_pd(a[2][0], xyz[0], _mm512_fmadd_pd(a[2][1], xyz[1], _mm512_fmadd_pd(a[2][2], xyz[2], a[2][3])));
+    for( int j = 0; j < 3; j++ ){
+      _mm512_storeu_pd(q + 8 * j, _mm512_mask_permutexvar_pd(_mm512_permutex2var_pd(tx, scatter[j], ty), scatterMask[j], scatter[j], tz));
+    }
+  }
+  return blocks * 8;
+}
+
+#endif
+
+static SimdLevel detectSimdLevel( ){
+#ifdef VERTEXKERNELS_X86
+  __builtin_cpu_init( );
+  if( __builtin_cpu_supports("avx512f") ){
+    return SIMD_AVX512;
+  }
+  if( __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma") ){
+    return SIMD_AVX2;
+  }
+  if( __builtin_cpu_supports("sse2") ){
+    return SIMD_SSE2;
+  }
+#endif
+  return SIMD_SCALAR;
+}
+
+// -1 until the CPU has been checked
+static std::atomic<int> currentLevel(-1);
+
+SimdLevel simdLevelSupported( ){
+  static const SimdLevel supported = detectSimdLevel( );
+  return supported;
+}
+
+SimdLevel simdLevel( ){
+  int level = currentLevel.load(std::memory_order_relaxed);
+  if( level < 0 ){
+    level = simdLevelSupported( );
+    currentLevel.store(level, std::memory_order_relaxed);
+  }
+  return (SimdLevel)level;
+}
+
+SimdLevel setSimdLevel( SimdLevel level ){
+  if( level > simdLevelSupported( ) ){
+    level = simdLevelSupported( );
+  }
+  currentLevel.store(level, std::memory_order_relaxed);
+  return level;
+}
+
+const char* simdLevelName( SimdLevel level ){
+  switch( level ){
+  case SIMD_SSE2:
+    return "SSE2";
+  case SIMD_AVX2:
+    return "AVX2";
+  case SIMD_AVX512:
+    return "AVX-512";
+  default:
+    return "scalar";
+  }
+}
+
+template <typename Real>
+static void transformRows( const Real *m, const Real (*in)[3], Real (*out)[3], int count, Real w ){
+  int done;
+  if( count <= 0 ){
+    return;
+  }
+  switch( simdLevel( ) ){
+#ifdef VERTEXKERNELS_X86
+  case SIMD_AVX512:
+    done = transformBlocksAvx512(m, in[0], out[0], count, w);
+    transformRowsSse2(m, in + done, out + done, count - done, w);
+    break;
+  case SIMD_AVX2:
+    done = transformBlocksAvx2(m, in[0], out[0], count, w);
+    transformRowsSse2(m, in + done, out + done, count - done, w);
+    break;
+  case SIMD_SSE2:
+    transformRowsSse2(m, in, out, count, w);
+    break;
+#endif
+  default:
+    transformRowsScalar(m, in, out, count, w);
+    break;
+  }
+}
+
+void transformPoints( const double *m, const double (*in)[3], double (*out)[3], int count ){
+  transformRows(m, in, out, count, 1.0);
+}
+
+void transformDirections( const double *m, const double (*in)[3], double (*out)[3], int count ){
+  transformRows(m, in, out, count, 0.0);
+}
+
+void transformPoints( const float *m, const float (*in)[3], float (*out)[3], int count ){
+  transformRows(m, in, out, count, 1.0f);
+}
+
+void transformDirections( const float *m, const float (*in)[3], float (*out)[3], int count ){
+  transformRows(m, in, out, count, 0.0f);
+}
@@ -0,0 +1,39 @@
+/*
+ * VertexKernels
+ *
+ * Affine transforms of whole arrays of xyz rows, such as the vertices
+ * and normals of a FaceList. There is a kernel for each of SSE2, AVX2
+ * and AVX-512 besides plain C++; the best one the CPU supports is picked
+ * the first time one is needed.
+ */
+
+#ifndef _VERTEXKERNELS_H_
+#define _VERTEXKERNELS_H_
+
+enum SimdLevel{
+  SIMD_SCALAR,
+  SIMD_SSE2,
+  SIMD_AVX2,
+  SIMD_AVX512
+};
+
+// The level in use. It starts as the best one the CPU supports.
+SimdLevel simdLevel( );
+// The best level this CPU supports
+SimdLevel simdLevelSupported( );
+// Use level, or the best supported one below it. Returns the level used.
+SimdLevel setSimdLevel( SimdLevel level );
+const char* simdLevelName( SimdLevel level );
+
+/*
+ * out[i] = m * (in[i], 1) for points, or m * (in[i], 0) for directions
+ * such as normals, for every i in [0, count). m is a 4x4 matrix stored
+ * by columns, as OpenGL does. in and out may be the same array but must
+ * not otherwise overlap.
+ */
+void transformPoints( const double *m, const double (*in)[3], double (*out)[3], int count );
+void transformDirections( const double *m, const double (*in)[3], double (*out)[3], int count );
+void transformPoints( const float *m, const float (*in)[3], float (*out)[3], int count );
+void transformDirections( const float *m, const float (*in)[3], float (*out)[3], int count );
+
+#endif
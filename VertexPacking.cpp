@@ -0,0 +1,161 @@
+/*
+ * VertexPacking
+ *
+ * Quantizing positions and oct-encoding normals.
+ */
+
+#include "VertexPacking.h"
+
+#include <algorithm>
+#include <cmath>
+
+typedef FaceList::Real Real;
+
+// Largest magnitude of a quantized component; -32768 is left unused so
+// that both signs have the same range
+static const int packRange = 32767;
+
+static double signOf( double a ){
+  return a > 0.0 ? 1.0 : a < 0.0 ? -1.0 : 0.0;
+}
+
+static short quantize( double a ){
+  return (short)std::max(-packRange, std::min(packRange, (int)floor(a * packRange + 0.5)));
+}
+
+void unpackPosition( const FaceList* fl, const PackedVertex& v, double p[3] ){
+  for( int j = 0; j < 3; j++ ){
+    p[j] = fl->packOffset[j] + (double)fl->packScale[j] * v.position[j];
+  }
+}
+
+/*
+ * The octahedron |x| + |y| + |z| = 1 unfolded onto the square: the
+ * upper half is projected straight down and the lower half folded out
+ * over the corners.
+ */
+void unpackNormal( const PackedVertex& v, double n[3] ){
+  double u = (double)v.normal[0] / packRange;
+  double w = (double)v.normal[1] / packRange;
+  n[0] = u;
+  n[1] = w;
+  n[2] = 1.0 - fabs(u) - fabs(w);
+  if( n[2] < 0.0 ){
+    n[0] = (1.0 - fabs(w)) * signOf(u);
+    n[1] = (1.0 - fabs(u)) * signOf(w);
+  }
+  double length = sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+  for( int j = 0; j < 3; j++ ){
+    n[j] /= length;
+  }
+}
+
+static double angleBetween( const double a[3], const Real b[3] ){
+  double lb = sqrt(b[0] * b[0] + b[1] * b[1] + b[2] * b[2]);
+  double c = (a[0] * b[0] + a[1] * b[1] + a[2] * b[2]) / (lb > 0.0 ? lb : 1.0);
+  return acos(std::max(-1.0, std::min(1.0, c)));
+}
+
+/*
+ * Rounding each component on its own is not always nearest once the
+ * square is folded back onto the sphere, so the four corners of the
+ * grid cell are tried and the closest kept. Returns its angle.
+ */
+static double packNormal( const Real n[3], PackedVertex& v ){
+  double l1 = fabs(n[0]) + fabs(n[1]) + fabs(n[2]);
+  double u = l1 > 0.0 ? n[0] / l1 : 0.0;
+  double w = l1 > 0.0 ? n[1] / l1 : 0.0;
+  if( l1 > 0.0 && n[2] < 0.0 ){
+    double fu = (1.0 - fabs(w)) * (u < 0.0 ? -1.0 : 1.0);
+    double fw = (1.0 - fabs(u)) * (w < 0.0 ? -1.0 : 1.0);
+    u = fu;
+    w = fw;
+  }
+  double best = -1.0;
+  for( int i = 0; i < 4; i++ ){
+    PackedVertex t = v;
+    t.normal[0] = quantize(((i & 1) ? ceil(u * packRange) : floor(u * packRange)) / packRange);
+    t.normal[1] = quantize(((i & 2) ? ceil(w * packRange) : floor(w * packRange)) / packRange);
+    t.normal[2] = 0;
+    double decoded[3];
+    unpackNormal(t, decoded);
+    double angle = l1 > 0.0 ? angleBetween(decoded, n) : 0.0;
+    if( best < 0.0 || angle < best ){
+      best = angle;
+      v = t;
+    }
+  }
+  return best;
+}
+
+/*
+ * The scale is rounded up to the next float that still reaches the
+ * farthest vertex from the float offset, so no vertex is clamped and
+ * every one is within half a step of where it was.
+ */
+void packVertices( FaceList* fl, VertexPackingStats* stats ){
+  const int vc = fl->vc;
+  bool withShortFaces = vc <= 65536;
+  fl->allocPacking(withShortFaces);
+
+  VertexPackingStats s = VertexPackingStats( );
+  for( int j = 0; j < 3; j++ ){
+    double low = vc > 0 ? fl->vertices[0][j] : 0.0;
+    double high = low;
+    for( int i = 1; i < vc; i++ ){
+      low = std::min(low, (double)fl->vertices[i][j]);
+      high = std::max(high, (double)fl->vertices[i][j]);
+    }
+    float offset = (float)((low + high) / 2);
+    double reach = std::max(high - offset, offset - low);
+    float scale = (float)(reach / packRange);
+    while( (double)scale * packRange < reach ){
+      scale = nextafterf(scale, HUGE_VALF);
+    }
+    if( scale <= 0.0f ){
+      scale = 1.0f;
+    }
+    fl->packOffset[j] = offset;
+    fl->packScale[j] = scale;
+    s.positionBound += 0.25 * (double)scale * scale;
+  }
+  s.positionBound = sqrt(s.positionBound);
+
+  double worstNormal = 0.0;
+  for( int i = 0; i < vc; i++ ){
+    PackedVertex &v = fl->packed[i];
+    double p[3];
+    double d2 = 0.0;
+    for( int j = 0; j < 3; j++ ){
+      v.position[j] = quantize((fl->vertices[i][j] - fl->packOffset[j]) / ((double)fl->packScale[j] * packRange));
+    }
+    unpackPosition(fl, v, p);
+    for( int j = 0; j < 3; j++ ){
+      d2 += (p[j] - fl->vertices[i][j]) * (p[j] - fl->vertices[i][j]);
+    }
+    s.positionError = std::max(s.positionError, sqrt(d2));
+    worstNormal = std::max(worstNormal, packNormal(fl->v_normals[i], v));
+  }
+  s.normalDegrees = worstNormal * 180.0 / M_PI;
+
+  if( withShortFaces ){
+    for( int f = 0; f < fl->fc; f++ ){
+      for( int k = 0; k < 3; k++ ){
+        fl->shortFaces[f][k] = (unsigned short)fl->faces[f][k];
+      }
+    }
+    for( int f = 0; f < fl->lodFaceCount( ); f++ ){
+      for( int k = 0; k < 3; k++ ){
+        fl->shortFaces[fl->fc + f][k] = (unsigned short)fl->lodFaces[f][k];
+      }
+    }
+  }
+
+  s.vertexBytesBefore = 2 * sizeof(Real[3]);
+  s.vertexBytesAfter = sizeof(PackedVertex);
+  s.faceBytesBefore = sizeof(int[3]);
+  s.faceBytesAfter = withShortFaces ? sizeof(unsigned short[3]) : sizeof(int[3]);
+  if( stats ){
+    *stats = s;
+  }
+}
@@ -0,0 +1,47 @@
+/*
+ * VertexPacking
+ *
+ * A compact copy of a FaceList's vertices and faces for drawing.
+ * Positions become 16-bit integers across the mesh's bounding box,
+ * normals are oct-encoded (Meyer et al. 2010) into two 16-bit
+ * components, and faces take 16-bit indices when the mesh has no more
+ * than 65536 vertices. A vertex is sent in 12 bytes instead of 48 (24
+ * in single precision), and an index in 2 instead of 4.
+ *
+ * blinn_phong.vert.glsl decodes them, given packScale and packOffset.
+ * The full precision arrays stay as they are for everything done on
+ * the CPU, such as culling and simplification.
+ */
+
+#include "FaceList.h"
+
+#ifndef _VERTEXPACKING_H_
+#define _VERTEXPACKING_H_
+
+struct VertexPackingStats{
+  // farthest a decoded position lies from its vertex, and the most it
+  // ever can: half a quantization step along each axis
+  double positionError;
+  double positionBound;
+  // widest angle between a decoded normal and its vertex's, in degrees
+  double normalDegrees;
+  // bytes sent per vertex and per face, unpacked and packed
+  int vertexBytesBefore;
+  int vertexBytesAfter;
+  int faceBytesBefore;
+  int faceBytesAfter;
+};
+
+/*
+ * Give fl a packed copy of its vertices, and of its faces and levels
+ * of detail when 16-bit indices can hold them, replacing any it had.
+ * Call it after the mesh is final; any later change to the mesh drops
+ * the copy (see FaceList::dropPacking).
+ */
+void packVertices( FaceList* fl, VertexPackingStats* stats = NULL );
+
+// Decode as the shader does
+void unpackPosition( const FaceList* fl, const PackedVertex& v, double p[3] );
+void unpackNormal( const PackedVertex& v, double n[3] );
+
+#endif
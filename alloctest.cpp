@@ -0,0 +1,218 @@
+/*
+ * alloctest
+ *
+ * Counts the heap allocations made while the scene's models are loaded
+ * and handed along, to check that meshes go from the loader to the
+ * scene without copies or hidden allocations. Under glibc malloc itself
+ * is replaced, so every allocation is counted, operator new's and the
+ * C library's alike; elsewhere only operator new is.
+ *
+ * Checked, loading data/ the way SceneGraph does, into an arena on a
+ * loader thread and through a HandoffQueue:
+ *   - a model loaded from its baked copy costs at most
+ *     loadAllocationLimit heap allocations and loadByteLimit bytes,
+ *     however large it is, so none of its data is on the heap
+ *   - acquiring a model that is already loaded costs at most one
+ *     allocation, for its path
+ *   - copying, moving and dropping handles costs nothing
+ *
+ * usage: alloctest
+ *   run from the directory holding data/; the models there are baked
+ *   first if they are not already
+ */
+
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "Arena.h"
+#include "HandoffQueue.h"
+#include "MeshRegistry.h"
+#include "PlyModel.h"
+#include "ThreadPool.h"
+
+static std::atomic<long> allocations(0);
+static std::atomic<long> allocatedBytes(0);
+
+static inline void counted( size_t size ){
+  allocations.fetch_add(1, std::memory_order_relaxed);
+  allocatedBytes.fetch_add(size, std::memory_order_relaxed);
+}
+
+#ifdef __GLIBC__
+// glibc's own entry points, which the replacements below forward to
+extern "C" void* __libc_malloc( size_t size );
+extern "C" void* __libc_calloc( size_t count, size_t size );
+extern "C" void* __libc_realloc( void* p, size_t size );
+extern "C" void* __libc_memalign( size_t alignment, size_t size );
+extern "C" void __libc_free( void* p );
+
+extern "C" void* malloc( size_t size ){
+  counted(size);
+  return __libc_malloc(size);
+}
+
+extern "C" void* calloc( size_t count, size_t size ){
+  counted(count * size);
+  return __libc_calloc(count, size);
+}
+
+extern "C" void* realloc( void* p, size_t size ){
+  counted(size);
+  return __libc_realloc(p, size);
+}
+
+extern "C" void* memalign( size_t alignment, size_t size ){
+  counted(size);
+  return __libc_memalign(alignment, size);
+}
+
+extern "C" void* aligned_alloc( size_t alignment, size_t size ){
+  counted(size);
+  return __libc_memalign(alignment, size);
+}
+
+extern "C" int posix_memalign( void** p, size_t alignment, size_t size ){
+  counted(size);
+  *p = __libc_memalign(alignment, size);
+  return *p ? 0 : ENOMEM;
+}
+
+extern "C" void free( void* p ){
+  __libc_free(p);
+}
+#else
+// operator new is all that can be replaced portably
+void* operator new( size_t size ){
+  counted(size);
+  void *p = malloc(size ? size : 1);
+  if( !p ){
+    throw std::bad_alloc( );
+  }
+  return p;
+}
+
+void* operator new[]( size_t size ){
+  return operator new(size);
+}
+
+void operator delete( void* p ) noexcept{
+  free(p);
+}
+
+void operator delete[]( void* p ) noexcept{
+  free(p);
+}
+#endif
+
+// Allocations since a snapshot of the counters
+struct AllocCount{
+  long allocations;
+  long bytes;
+
+  AllocCount( ) : allocations(::allocations), bytes(allocatedBytes){ }
+
+  AllocCount since( ) const{
+    AllocCount now;
+    now.allocations -= allocations;
+    now.bytes -= bytes;
+    return now;
+  }
+};
+
+// Bookkeeping a load may allocate: paths, registry entries, the task
+// and the hand-off; nothing that grows with the model
+static const long loadAllocationLimit = 32;
+static const long loadByteLimit = 4096;
+
+static int failures = 0;
+
+static void check( bool ok, const char* what ){
+  if( !ok ){
+    fprintf(stderr, "FAILED: %s\n", what);
+    failures++;
+  }
+}
+
+static const char* const sceneFiles[] = {
+  "data/sphere.ply", "data/urn.ply", "data/shark.ply", "data/trico.ply", "data/spider.ply", "data/big_spider.ply"
+};
+static const int sceneFileCount = sizeof(sceneFiles) / sizeof(sceneFiles[0]);
+
+// A model handed from the loader thread, as SceneGraph's LoadedMesh
+struct Loaded{
+  int index;
+  MeshHandle mesh;
+};
+
+int main( ){
+  int i;
+  // Bake every model first, so the loads below come from the baked copies
+  for( i = 0; i < sceneFileCount; i++ ){
+    FaceList::release(readPlyModel(sceneFiles[i]));
+  }
+
+  Arena arena(8 << 20);
+  MeshRegistry registry(&arena);
+  ThreadPool loader(1);
+  HandoffQueue<Loaded> done;
+
+  // Each model's load on its own, on the loader thread as in the scene
+  std::vector<AllocCount> loadCost(sceneFileCount);
+  std::vector<MeshHandle> scene(sceneFileCount);
+  for( i = 0; i < sceneFileCount; i++ ){
+    std::atomic<bool> finished(false);
+    AllocCount start;
+    loader.submit([&, i](){
+      Loaded m;
+      m.index = i;
+      m.mesh = registry.acquire(sceneFiles[i]);
+      done.push(std::move(m));
+      finished = true;
+    });
+    while( !finished ){
+      std::this_thread::yield( );
+    }
+    done.drain([&](Loaded &m){
+      scene[m.index] = std::move(m.mesh);
+    });
+    loadCost[i] = start.since( );
+  }
+
+  printf("%-22s %8s %8s %12s %12s\n", "model", "vertices", "allocs", "heap bytes", "mesh bytes");
+  for( i = 0; i < sceneFileCount; i++ ){
+    const FaceList *fl = scene[i].get( );
+    size_t meshBytes = fl->vc * (sizeof(fl->vertices[0]) * 3 + sizeof(fl->packed[0])) + fl->fc * (sizeof(fl->faces[0]) + sizeof(fl->f_normals[0]));
+    printf("%-22s %8d %8ld %12ld %12lu\n", sceneFiles[i], fl->vc, loadCost[i].allocations, loadCost[i].bytes, (unsigned long)meshBytes);
+    check(loadCost[i].allocations <= loadAllocationLimit, "a baked model loads with a fixed number of allocations");
+    check(loadCost[i].bytes <= loadByteLimit, "a baked model's data is not on the heap");
+  }
+
+  // Acquiring what is loaded and passing handles about
+  AllocCount start;
+  MeshHandle again = registry.acquire(sceneFiles[0]);
+  AllocCount acquireCost = start.since( );
+  start = AllocCount( );
+  for( i = 0; i < sceneFileCount; i++ ){
+    MeshHandle copy = scene[i];
+    MeshHandle moved = std::move(copy);
+    scene[i] = moved;
+    moved.reset( );
+  }
+  AllocCount handleCost = start.since( );
+  printf("acquire of a loaded model: %ld allocations, %ld bytes\n", acquireCost.allocations, acquireCost.bytes);
+  printf("copying, moving and dropping handles: %ld allocations\n", handleCost.allocations);
+  check(acquireCost.allocations <= 1, "acquiring a loaded model allocates no more than its path");
+  check(handleCost.allocations == 0, "passing handles about allocates nothing");
+  if( failures > 0 ){
+    fprintf(stderr, "%d checks failed\n", failures);
+    return 1;
+  }
+  printf("all checks passed\n");
+  return 0;
+}
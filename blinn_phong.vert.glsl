@@ -27,14 +27,37 @@
 uniform mat4 modelViewMatrix;
 uniform mat4 projectionMatrix;
 
+// Set when the model's vertices come packed (see VertexPacking.h):
+// gl_Vertex holds positions quantized across the model's bounding box
+// and gl_Normal.xy an oct-encoded normal.
+uniform bool packedVertices;
+uniform vec3 packScale;
+uniform vec3 packOffset;
+
 
 // These are variables that we wish to send to our fragment shader
 // In later versions of GLSL, these are 'out' variables.
 varying vec3 myNormal;
 varying vec4 myVertex;
 
+// The octahedron |x| + |y| + |z| = 1 unfolded onto the square, with
+// its lower half folded out over the corners
+vec3 octDecode(vec2 o) {
+  vec3 n = vec3(o, 1.0 - abs(o.x) - abs(o.y));
+  if (n.z < 0.0) {
+    n.xy = (1.0 - abs(o.yx)) * sign(o);
+  }
+  return normalize(n);
+}
+
 void main() {
-  gl_Position = projectionMatrix * modelViewMatrix * gl_Vertex;
-  myNormal = gl_Normal;
-  myVertex = gl_Vertex;
+  vec4 vertex = gl_Vertex;
+  vec3 normal = gl_Normal;
+  if (packedVertices) {
+    vertex = vec4(packOffset + packScale * gl_Vertex.xyz, 1.0);
+    normal = octDecode(gl_Normal.xy);
+  }
+  gl_Position = projectionMatrix * modelViewMatrix * vertex;
+  myNormal = normal;
+  myVertex = vertex;
 }
@@ -0,0 +1,65 @@
+/*
+ * kernelbench
+ *
+ * Throughput of the vertex transform kernels (see VertexKernels.h) at
+ * every SIMD level this CPU supports, in millions of vertices per
+ * second, for points and directions in double and single precision.
+ *
+ * usage: kernelbench [vertices]
+ *   vertices  rows per array (default 1000000)
+ */
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+
+#include <vector>
+
+#include "VertexKernels.h"
+
+template <typename Real>
+static double verticesPerSecond( bool points, int count ){
+  std::vector<Real> rows(3 * (size_t)count);
+  for( size_t i = 0; i < rows.size( ); i++ ){
+    rows[i] = (Real)(rand( ) / (double)RAND_MAX - 0.5);
+  }
+  // A small rotation about z and a translation, so repeated passes
+  // neither blow up nor collapse the data
+  const double a = 0.001;
+  Real m[16] = { (Real)cos(a), (Real)sin(a), 0, 0,  (Real)-sin(a), (Real)cos(a), 0, 0,  0, 0, 1, 0,  0, 0, 0, 1 };
+  Real (*data)[3] = (Real(*)[3])&rows[0];
+
+  // Repeat until the timing is long enough to trust
+  long transformed = 0;
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now( );
+  double seconds = 0.0;
+  while( seconds < 0.25 ){
+    if( points ){
+      transformPoints(m, data, data, count);
+    }else{
+      transformDirections(m, data, data, count);
+    }
+    transformed += count;
+    seconds = std::chrono::duration<double>(std::chrono::steady_clock::now( ) - start).count( );
+  }
+  return transformed / seconds;
+}
+
+int main( int argc, char **argv ){
+  int count = 1000000;
+  if( argc > 2 || (argc == 2 && (count = atoi(argv[1])) < 1) ){
+    fprintf(stderr, "usage: kernelbench [vertices]\n");
+    exit(1);
+  }
+
+  printf("%d vertices per array, CPU supports %s\n", count, simdLevelName(simdLevelSupported( )));
+  printf("%-8s %14s %14s %14s %14s\n", "level", "double points", "double dirs", "float points", "float dirs");
+  for( int level = SIMD_SCALAR; level <= simdLevelSupported( ); level++ ){
+    setSimdLevel((SimdLevel)level);
+    printf("%-8s %11.1f M/s %11.1f M/s %11.1f M/s %11.1f M/s\n", simdLevelName((SimdLevel)level),
+      verticesPerSecond<double>(true, count) * 1e-6, verticesPerSecond<double>(false, count) * 1e-6,
+      verticesPerSecond<float>(true, count) * 1e-6, verticesPerSecond<float>(false, count) * 1e-6);
+  }
+  return 0;
+}
@@ -0,0 +1,869 @@
+/*
+ * meshtest
+ *
+ * Checks what readPlyModel makes of every model in data/, fresh from
+ * the PLY file:
+ *   - face and level of detail indices name vertices the mesh has
+ *   - the meshlets tile the faces in order, within the cluster limits
+ *     of Meshlets.h, and each one's sphere holds its faces; their
+ *     cones keep facing with the faces when the mesh is mirrored, and
+ *     cull nothing once it is scaled to a point
+ *   - the levels of detail follow one another in lodFaces, coarser
+ *     and no more accurate each time
+ *   - the progressive mesh stays in range at every step, and with
+ *     every split applied has the same faces as the mesh
+ *   - a progressive mesh and a baked mesh read back equal to what was
+ *     written, and neither is read under another source hash
+ *   - every vertex is behind every plane of the hull, also after the
+ *     mesh is mirrored through scale(-1), and the hull never culls a
+ *     plane some vertex is in front of
+ *   - GJK agrees with the separating axis test on pairs of hulls
+ *   - every packed position is within positionBound of its vertex
+ *   - streaming the file through PlyStream.h, from the file or from a
+ *     pipe and in chunks of any size, gives its vertices and faces as
+ *     readPlyModel reads them, and PlyBoundsHandler's box is the box
+ *     calcBoundingBox finds and its sphere holds every vertex
+ *   - a model rewritten as binary, little and big endian, with 32 and
+ *     64 bit positions, loads the same as it does as ASCII
+ *   - rewritten with normals, colors or texture coordinates, or with
+ *     other properties or properties in another order, a model loads
+ *     the same through the fixed layout decoders of PlyParse.h as
+ *     through the ones routing each property
+ *   - a model large enough to be parsed and processed on the thread
+ *     pool loads the same on any number of threads
+ *
+ * usage: meshtest
+ *   run from the directory holding data/; writes its scratch files
+ *   there and removes them
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "ConvexHull.h"
+#include "MeshCache.h"
+#include "Meshlets.h"
+#include "PlyModel.h"
+#include "PlyStream.h"
+#include "ProgressiveMesh.h"
+#include "VertexPacking.h"
+
+typedef FaceList::Real Real;
+
+static int failures = 0;
+
+static void check( bool ok, const char* filename, const char* what ){
+  if( !ok ){
+    fprintf(stderr, "FAILED: %s: %s\n", filename, what);
+    failures++;
+  }
+}
+
+static const char* const testFiles[] = {
+  "data/sphere.ply", "data/urn.ply", "data/shark.ply", "data/trico.ply", "data/spider.ply"
+};
+static const int testFileCount = sizeof(testFiles) / sizeof(testFiles[0]);
+
+// Closer than this, in model units (the models fit a unit sphere),
+// counts as on a plane or surface
+static const double tolerance = sizeof(Real) == sizeof(float) ? 1e-5 : 1e-9;
+
+static bool facesInRange( const int (*faces)[3], int count, int vc ){
+  for( int i = 0; i < count; i++ ){
+    for( int k = 0; k < 3; k++ ){
+      if( faces[i][k] < 0 || faces[i][k] >= vc ){
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+// A face as its three positions, turned to start at the least, so the
+// same face gives the same key whatever its vertices are numbered
+typedef std::vector<Real> FaceKey;
+
+static FaceKey faceKey( const Real* a, const Real* b, const Real* c ){
+  const Real *corner[3] = { a, b, c };
+  int first = 0;
+  for( int k = 1; k < 3; k++ ){
+    if( std::lexicographical_compare(corner[k], corner[k] + 3, corner[first], corner[first] + 3) ){
+      first = k;
+    }
+  }
+  FaceKey key;
+  for( int k = 0; k < 3; k++ ){
+    key.insert(key.end( ), corner[(first + k) % 3], corner[(first + k) % 3] + 3);
+  }
+  return key;
+}
+
+static void checkMeshlets( const FaceList* fl, const char* filename ){
+  bool tiled = fl->meshletCount > 0, limits = true, bounded = true;
+  int next = 0;
+  for( int i = 0; i < fl->meshletCount; i++ ){
+    const Meshlet &m = fl->meshlets[i];
+    tiled = tiled && m.firstFace == next;
+    next = m.firstFace + m.faceCount;
+    std::set<int> vertices;
+    for( int f = m.firstFace; f < m.firstFace + m.faceCount && f < fl->fc; f++ ){
+      for( int k = 0; k < 3; k++ ){
+        const Real *v = fl->vertices[fl->faces[f][k]];
+        double dx = v[0] - m.center[0], dy = v[1] - m.center[1], dz = v[2] - m.center[2];
+        bounded = bounded && sqrt(dx * dx + dy * dy + dz * dz) <= m.radius * (1 + 1e-5) + tolerance;
+        vertices.insert(fl->faces[f][k]);
+      }
+    }
+    limits = limits && m.faceCount > 0 && m.faceCount <= meshletMaxFaces && (int)vertices.size( ) <= meshletMaxVertices;
+  }
+  check(tiled && next == fl->fc, filename, "meshlets tile the faces in order");
+  check(limits, filename, "meshlets keep to the cluster limits");
+  check(bounded, filename, "meshlet spheres hold their faces");
+
+  // Mirrored, the faces wind as before and the cones face the same way;
+  // flattened to a point, no cone culls anything
+  FaceList *mirrored = fl->clone( );
+  mirrored->scale(-2.0f);
+  FaceList *flat = fl->clone( );
+  flat->scale(0.0f);
+  bool sameCones = true, openCones = true;
+  for( int i = 0; i < fl->meshletCount; i++ ){
+    const Meshlet &m = fl->meshlets[i], &mm = mirrored->meshlets[i], &fm = flat->meshlets[i];
+    for( int k = 0; k < 3; k++ ){
+      sameCones = sameCones && fabs(mm.coneAxis[k] - m.coneAxis[k]) <= 1e-6;
+      openCones = openCones && fm.coneAxis[k] == 0.0f;
+    }
+    sameCones = sameCones && mm.coneCutoff == m.coneCutoff;
+    openCones = openCones && fm.coneCutoff == 1.0f;
+  }
+  check(sameCones, filename, "meshlet cones keep their direction after scale(-2)");
+  check(openCones, filename, "meshlet cones cull nothing after scale(0)");
+  FaceList::release(mirrored);
+  FaceList::release(flat);
+}
+
+static void checkLods( const FaceList* fl, const char* filename ){
+  bool ordered = true;
+  int next = 0, faces = fl->fc;
+  float error = 0.0f;
+  for( int l = 0; l < fl->lodCount; l++ ){
+    const MeshLod &lod = fl->lods[l];
+    ordered = ordered && lod.firstFace == next && lod.faceCount > 0 && lod.faceCount < faces && lod.error >= error;
+    next = lod.firstFace + lod.faceCount;
+    faces = lod.faceCount;
+    error = lod.error;
+  }
+  check(ordered, filename, "levels of detail follow one another, coarser each time");
+  check(facesInRange(fl->lodFaces, fl->lodFaceCount( ), fl->vc), filename, "level of detail indices are in range");
+}
+
+static bool progressiveInRange( const ProgressiveMesh* pm ){
+  const int *faces = pm->currentFaces( );
+  for( int i = 0; i < 3 * pm->faceCount( ); i++ ){
+    if( faces[i] < 0 || faces[i] >= pm->vertexCount( ) ){
+      return false;
+    }
+  }
+  return true;
+}
+
+static void checkProgressive( const FaceList* fl, const char* filename ){
+  ProgressiveMesh *pm = buildProgressiveMesh(fl);
+  int splits = (int)pm->splits.size( );
+  bool inRange = true;
+  for( int step = 0; step <= 8; step++ ){
+    pm->refine(splits * step / 8);
+    inRange = inRange && progressiveInRange(pm);
+  }
+  check(inRange, filename, "progressive mesh indices are in range at every step");
+  check(pm->faceCount( ) == fl->fc && pm->vertexCount( ) == fl->vc, filename, "a fully refined progressive mesh has every face and vertex");
+
+  std::multiset<FaceKey> original, refined;
+  for( int i = 0; i < fl->fc; i++ ){
+    original.insert(faceKey(fl->vertices[fl->faces[i][0]], fl->vertices[fl->faces[i][1]], fl->vertices[fl->faces[i][2]]));
+  }
+  const int *faces = pm->currentFaces( );
+  const Real *p = &pm->positions[0];
+  for( int i = 0; i < pm->faceCount( ); i++ ){
+    refined.insert(faceKey(p + 3 * faces[3 * i], p + 3 * faces[3 * i + 1], p + 3 * faces[3 * i + 2]));
+  }
+  check(original == refined, filename, "a fully refined progressive mesh has the mesh's faces");
+  pm->refine(0);
+  check(pm->faceCount( ) == pm->baseFaces, filename, "undoing every split gives the base back");
+
+  // Written, then read back a few splits at a time
+  std::string path = std::string(filename) + ".meshtest.pm";
+  check(writeProgressiveMesh(path.c_str( ), 42, pm), filename, "progressive mesh written");
+  ProgressiveMeshReader wrongHash;
+  check(wrongHash.open(path.c_str( ), 43) == NULL, filename, "a progressive mesh is not read under another hash");
+  ProgressiveMeshReader reader;
+  ProgressiveMesh *read = reader.open(path.c_str( ), 42);
+  check(read != NULL, filename, "progressive mesh read back");
+  if( read ){
+    while( ProgressiveMesh *more = reader.readSplits(100) ){
+      read->append(*more);
+      delete more;
+    }
+    read->refine((int)read->splits.size( ));
+    pm->refine(splits);
+    check(read->positions == pm->positions && read->faces == pm->faces && read->corners == pm->corners &&
+      read->splits.size( ) == pm->splits.size( ) && read->faceCount( ) == pm->faceCount( ) &&
+      std::equal(pm->currentFaces( ), pm->currentFaces( ) + 3 * pm->faceCount( ), read->currentFaces( )),
+      filename, "progressive mesh reads back as written");
+    delete read;
+  }
+  remove(path.c_str( ));
+  delete pm;
+}
+
+static void checkBake( const FaceList* fl, const char* filename ){
+  std::string path = std::string(filename) + ".meshtest.mesh";
+  check(writeBakedMesh(path.c_str( ), 42, fl), filename, "baked mesh written");
+  check(readBakedMesh(path.c_str( ), 43) == NULL, filename, "a baked mesh is not read under another hash");
+  FaceList *read = readBakedMesh(path.c_str( ), 42);
+  check(read != NULL, filename, "baked mesh read back");
+  if( read ){
+    bool same = read->vc == fl->vc && read->fc == fl->fc && read->meshletCount == fl->meshletCount &&
+      read->lodCount == fl->lodCount && read->hullPlaneCount == fl->hullPlaneCount && read->hullVertexCount == fl->hullVertexCount &&
+      read->radius == fl->radius;
+    if( same ){
+      same = memcmp(read->vertices, fl->vertices, fl->vc * sizeof(fl->vertices[0])) == 0 &&
+        memcmp(read->v_normals, fl->v_normals, fl->vc * sizeof(fl->v_normals[0])) == 0 &&
+        memcmp(read->faces, fl->faces, fl->fc * sizeof(fl->faces[0])) == 0 &&
+        memcmp(read->meshlets, fl->meshlets, fl->meshletCount * sizeof(fl->meshlets[0])) == 0 &&
+        memcmp(read->lods, fl->lods, fl->lodCount * sizeof(fl->lods[0])) == 0 &&
+        memcmp(read->lodFaces, fl->lodFaces, fl->lodFaceCount( ) * sizeof(fl->lodFaces[0])) == 0 &&
+        memcmp(read->hullPlanes, fl->hullPlanes, fl->hullPlaneCount * sizeof(fl->hullPlanes[0])) == 0 &&
+        memcmp(read->hullVertices, fl->hullVertices, fl->hullVertexCount * sizeof(fl->hullVertices[0])) == 0;
+    }
+    check(same, filename, "baked mesh reads back as written");
+    FaceList::release(read);
+  }
+  remove(path.c_str( ));
+}
+
+// The farthest any vertex of fl is in front of a plane of its hull
+static double hullExcess( const FaceList* fl ){
+  double worst = -HUGE_VAL;
+  for( int p = 0; p < fl->hullPlaneCount; p++ ){
+    const Real *h = fl->hullPlanes[p];
+    for( int i = 0; i < fl->vc; i++ ){
+      const Real *v = fl->vertices[i];
+      worst = std::max(worst, h[0] * v[0] + h[1] * v[1] + h[2] * v[2] - (double)h[3]);
+    }
+  }
+  return worst;
+}
+
+static double random( double low, double high ){
+  return low + (high - low) * (rand( ) / (double)RAND_MAX);
+}
+
+static Vec3 randomDirection( ){
+  Vec3 d;
+  do{
+    d = Vec3(random(-1, 1), random(-1, 1), random(-1, 1));
+  }while( d[0] * d[0] + d[1] * d[1] + d[2] * d[2] < 0.01f );
+  return normalize(d);
+}
+
+static Mat4 translation( double x, double y, double z ){
+  Mat4 m;
+  m.identity( );
+  m(3, 0) = x;
+  m(3, 1) = y;
+  m(3, 2) = z;
+  return m;
+}
+
+static void checkHull( const FaceList* fl, const char* filename ){
+  check(fl->hullPlaneCount > 0 && fl->hullPlaneCount <= hullMaxPlanes, filename, "the hull has planes, no more than the cap");
+  check(hullExcess(fl) <= tolerance, filename, "every vertex is behind every hull plane");
+  FaceList *mirrored = fl->clone( );
+  mirrored->scale(-1.0f);
+  mirrored->translate(0.25f, -0.5f, 1.0f);
+  check(hullExcess(mirrored) <= tolerance, filename, "the hull still holds the mesh after scale(-1)");
+  FaceList::release(mirrored);
+
+  // A plane the hull is wholly outside of has no vertex behind it
+  Mat4 identity;
+  identity.identity( );
+  bool neverWrong = true;
+  int culled = 0;
+  for( int t = 0; t < 2000; t++ ){
+    Vec3 normal = randomDirection( );
+    Vec3 point = normal * (float)random(-1.2, 1.2);
+    if( hullOutside(fl, identity, normal, point) ){
+      culled++;
+      for( int i = 0; i < fl->vc; i++ ){
+        const Real *v = fl->vertices[i];
+        if( normal[0] * (v[0] - point[0]) + normal[1] * (v[1] - point[1]) + normal[2] * (v[2] - point[2]) < -tolerance ){
+          neverWrong = false;
+        }
+      }
+    }
+  }
+  check(culled > 0 && neverWrong, filename, "the hull never culls a plane a vertex is in front of");
+}
+
+/*
+ * Whether the hulls of a and b, with b moved by offset, meet, by the
+ * separating axis test: hulls apart have a separating axis among their
+ * face normals and the cross products of their edges. Also gives how
+ * far apart or into each other they are along the best axis found.
+ */
+static bool hullsMeetSat( const FaceList* a, const FaceList* b, const double offset[3], double* gap ){
+  std::vector<std::vector<double> > axes;
+  const FaceList *hull[2] = { a, b };
+  std::vector<std::vector<double> > edges[2];
+  for( int h = 0; h < 2; h++ ){
+    const FaceList *fl = hull[h];
+    for( int p = 0; p < fl->hullPlaneCount; p++ ){
+      axes.push_back(std::vector<double>(fl->hullPlanes[p], fl->hullPlanes[p] + 3));
+    }
+    // corners on two planes in common are the ends of an edge
+    for( int i = 0; i < fl->hullVertexCount; i++ ){
+      for( int j = i + 1; j < fl->hullVertexCount; j++ ){
+        int shared = 0;
+        for( int p = 0; p < fl->hullPlaneCount; p++ ){
+          const Real *q = fl->hullPlanes[p];
+          const Real *u = fl->hullVertices[i], *v = fl->hullVertices[j];
+          if( fabs(q[0] * u[0] + q[1] * u[1] + q[2] * u[2] - q[3]) < 1e-6 && fabs(q[0] * v[0] + q[1] * v[1] + q[2] * v[2] - q[3]) < 1e-6 ){
+            shared++;
+          }
+        }
+        if( shared >= 2 ){
+          std::vector<double> e(3);
+          for( int k = 0; k < 3; k++ ){
+            e[k] = fl->hullVertices[j][k] - fl->hullVertices[i][k];
+          }
+          edges[h].push_back(e);
+        }
+      }
+    }
+  }
+  for( size_t i = 0; i < edges[0].size( ); i++ ){
+    for( size_t j = 0; j < edges[1].size( ); j++ ){
+      const std::vector<double> &e = edges[0][i], &f = edges[1][j];
+      std::vector<double> c(3);
+      c[0] = e[1] * f[2] - e[2] * f[1];
+      c[1] = e[2] * f[0] - e[0] * f[2];
+      c[2] = e[0] * f[1] - e[1] * f[0];
+      double length = sqrt(c[0] * c[0] + c[1] * c[1] + c[2] * c[2]);
+      if( length > 1e-9 ){
+        for( int k = 0; k < 3; k++ ){
+          c[k] /= length;
+        }
+        axes.push_back(c);
+      }
+    }
+  }
+  *gap = -HUGE_VAL;
+  for( size_t i = 0; i < axes.size( ); i++ ){
+    const double *n = &axes[i][0];
+    double lowA = HUGE_VAL, highA = -HUGE_VAL, lowB = HUGE_VAL, highB = -HUGE_VAL;
+    for( int k = 0; k < a->hullVertexCount; k++ ){
+      const Real *v = a->hullVertices[k];
+      double d = n[0] * v[0] + n[1] * v[1] + n[2] * v[2];
+      lowA = std::min(lowA, d);
+      highA = std::max(highA, d);
+    }
+    for( int k = 0; k < b->hullVertexCount; k++ ){
+      const Real *v = b->hullVertices[k];
+      double d = n[0] * (v[0] + offset[0]) + n[1] * (v[1] + offset[1]) + n[2] * (v[2] + offset[2]);
+      lowB = std::min(lowB, d);
+      highB = std::max(highB, d);
+    }
+    *gap = std::max(*gap, std::max(lowB - highA, lowA - highB));
+  }
+  return *gap <= 0.0;
+}
+
+static void checkGjk( const FaceList* a, const FaceList* b, const char* filename ){
+  Mat4 identity;
+  identity.identity( );
+  int disagree = 0, meet = 0, tried = 0;
+  for( int t = 0; t < 300; t++ ){
+    Vec3 d = randomDirection( ) * (float)random(0.0, 2.5);
+    double offset[3] = { d[0], d[1], d[2] };
+    double gap;
+    bool sat = hullsMeetSat(a, b, offset, &gap);
+    // too close to touching for either answer to be wrong
+    if( fabs(gap) < 1e-4 ){
+      continue;
+    }
+    tried++;
+    bool gjk = hullsIntersect(a, identity, b, translation(d[0], d[1], d[2]));
+    meet += gjk;
+    disagree += gjk != sat;
+  }
+  check(disagree == 0 && meet > 0 && meet < tried, filename, "GJK agrees with the separating axis test");
+}
+
+static void checkPacking( const FaceList* fl, const char* filename ){
+  VertexPackingStats stats;
+  FaceList *packed = fl->clone( );
+  packVertices(packed, &stats);
+  double worst = 0.0;
+  for( int i = 0; i < packed->vc; i++ ){
+    double p[3];
+    unpackPosition(packed, packed->packed[i], p);
+    for( int k = 0; k < 3; k++ ){
+      worst = std::max(worst, fabs(p[k] - packed->vertices[i][k]));
+    }
+  }
+  check(worst <= stats.positionBound * (1 + 1e-6), filename, "packed positions are within positionBound");
+  bool sameFaces = true;
+  if( packed->shortFaces ){
+    for( int i = 0; i < packed->fc + packed->lodFaceCount( ); i++ ){
+      const int *f = i < packed->fc ? packed->faces[i] : packed->lodFaces[i - packed->fc];
+      for( int k = 0; k < 3; k++ ){
+        sameFaces = sameFaces && packed->shortFaces[i][k] == f[k];
+      }
+    }
+  }
+  check(sameFaces, filename, "16-bit faces are the faces");
+  FaceList::release(packed);
+}
+
+// A streamed model, gathered whole
+class StreamedMesh : public PlyStreamHandler{
+public:
+  std::vector<double> positions;
+  std::vector<int> corners;
+  bool inOrder;
+
+  StreamedMesh( ) : inOrder(true){ }
+  void vertices( unsigned int first, unsigned int count, const double* xyz ){
+    inOrder = inOrder && first == positions.size( ) / 3 && count > 0;
+    positions.insert(positions.end( ), xyz, xyz + 3 * count);
+  }
+  void faces( unsigned int first, unsigned int count, const int* indices ){
+    inOrder = inOrder && first == corners.size( ) / 3 && count > 0;
+    corners.insert(corners.end( ), indices, indices + 3 * count);
+  }
+};
+
+// Both at once, so one read of a pipe checks both
+class StreamedBounds : public PlyStreamHandler{
+public:
+  StreamedMesh mesh;
+  PlyBoundsHandler bounds;
+
+  void vertices( unsigned int first, unsigned int count, const double* xyz ){
+    mesh.vertices(first, count, xyz);
+    bounds.vertices(first, count, xyz);
+  }
+  void faces( unsigned int first, unsigned int count, const int* indices ){
+    mesh.faces(first, count, indices);
+  }
+};
+
+static void checkStream( const char* filename ){
+  StreamedBounds file, pipe;
+  streamPlyModel(filename, file);
+  // a pipe cannot be seeked or mapped; small chunks split every run
+  std::string command = std::string("cat ") + filename;
+  FILE *input = popen(command.c_str( ), "r");
+  check(input != NULL, filename, "the model can be piped in");
+  if( !input ){
+    return;
+  }
+  streamPlyModel(input, filename, pipe, 7);
+  pclose(input);
+  check(file.mesh.inOrder && pipe.mesh.inOrder, filename, "streamed chunks follow one another");
+  check(file.mesh.positions == pipe.mesh.positions && file.mesh.corners == pipe.mesh.corners,
+    filename, "a model streams the same from a pipe, in any chunk size");
+  check(memcmp(&file.bounds.min, &pipe.bounds.min, sizeof(file.bounds.min)) == 0 &&
+    memcmp(&file.bounds.max, &pipe.bounds.max, sizeof(file.bounds.max)) == 0 &&
+    file.bounds.radius == pipe.bounds.radius, filename, "streamed bounds are the same from a pipe");
+
+  // readPlyModel as it reads the file, before anything is reordered
+  plyLoadOptions( ).optimize = false;
+  FaceList *loaded = readPlyModel(filename);
+  plyLoadOptions( ).optimize = true;
+  const std::vector<double> &positions = file.mesh.positions;
+  const int vc = (int)positions.size( ) / 3;
+  FaceList *raw = FaceList::create(vc, 0);
+  for( int i = 0; i < vc; i++ ){
+    for( int k = 0; k < 3; k++ ){
+      raw->vertices[i][k] = positions[3 * i + k];
+    }
+  }
+  check(file.bounds.count == (unsigned int)vc && vc == loaded->vc, filename, "every vertex is streamed");
+  check((int)file.mesh.corners.size( ) == 3 * loaded->fc &&
+    std::equal(file.mesh.corners.begin( ), file.mesh.corners.end( ), &loaded->faces[0][0]), filename, "streamed faces are readPlyModel's");
+
+  // readPlyModel moves its vertices from its sphere's center and
+  // scales by its radius; undone, they are the streamed ones
+  double center[3], radius;
+  calcRitterBoundingSphere(center, &radius, raw);
+  bool same = vc == loaded->vc;
+  for( int i = 0; same && i < vc; i++ ){
+    for( int k = 0; k < 3; k++ ){
+      same = same && fabs(positions[3 * i + k] - (loaded->vertices[i][k] * radius + center[k])) <= tolerance * radius;
+    }
+  }
+  check(same, filename, "streamed vertices are readPlyModel's");
+
+  double low[3], high[3];
+  calcBoundingBox(low, high, raw);
+  bool box = true, held = true;
+  for( int k = 0; k < 3; k++ ){
+    box = box && fabs(file.bounds.min[k] - low[k]) <= tolerance * radius && fabs(file.bounds.max[k] - high[k]) <= tolerance * radius;
+  }
+  for( int i = 0; i < vc; i++ ){
+    double sq = 0.0;
+    for( int k = 0; k < 3; k++ ){
+      double d = positions[3 * i + k] - file.bounds.center[k];
+      sq += d * d;
+    }
+    held = held && sqrt(sq) <= file.bounds.radius * (1 + 1e-9);
+  }
+  check(box, filename, "the streamed box is calcBoundingBox's");
+  check(held, filename, "the streamed sphere holds every vertex");
+  FaceList::release(raw);
+  FaceList::release(loaded);
+}
+
+/*
+ * A layout to rewrite a model in: its format, and its vertex and face
+ * properties as the header gives them. Properties readPlyModel does
+ * not know are written as a constant.
+ */
+struct PlyLayout{
+  const char* name;
+  const char* format;
+  std::vector<std::string> vertex;
+  std::vector<std::string> face;
+};
+
+struct ScalarType{
+  const char* names[2];
+  int size;
+  bool real;
+};
+
+static const ScalarType scalarTypes[] = {
+  { { "char", "int8" }, 1, false }, { { "uchar", "uint8" }, 1, false },
+  { { "short", "int16" }, 2, false }, { { "ushort", "uint16" }, 2, false },
+  { { "int", "int32" }, 4, false }, { { "uint", "uint32" }, 4, false },
+  { { "float", "float32" }, 4, true }, { { "double", "float64" }, 8, true }
+};
+
+static const ScalarType& scalarType( const std::string& name ){
+  for( size_t i = 0; i < sizeof(scalarTypes) / sizeof(scalarTypes[0]); i++ ){
+    if( name == scalarTypes[i].names[0] || name == scalarTypes[i].names[1] ){
+      return scalarTypes[i];
+    }
+  }
+  fprintf(stderr, "meshtest: no type %s\n", name.c_str( ));
+  exit(1);
+}
+
+static void writeScalar( FILE* out, const PlyLayout& layout, const std::string& typeName, double value ){
+  const ScalarType &type = scalarType(typeName);
+  if( strcmp(layout.format, "ascii") == 0 ){
+    if( type.real ){
+      fprintf(out, " %.17g", value);
+    }else{
+      fprintf(out, " %ld", (long)value);
+    }
+    return;
+  }
+  unsigned char bytes[8];
+  if( type.real && type.size == 4 ){
+    float v = (float)value;
+    memcpy(bytes, &v, 4);
+  }else if( type.real ){
+    memcpy(bytes, &value, 8);
+  }else{
+    // two's complement, least significant byte first
+    unsigned long long v = (unsigned long long)(long long)value;
+    for( int k = 0; k < type.size; k++ ){
+      bytes[k] = (unsigned char)(v >> (8 * k));
+    }
+    uint16_t one = 1;
+    if( *(unsigned char*)&one != 1 ){
+      std::reverse(bytes, bytes + type.size);
+    }
+  }
+  uint16_t one = 1;
+  bool hostLittle = *(unsigned char*)&one == 1;
+  if( hostLittle != (strcmp(layout.format, "binary_little_endian") == 0) ){
+    std::reverse(bytes, bytes + type.size);
+  }
+  fwrite(bytes, 1, type.size, out);
+}
+
+// What a model rewritten in any layout gives vertex i for a property
+static double propertyValue( const std::vector<double>& positions, int i, const std::string& name ){
+  const double *p = &positions[3 * i];
+  if( name == "x" || name == "y" || name == "z" ){
+    return p[name[0] - 'x'];
+  }
+  // a normal is kept as the file has it, so need not be the surface's
+  if( name == "nx" ){
+    return 1.0;
+  }
+  if( name == "ny" || name == "nz" ){
+    return p[name[1] - 'y'];
+  }
+  if( name == "red" || name == "green" || name == "blue" ){
+    int k = name == "red" ? 0 : name == "green" ? 1 : 2;
+    return (i * 37 + k * 91) % 256;
+  }
+  if( name == "u" || name == "s" ){
+    return p[0];
+  }
+  if( name == "v" || name == "t" ){
+    return p[1];
+  }
+  return 7.0;
+}
+
+/*
+ * Write mesh in layout beside filename and return the path. Positions
+ * are rounded to float first, so every layout holds exactly the same
+ * values.
+ */
+static std::string writeLayout( const StreamedMesh& mesh, const char* filename, const PlyLayout& layout ){
+  std::string path = std::string(filename) + ".meshtest." + layout.name + ".ply";
+  FILE *out = fopen(path.c_str( ), "wb");
+  if( !out ){
+    return path;
+  }
+  std::vector<double> positions(mesh.positions.size( ));
+  for( size_t i = 0; i < positions.size( ); i++ ){
+    positions[i] = (float)mesh.positions[i];
+  }
+  int vc = (int)positions.size( ) / 3, fc = (int)mesh.corners.size( ) / 3;
+  size_t j;
+  fprintf(out, "ply\nformat %s 1.0\nelement vertex %d\n", layout.format, vc);
+  for( j = 0; j < layout.vertex.size( ); j++ ){
+    fprintf(out, "property %s\n", layout.vertex[j].c_str( ));
+  }
+  fprintf(out, "element face %d\n", fc);
+  for( j = 0; j < layout.face.size( ); j++ ){
+    fprintf(out, "property %s\n", layout.face[j].c_str( ));
+  }
+  fprintf(out, "end_header\n");
+  for( int i = 0; i < vc; i++ ){
+    for( j = 0; j < layout.vertex.size( ); j++ ){
+      char type[32], name[32];
+      sscanf(layout.vertex[j].c_str( ), "%31s %31s", type, name);
+      writeScalar(out, layout, type, propertyValue(positions, i, name));
+    }
+    if( strcmp(layout.format, "ascii") == 0 ){
+      fprintf(out, "\n");
+    }
+  }
+  for( int f = 0; f < fc; f++ ){
+    for( j = 0; j < layout.face.size( ); j++ ){
+      char type[32], countType[32], indexType[32];
+      if( sscanf(layout.face[j].c_str( ), "list %31s %31s", countType, indexType) == 2 ){
+        writeScalar(out, layout, countType, 3);
+        for( int k = 0; k < 3; k++ ){
+          writeScalar(out, layout, indexType, mesh.corners[3 * f + k]);
+        }
+      }else{
+        sscanf(layout.face[j].c_str( ), "%31s", type);
+        writeScalar(out, layout, type, 3);
+      }
+    }
+    if( strcmp(layout.format, "ascii") == 0 ){
+      fprintf(out, "\n");
+    }
+  }
+  fclose(out);
+  return path;
+}
+
+template <typename T>
+static bool sameArray( const T* a, const T* b, size_t count ){
+  return (a == NULL) == (b == NULL) && (a == NULL || memcmp(a, b, count * sizeof(T)) == 0);
+}
+
+/*
+ * Whether a and b are the same mesh to the bit: vertices, normals,
+ * faces and everything built from them. Colors are only compared when
+ * the file gave them; otherwise they are random.
+ */
+static bool sameMesh( const FaceList* a, const FaceList* b, bool colors ){
+  return a->vc == b->vc && a->fc == b->fc && a->meshletCount == b->meshletCount && a->lodCount == b->lodCount &&
+    a->hullPlaneCount == b->hullPlaneCount && a->hullVertexCount == b->hullVertexCount &&
+    sameArray(a->vertices, b->vertices, a->vc) && sameArray(a->v_normals, b->v_normals, a->vc) &&
+    sameArray(a->texcoords, b->texcoords, a->vc) && (!colors || sameArray(a->colors, b->colors, a->vc)) &&
+    sameArray(a->faces, b->faces, a->fc) && sameArray(a->f_normals, b->f_normals, a->fc) &&
+    sameArray(a->meshlets, b->meshlets, a->meshletCount) && sameArray(a->lods, b->lods, a->lodCount) &&
+    sameArray(a->lodFaces, b->lodFaces, a->lodFaceCount( )) &&
+    sameArray(a->hullPlanes, b->hullPlanes, a->hullPlaneCount) && sameArray(a->hullVertices, b->hullVertices, a->hullVertexCount) &&
+    a->radius == b->radius && memcmp(a->center, b->center, sizeof(a->center)) == 0;
+}
+
+/*
+ * Rewrite filename in each of layouts and check each loads the same as
+ * the first.
+ */
+static void checkLayouts( const char* filename, const PlyLayout* layouts, int count, bool colors ){
+  StreamedMesh mesh;
+  streamPlyModel(filename, mesh);
+  FaceList *first = NULL;
+  for( int i = 0; i < count; i++ ){
+    std::string path = writeLayout(mesh, filename, layouts[i]);
+    FaceList *fl = readPlyModel(path.c_str( ));
+    remove(path.c_str( ));
+    if( i == 0 ){
+      first = fl;
+      continue;
+    }
+    std::string what = std::string(layouts[i].name) + " loads the same as " + layouts[0].name;
+    check(sameMesh(first, fl, colors), filename, what.c_str( ));
+    FaceList::release(fl);
+  }
+  FaceList::release(first);
+}
+
+// The same positions in either byte order, as 32 and 64 bit floats
+static const PlyLayout byteOrders[] = {
+  { "ascii", "ascii", { "float x", "float y", "float z" }, { "list uchar int vertex_indices" } },
+  { "le32", "binary_little_endian", { "float x", "float y", "float z" }, { "list uchar int vertex_indices" } },
+  { "be32", "binary_big_endian", { "float x", "float y", "float z" }, { "list uchar int vertex_indices" } },
+  { "le64", "binary_little_endian", { "double x", "double y", "double z" }, { "list uchar int vertex_indices" } },
+  { "be64", "binary_big_endian", { "double x", "double y", "double z" }, { "list uchar int vertex_indices" } }
+};
+
+/*
+ * Large enough for readPlyModel to parse and process it on its thread
+ * pool: a wavy grid of side by side vertices, half of it in quads so
+ * the faces fan into a different number of triangles than lines
+ */
+static void writeGrid( const char* path, int side ){
+  FILE *out = fopen(path, "w");
+  if( !out ){
+    return;
+  }
+  int cells = side - 1, quads = cells * cells / 2, triangles = 2 * (cells * cells - quads);
+  fprintf(out, "ply\nformat ascii 1.0\nelement vertex %d\nproperty float x\nproperty float y\nproperty float z\n"
+    "element face %d\nproperty list uchar int vertex_indices\nend_header\n", side * side, quads + triangles);
+  for( int i = 0; i < side; i++ ){
+    for( int j = 0; j < side; j++ ){
+      fprintf(out, "%.6f %.6f %.6f\n", i * 0.01, j * 0.01, 0.5 * sin(i * 0.3) * cos(j * 0.2));
+    }
+  }
+  for( int c = 0; c < cells * cells; c++ ){
+    int a = c / cells * side + c % cells, b = a + 1, d = a + side, e = d + 1;
+    if( c < quads ){
+      fprintf(out, "4 %d %d %d %d\n", a, b, e, d);
+    }else{
+      fprintf(out, "3 %d %d %d\n3 %d %d %d\n", a, b, e, a, e, d);
+    }
+  }
+  fclose(out);
+}
+
+static void checkThreads( ){
+  const char *path = "data/meshtest.threads.ply";
+  writeGrid(path, 260);
+  // only parsing and the first processing pass run on the pool
+  plyLoadOptions( ).optimize = false;
+  plyLoadOptions( ).threads = 1;
+  FaceList *serial = readPlyModel(path);
+  const int threads[] = { 2, 3, 8 };
+  for( int i = 0; i < 3; i++ ){
+    plyLoadOptions( ).threads = threads[i];
+    FaceList *fl = readPlyModel(path);
+    char what[96];
+    snprintf(what, sizeof(what), "loads the same on %d threads as on one", threads[i]);
+    check(sameMesh(serial, fl, false), path, what);
+    FaceList::release(fl);
+  }
+  plyLoadOptions( ).threads = 0;
+  plyLoadOptions( ).optimize = true;
+  printf("%s: %d vertices, %d faces, loaded on 1, 2, 3 and 8 threads\n", path, serial->vc, serial->fc);
+  FaceList::release(serial);
+  remove(path);
+}
+
+// Positions only, in the fixed layouts and in ones that are not
+static const PlyLayout positionSchemas[] = {
+  { "ascii", "ascii", { "float x", "float y", "float z" }, { "list uchar int vertex_indices" } },
+  { "ascii-other", "ascii", { "uchar flags", "float x", "float y", "float z", "float confidence" }, { "uchar flags", "list uchar int vertex_indices" } },
+  { "ascii-zxy", "ascii", { "float z", "float x", "float y" }, { "list uchar int vertex_indices" } },
+  { "le-other", "binary_little_endian", { "uchar flags", "float x", "float y", "float z" }, { "uchar flags", "list uchar int vertex_indices" } },
+  { "le-mixed", "binary_little_endian", { "double x", "float y", "double z" }, { "list uchar int vertex_indices" } },
+  { "le-ushort", "binary_little_endian", { "float x", "float y", "float z" }, { "list uchar ushort vertex_indices" } },
+  { "be-uint", "binary_big_endian", { "float x", "float y", "float z" }, { "list int uint vertex_indices", "int flags" } }
+};
+
+static const PlyLayout normalSchemas[] = {
+  { "ascii-normals", "ascii", { "float x", "float y", "float z", "float nx", "float ny", "float nz" }, { "list uchar int vertex_indices" } },
+  { "ascii-normals-first", "ascii", { "float nx", "float ny", "float nz", "float x", "float y", "float z" }, { "list uchar int vertex_indices" } },
+  { "le32-normals", "binary_little_endian", { "float x", "float y", "float z", "float nx", "float ny", "float nz" }, { "list uchar int vertex_indices" } },
+  { "le64-normals", "binary_little_endian", { "double x", "double y", "double z", "double nx", "double ny", "double nz" }, { "list uchar int vertex_indices" } },
+  { "be32-normals", "binary_big_endian", { "float x", "float y", "float z", "float nx", "float ny", "float nz" }, { "list uchar int vertex_indices" } }
+};
+
+static const PlyLayout colorSchemas[] = {
+  { "ascii-colors", "ascii", { "float x", "float y", "float z", "uchar red", "uchar green", "uchar blue" }, { "list uchar int vertex_indices" } },
+  { "ascii-colors-first", "ascii", { "uchar red", "uchar green", "uchar blue", "float x", "float y", "float z" }, { "list uchar int vertex_indices" } },
+  { "le32-colors", "binary_little_endian", { "float x", "float y", "float z", "uchar red", "uchar green", "uchar blue" }, { "list uchar int vertex_indices" } },
+  { "be32-colors", "binary_big_endian", { "float x", "float y", "float z", "uchar red", "uchar green", "uchar blue" }, { "list uchar int vertex_indices" } }
+};
+
+static const PlyLayout texcoordSchemas[] = {
+  { "ascii-uv", "ascii", { "float x", "float y", "float z", "float nx", "float ny", "float nz", "float u", "float v" }, { "list uchar int vertex_indices" } },
+  { "ascii-st", "ascii", { "float x", "float y", "float z", "float nx", "float ny", "float nz", "float s", "float t" }, { "list uchar int vertex_indices" } },
+  { "ascii-uv-first", "ascii", { "float u", "float v", "float x", "float y", "float z", "float nx", "float ny", "float nz" }, { "list uchar int vertex_indices" } },
+  { "le32-uv", "binary_little_endian", { "float x", "float y", "float z", "float nx", "float ny", "float nz", "float u", "float v" }, { "list uchar int vertex_indices" } },
+  { "be32-uv", "binary_big_endian", { "float x", "float y", "float z", "float nx", "float ny", "float nz", "float u", "float v" }, { "list uchar int vertex_indices" } }
+};
+
+#define LAYOUTS(layouts) layouts, sizeof(layouts) / sizeof(layouts[0])
+
+int main( ){
+  // Every check starts from the PLY file, not from a baked copy
+  plyLoadOptions( ).useCache = false;
+  srand(1);
+  std::vector<FaceList*> meshes;
+  for( int i = 0; i < testFileCount; i++ ){
+    const char *filename = testFiles[i];
+    FaceList *fl = readPlyModel(filename);
+    check(facesInRange(fl->faces, fl->fc, fl->vc), filename, "face indices are in range");
+    checkMeshlets(fl, filename);
+    checkLods(fl, filename);
+    checkProgressive(fl, filename);
+    checkBake(fl, filename);
+    checkHull(fl, filename);
+    checkPacking(fl, filename);
+    checkStream(filename);
+    checkLayouts(filename, LAYOUTS(byteOrders), false);
+    checkLayouts(filename, LAYOUTS(positionSchemas), false);
+    checkLayouts(filename, LAYOUTS(normalSchemas), false);
+    checkLayouts(filename, LAYOUTS(colorSchemas), true);
+    checkLayouts(filename, LAYOUTS(texcoordSchemas), false);
+    meshes.push_back(fl);
+    printf("%s: %d vertices, %d faces, %d meshlets, %d levels, hull of %d planes\n", filename, fl->vc, fl->fc,
+      fl->meshletCount, fl->lodCount, fl->hullPlaneCount);
+  }
+  checkThreads( );
+  for( size_t i = 0; i + 1 < meshes.size( ); i++ ){
+    checkGjk(meshes[i], meshes[i + 1], testFiles[i]);
+  }
+  for( size_t i = 0; i < meshes.size( ); i++ ){
+    FaceList::release(meshes[i]);
+  }
+
+  if( failures > 0 ){
+    fprintf(stderr, "%d checks failed\n", failures);
+    return 1;
+  }
+  printf("all checks passed\n");
+  return 0;
+}
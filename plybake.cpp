@@ -0,0 +1,218 @@
+/*
+ * plybake
+ *
+ * Offline conversion of PLY models into the baked mesh format read by
+ * readPlyModel (see MeshCache.h). Each model gets the same processing
+ * it would get at application startup -- centering, scaling to a unit
+ * sphere, face and vertex normals, a Ritter bounding sphere, the
+ * vertex cache optimizations of MeshOptimize.h and the levels of detail
+ * of MeshSimplify.h -- and the result is written beside it as
+ * <file>.ply.mesh, with its progressive mesh (ProgressiveMesh.h) as
+ * <file>.ply.pm.
+ *
+ * usage: plybake [-j threads] [-f] [-n] [-r] [-s] <directory or .ply file> ...
+ *   -j  number of files baked at once (default: one per hardware thread)
+ *   -f  rebake even if an up to date baked mesh exists
+ *   -n  bake without optimizing
+ *   -r  bake nothing; report each model's vertex cache misses per
+ *       triangle (ACMR) before and after optimizing, the faces
+ *       and error of each of its levels of detail, the size of its
+ *       progressive mesh, what packing its vertices for drawing
+ *       saves and costs in precision, how much smaller its
+ *       smallest bounding sphere is than Ritter's, and the size of
+ *       its convex hull, whole and capped
+ *   -s  bake nothing; stream each model through PlyStream.h, in
+ *       memory that does not grow with it, and report its box and a
+ *       one pass enclosing sphere as the file has them. A file
+ *       named - is read from standard input.
+ */
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include "PlyModel.h"
+#include "MeshCache.h"
+#include "MeshOptimize.h"
+#include "PlyStream.h"
+#include "ProgressiveMesh.h"
+#include "VertexPacking.h"
+#include "ConvexHull.h"
+#include "ThreadPool.h"
+
+static bool hasPlySuffix(const std::string &name){
+  return name.size( ) > 4 && name.compare(name.size( ) - 4, 4, ".ply") == 0;
+}
+
+static void usage( ){
+  fprintf(stderr, "usage: plybake [-j threads] [-f] [-n] [-r] [-s] <directory or .ply file> ...\n");
+  exit(1);
+}
+
+/*
+ * Append every .ply file named by path to files. A directory
+ * contributes the .ply files directly inside it.
+ */
+static void collectPlyFiles(const char *path, std::vector<std::string> &files){
+  struct stat st;
+  if( stat(path, &st) != 0 ){
+    fprintf(stderr, "plybake: %s not found.\n", path);
+    exit(1);
+  }
+  if( !S_ISDIR(st.st_mode) ){
+    files.push_back(path);
+    return;
+  }
+  DIR *dir = opendir(path);
+  if( !dir ){
+    fprintf(stderr, "plybake: could not read directory %s.\n", path);
+    exit(1);
+  }
+  std::vector<std::string> found;
+  struct dirent *entry;
+  while( (entry = readdir(dir)) != NULL ){
+    std::string name(entry->d_name);
+    if( hasPlySuffix(name) ){
+      found.push_back(std::string(path) + "/" + name);
+    }
+  }
+  closedir(dir);
+  std::sort(found.begin( ), found.end( ));
+  files.insert(files.end( ), found.begin( ), found.end( ));
+}
+
+// The bounds of a streamed model, and how many triangles it has
+class StreamReport : public PlyBoundsHandler{
+public:
+  unsigned int triangles;
+
+  StreamReport( ) : triangles(0){ }
+  void faces( unsigned int first, unsigned int count, const int* indices ){
+    triangles += count;
+  }
+};
+
+int main(int argc, char* argv[]){
+  int threads = 0;
+  bool force = false;
+  bool optimize = true;
+  bool report = false;
+  bool stream = false;
+  std::vector<std::string> files;
+
+  for( int i = 1; i < argc; i++ ){
+    if( strcmp(argv[i], "-j") == 0 ){
+      if( ++i == argc ){
+        usage( );
+      }
+      threads = atoi(argv[i]);
+    }else if( strcmp(argv[i], "-f") == 0 ){
+      force = true;
+    }else if( strcmp(argv[i], "-n") == 0 ){
+      optimize = false;
+    }else if( strcmp(argv[i], "-r") == 0 ){
+      report = true;
+    }else if( strcmp(argv[i], "-s") == 0 ){
+      stream = true;
+    }else if( strcmp(argv[i], "-") == 0 && stream ){
+      files.push_back(argv[i]);
+    }else if( argv[i][0] == '-' ){
+      usage( );
+    }else{
+      collectPlyFiles(argv[i], files);
+    }
+  }
+  if( files.empty( ) ){
+    usage( );
+  }
+
+  // Parallelism comes from baking several files at once; each file is
+  // parsed on the worker that owns it.
+  plyLoadOptions( ).threads = 1;
+  plyLoadOptions( ).useCache = !report;
+  plyLoadOptions( ).optimize = optimize && !report;
+  // the packed copy is made at load, and not baked; the report builds
+  // its own hulls
+  plyLoadOptions( ).pack = false;
+  if( report ){
+    plyLoadOptions( ).hullPlanes = 0;
+  }
+
+  ThreadPool pool(std::min(threads < 1 ? ThreadPool::hardwareThreads( ) : threads, (int)files.size( )));
+  pool.parallelFor((int)files.size( ), [&](int i){
+    const char *filename = files[i].c_str( );
+    if( stream ){
+      StreamReport bounds;
+      streamPlyModel(filename, bounds);
+      printf("%s: %u vertices, %u triangles\n  box (%g, %g, %g) to (%g, %g, %g)\n  sphere at (%g, %g, %g), radius %g\n",
+        filename, bounds.count, bounds.triangles, bounds.min[0], bounds.min[1], bounds.min[2],
+        bounds.max[0], bounds.max[1], bounds.max[2], bounds.center[0], bounds.center[1], bounds.center[2], bounds.radius);
+      return;
+    }
+    if( report ){
+      // Loaded as is, so the optimization can be measured here
+      FaceList *fl = readPlyModel(filename);
+      MeshOptimizeStats stats;
+      optimizeMesh(fl, &stats);
+      // one printf per model so reports from several workers do not mix
+      std::string lods;
+      for( int l = 0; l < fl->lodCount; l++ ){
+        char level[64];
+        snprintf(level, sizeof(level), " %d (%.2g)", fl->lods[l].faceCount, fl->lods[l].error);
+        lods += level;
+      }
+      ProgressiveMesh *pm = buildProgressiveMesh(fl);
+      VertexPackingStats packing;
+      packVertices(fl, &packing);
+      double center[3], ritter, minimal;
+      calcRitterBoundingSphere(center, &ritter, fl);
+      calcMinimalBoundingSphere(center, &minimal, fl);
+      buildHull(fl, 0);
+      int fullPlanes = fl->hullPlaneCount, fullCorners = fl->hullVertexCount;
+      buildHull(fl);
+      printf("%s: %d -> %d vertices, %d -> %d faces, ACMR %.3f -> %.3f\n  levels of detail, faces (error):%s\n"
+        "  progressive mesh: base of %d vertices, %d faces (error %.2g), %d vertex splits\n"
+        "  packed: %d -> %d bytes per vertex, %d -> %d per face; position error %.2g (at most %.2g), normal error %.2g degrees\n"
+        "  bounding sphere radius: Ritter %.4f, smallest %.4f (%.1f%% smaller, %.1f%% less volume)\n"
+        "  convex hull: %d planes, %d corners; capped at %d planes: %d planes, %d corners\n", filename,
+        stats.verticesBefore, stats.verticesAfter, stats.facesBefore, stats.facesAfter,
+        stats.acmrBefore, stats.acmrAfter, lods.empty( ) ? " none" : lods.c_str( ),
+        pm->baseVertices, pm->baseFaces, pm->splits.empty( ) ? 0.0 : pm->splits[0].error, (int)pm->splits.size( ),
+        packing.vertexBytesBefore, packing.vertexBytesAfter, packing.faceBytesBefore, packing.faceBytesAfter,
+        packing.positionError, packing.positionBound, packing.normalDegrees,
+        ritter, minimal, 100.0 * (1.0 - minimal / ritter), 100.0 * (1.0 - pow(minimal / ritter, 3)),
+        fullPlanes, fullCorners, hullMaxPlanes, fl->hullPlaneCount, fl->hullVertexCount);
+      delete pm;
+      delete fl;
+      return;
+    }
+    if( force ){
+      remove(bakedMeshPath(filename).c_str( ));
+      remove(progressiveMeshPath(filename).c_str( ));
+    }
+    FaceList *fl = readPlyModel(filename);
+    printf("%s: %d vertices, %d faces -> %s\n", filename, fl->vc, fl->fc, bakedMeshPath(filename).c_str( ));
+    // A bake that was already up to date may have no progressive mesh
+    // beside it yet
+    uint64_t key;
+    std::string pmPath = progressiveMeshPath(filename);
+    if( optimize && plyCacheKey(filename, &key) ){
+      ProgressiveMeshReader reader;
+      ProgressiveMesh *pm = reader.open(pmPath.c_str( ), key);
+      if( !pm ){
+        pm = buildProgressiveMesh(fl);
+        writeProgressiveMesh(pmPath.c_str( ), key, pm);
+      }
+      delete pm;
+    }
+    delete fl;
+  });
+  return 0;
+}
@@ -135,6 +135,14 @@ public:
                                              "projectionMatrix");
     uNormalMatrix = glGetUniformLocation(shaderProgram.id( ),
                                          "normalMatrix");
+    myGraph.uModelViewMatrix = uModelViewMatrix;
+    myGraph.uNormalMatrix = uNormalMatrix;
+    myGraph.uPackedVertices = glGetUniformLocation(shaderProgram.id( ),
+                                                   "packedVertices");
+    myGraph.uPackScale = glGetUniformLocation(shaderProgram.id( ),
+                                              "packScale");
+    myGraph.uPackOffset = glGetUniformLocation(shaderProgram.id( ),
+                                               "packOffset");
     uLight0_position = glGetUniformLocation(shaderProgram.id( ),
                                             "light0_position");
     uLight0_color = glGetUniformLocation(shaderProgram.id( ),
@@ -198,14 +206,12 @@ public:
   }
 
 	void isInFrustum(){
-		Vec3 point;
+		//an object is left out once its sphere, its box or, when used, its hull is wholly outside one of the planes
+		bool hull = myGraph.useHulls;
 		for(int x = 1; x < numObj; x++){
-			point = Vec3(myGraph.myObjs[x].FL->center[0], myGraph.myObjs[x].FL->center[1], myGraph.myObjs[x].FL->center[2]);
-			float distLeft	= dot(leftNorm, (point - eyePosition));
-			float distRight	= dot(rightNorm, (point - eyePosition));
-			float distTop	= dot(topNorm, (point - eyePosition));
-			float distBot	= dot(bottomNorm, (point - eyePosition));
-			if(distLeft>0 || distRight>0 || distTop>0 || distBot>0){
+			SceneObj &o = myGraph.myObjs[x];
+			if(o.outside(leftNorm, eyePosition, hull) || o.outside(rightNorm, eyePosition, hull) ||
+				o.outside(topNorm, eyePosition, hull) || o.outside(bottomNorm, eyePosition, hull)){
 				myGraph.myObjs[x].draw = false;
 			}else{
 				myGraph.myObjs[x].draw = true;
@@ -213,14 +219,14 @@ public:
 		}
 	}
   
-  bool pick(int x, int y, FaceList *fl){
+  bool pick(int x, int y, BBox bb){
 		bool result = false;
     		float center[3];
 		for(int i = 0; i < 3; i++){
-			center[i] = fl->center[i];
+			center[i] = bb.center[i];
 		}
 		Point3 cc(center);
-		BoundingSphere boundingSphere(cc, fl->radius);
+		BoundingSphere boundingSphere(cc, bb.width);
 		GLViewPort vp;
 		    /*******
 		     * With the double unproject technique
@@ -311,6 +317,8 @@ public:
     double ratio = double(w[0]) / double(w[1]);
 
     projectionMatrix = perspective(50.0, ratio, 1.0, 25.0);
+    myGraph.projectionMatrix = projectionMatrix;
+    myGraph.viewportHeight = w[1];
 
     modelViewMatrix = lookat(eyePosition, centerPosition, upVector);
 
@@ -398,10 +406,8 @@ public:
     
 	//Show bounding sphere
 	if(myGraph.showBB>=0 && myGraph.boolBB == true){
-		myGraph.drawBoundingSphere(Vec3(myGraph.myObjs[myGraph.showBB].FL->center[0],
-						myGraph.myObjs[myGraph.showBB].FL->center[1],
-						myGraph.myObjs[myGraph.showBB].FL->center[2]),
-						myGraph.myObjs[myGraph.showBB].FL->radius);
+		myGraph.drawBoundingSphere(myGraph.myObjs[myGraph.showBB].BB.center,
+						myGraph.myObjs[myGraph.showBB].BB.width);
 	}
 
 	if(myGraph.selectedObj > 0){
@@ -420,44 +426,44 @@ public:
 			myGraph.translate(&myGraph.myObjs[myGraph.selectedObj],0,-0.1);
 		}
 		else if(isKeyPressed('D')){
-			Vec3 axis = Vec3(	myGraph.myObjs[myGraph.selectedObj].FL->center[0],
-						myGraph.myObjs[myGraph.selectedObj].FL->center[1]+1,
-						myGraph.myObjs[myGraph.selectedObj].FL->center[2]);
-			axis = axis - Vec3(	myGraph.myObjs[myGraph.selectedObj].FL->center[0],
-						myGraph.myObjs[myGraph.selectedObj].FL->center[1],
-						myGraph.myObjs[myGraph.selectedObj].FL->center[2]);
+			Vec3 axis = Vec3(	myGraph.myObjs[myGraph.selectedObj].BB.center[0],
+						myGraph.myObjs[myGraph.selectedObj].BB.center[1]+1,
+						myGraph.myObjs[myGraph.selectedObj].BB.center[2]);
+			axis = axis - Vec3(	myGraph.myObjs[myGraph.selectedObj].BB.center[0],
+						myGraph.myObjs[myGraph.selectedObj].BB.center[1],
+						myGraph.myObjs[myGraph.selectedObj].BB.center[2]);
 			//axis -= centerPosition;
-			myGraph.myObjs[myGraph.selectedObj].FL->rotate(axis,0.1);
+			myGraph.rotate(&myGraph.myObjs[myGraph.selectedObj], axis, 0.1);
 		}
 		else if(isKeyPressed('W')){
-			Vec3 axis = Vec3(	myGraph.myObjs[myGraph.selectedObj].FL->center[0]+0.5,
-						myGraph.myObjs[myGraph.selectedObj].FL->center[1],
-						myGraph.myObjs[myGraph.selectedObj].FL->center[2]);
-			axis = axis - Vec3(	myGraph.myObjs[myGraph.selectedObj].FL->center[0],
-						myGraph.myObjs[myGraph.selectedObj].FL->center[1],
-						myGraph.myObjs[myGraph.selectedObj].FL->center[2]);
+			Vec3 axis = Vec3(	myGraph.myObjs[myGraph.selectedObj].BB.center[0]+0.5,
+						myGraph.myObjs[myGraph.selectedObj].BB.center[1],
+						myGraph.myObjs[myGraph.selectedObj].BB.center[2]);
+			axis = axis - Vec3(	myGraph.myObjs[myGraph.selectedObj].BB.center[0],
+						myGraph.myObjs[myGraph.selectedObj].BB.center[1],
+						myGraph.myObjs[myGraph.selectedObj].BB.center[2]);
 			//axis -= centerPosition;
-			myGraph.myObjs[myGraph.selectedObj].FL->rotate(axis,0.1);
+			myGraph.rotate(&myGraph.myObjs[myGraph.selectedObj], axis, 0.1);
 		}
 		else if(isKeyPressed('A')){
-			Vec3 axis = Vec3(	myGraph.myObjs[myGraph.selectedObj].FL->center[0],
-						myGraph.myObjs[myGraph.selectedObj].FL->center[1]+1,
-						myGraph.myObjs[myGraph.selectedObj].FL->center[2]);
-			axis = axis - Vec3(	myGraph.myObjs[myGraph.selectedObj].FL->center[0],
-						myGraph.myObjs[myGraph.selectedObj].FL->center[1],
-						myGraph.myObjs[myGraph.selectedObj].FL->center[2]);
+			Vec3 axis = Vec3(	myGraph.myObjs[myGraph.selectedObj].BB.center[0],
+						myGraph.myObjs[myGraph.selectedObj].BB.center[1]+1,
+						myGraph.myObjs[myGraph.selectedObj].BB.center[2]);
+			axis = axis - Vec3(	myGraph.myObjs[myGraph.selectedObj].BB.center[0],
+						myGraph.myObjs[myGraph.selectedObj].BB.center[1],
+						myGraph.myObjs[myGraph.selectedObj].BB.center[2]);
 			//axis -= centerPosition;
-			myGraph.myObjs[myGraph.selectedObj].FL->rotate(axis,-0.1);
+			myGraph.rotate(&myGraph.myObjs[myGraph.selectedObj], axis, -0.1);
 		}
 		else if(isKeyPressed('S')){
-			Vec3 axis = Vec3(	myGraph.myObjs[myGraph.selectedObj].FL->center[0]+0.5,
-						myGraph.myObjs[myGraph.selectedObj].FL->center[1],
-						myGraph.myObjs[myGraph.selectedObj].FL->center[2]);
-			axis = axis - Vec3(	myGraph.myObjs[myGraph.selectedObj].FL->center[0],
-						myGraph.myObjs[myGraph.selectedObj].FL->center[1],
-						myGraph.myObjs[myGraph.selectedObj].FL->center[2]);
+			Vec3 axis = Vec3(	myGraph.myObjs[myGraph.selectedObj].BB.center[0]+0.5,
+						myGraph.myObjs[myGraph.selectedObj].BB.center[1],
+						myGraph.myObjs[myGraph.selectedObj].BB.center[2]);
+			axis = axis - Vec3(	myGraph.myObjs[myGraph.selectedObj].BB.center[0],
+						myGraph.myObjs[myGraph.selectedObj].BB.center[1],
+						myGraph.myObjs[myGraph.selectedObj].BB.center[2]);
 			//axis -= centerPosition;
-			myGraph.myObjs[myGraph.selectedObj].FL->rotate(axis,-0.1);
+			myGraph.rotate(&myGraph.myObjs[myGraph.selectedObj], axis, -0.1);
 		}
 		
 	}
@@ -472,14 +478,53 @@ public:
 		}
 	}
 
+	if(isKeyPressed('M')){
+		myGraph.printMemoryStats();
+	}
+
+	if(isKeyPressed('K')){
+		myGraph.printCullStats();
+	}
+
+	if(isKeyPressed('C')){
+		myGraph.cullBackfaces = !myGraph.cullBackfaces;
+	}
+
+	if(isKeyPressed('X')){
+		myGraph.useHulls = !myGraph.useHulls;
+		printf("Convex hulls: %s\n", myGraph.useHulls ? "on" : "off");
+	}
+
+	if(isKeyPressed('L')){
+		//off, fixed levels, progressive, and round again
+		myGraph.lodMode = LodMode((myGraph.lodMode + 1) % 3);
+		const char *modes[] = {"off", "fixed levels", "progressive"};
+		printf("Level of detail: %s\n", modes[myGraph.lodMode]);
+	}
+
+	if(isKeyPressed('E') && myGraph.selectedObj > 0){
+		//Ritter's sphere or the smallest one for the selected model
+		SceneObj &o = myGraph.myObjs[myGraph.selectedObj];
+		o.setSphereMethod(o.sphereMethod == RITTER_SPHERE ? MINIMAL_SPHERE : RITTER_SPHERE);
+		o.refreshBounds();
+		printf("%s: %s bounding sphere, radius %f\n", o.name.c_str(),
+			o.sphereMethod == RITTER_SPHERE ? "Ritter" : "smallest", o.localRadius);
+	}
+
 	if(isKeyPressed('I')){
 		printf( "Controls are as follows: ");
 		printf( "shift+mouse: trackball movement");
 		printf( "b: toggle rendering the bounding volumes");
 		printf( "i: print a help message");
+		printf( "m: print how much memory the scene uses");
+		printf( "k: print how many meshlets and faces culling and levels of detail left out");
+		printf( "c: toggle culling meshlets that face away");
+		printf( "x: toggle testing the models' convex hulls when culling and checking for collisions");
+		printf( "l: switch how distant models are drawn coarser: not at all, fixed levels, or progressively");
+		printf( "e: switch the selected model between Ritter's bounding sphere and the smallest one");
 		printf( "q/esc: quit");
 		printf( "r: reset camera orientation to default state (bugged)");
-		printf( "w, a, s, d: rotate the selected model (bugged)");
+		printf( "w, a, s, d: rotate the selected model");
 		printf( "arrow keys: moves the camera forward, backward, to the left and to the right");
 		printf( "t, f, g, h: translate the selected model");
 	}
@@ -561,7 +606,7 @@ public:
 		//When the left mouse button in clicked, pick() is called, determining which object is selected
 		Vec2 mousePosition = mouseCurrentPosition( );
 		for(int x=1; x<numObj; x++){
-			if(pick(mousePosition[0], mousePosition[1], myGraph.myObjs[x].FL)){
+			if(myGraph.myObjs[x].FL != NULL && pick(mousePosition[0], mousePosition[1], myGraph.myObjs[x].BB)){
 				myGraph.showBB = x;
 				myGraph.selectedObj = x;
 				break;